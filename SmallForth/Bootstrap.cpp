@@ -0,0 +1,171 @@
+#include "ForthDefs.h"
+#include <iostream>
+#include <sstream>
+#include "Bootstrap.h"
+#include "ExecState.h"
+#include "TypeSystem.h"
+#include "ForthString.h"
+#include "ForthFile.h"
+#include "ForthArray.h"
+#include "Vector3.h"
+#include "ForthChannel.h"
+#include "PreBuiltWords.h"
+#include "DictionaryImage.h"
+#include "InputProcessor.h"
+#include "ForthDict.h"
+#include "DataStack.h"
+#include "ReturnStack.h"
+#include "CompileHelper.h"
+#include "DebugHelper.h"
+#include "ZeroCountTable.h"
+
+void Bootstrap::InitialiseTypeSystem(ExecState* pExecState) {
+	TypeSystem* ts = TypeSystem::GetTypeSystem();
+	ts->RegisterValueType(pExecState, "undefined");
+	ts->RegisterValueType(pExecState, "char");
+	ts->RegisterValueType(pExecState, "int");
+	ts->RegisterValueType(pExecState, "float");
+	ts->RegisterValueType(pExecState, "bool");
+	ts->RegisterValueType(pExecState, "type");
+	ts->RegisterValueType(pExecState, "xt");
+	ts->RegisterValueType(pExecState, "binaryopstype");
+	ts->RegisterValueType(pExecState, "ptertocfa");
+
+	ts->RegisterObjectType(pExecState, "word", nullptr);
+	ts->RegisterObjectType(pExecState, "dict", nullptr);
+	ts->RegisterObjectType(pExecState, "string", ForthString::Construct);
+	ts->RegisterObjectType(pExecState, "readfile", ForthFile::ConstructReadFile);
+	ts->RegisterObjectType(pExecState, "writefile", ForthFile::ConstructWriteFile);
+	ts->RegisterObjectType(pExecState, "readwritefile", ForthFile::ConstructReadWriteFile);
+	ts->RegisterObjectType(pExecState, "array", ForthArray::Construct);
+	ts->RegisterObjectType(pExecState, "vector3", Vector3::Construct, Vector3::BinaryOps);
+	ts->RegisterObjectType(pExecState, "future", nullptr);
+	ts->RegisterObjectType(pExecState, "channel", ForthChannel::Construct);
+	ts->RegisterObjectType(pExecState, "task", nullptr);
+	ts->RegisterObjectType(pExecState, "generator", nullptr);
+}
+
+void Bootstrap::InitialiseDict(ExecState* pExecState) {
+	PreBuiltWords::RegisterWords(pExecState->pDict);
+	PreBuiltWords::CreateSecondLevelWords(pExecState);
+	CreateTypeWords(pExecState);
+	CreateFileTypes(pExecState);
+}
+
+bool Bootstrap::InitialiseDictFromImage(ExecState* pExecState, const std::string& imagePath) {
+	PreBuiltWords::RegisterWords(pExecState->pDict);
+	DictionaryImage image(pExecState);
+	if (!image.Load(imagePath)) {
+		std::ostream* pStderr = pExecState->GetStderr();
+		(*pStderr) << "Exception: " << pExecState->pzException << ": " << imagePath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+ExecState* Bootstrap::CreateExecState(ForthDict* pSharedDict) {
+	ForthDict* pDict = pSharedDict != nullptr ? new ForthDict(pSharedDict) : new ForthDict();
+	return CreateExecStateUsingDict(pDict);
+}
+
+ExecState* Bootstrap::CreateExecStateUsingDict(ForthDict* pDict) {
+	ExecState* pExecState = new ExecState(new DataStack(40), pDict, new InputProcessor(), new ReturnStack(40), new CompileHelper(), new DebugHelper());
+	return pExecState;
+}
+
+void Bootstrap::DeleteExecState(ExecState* pExecState) {
+	InputProcessor* pInputProcessor = pExecState->pInputProcessor;
+	DataStack* pStack = pExecState->pStack;
+	ReturnStack* pReturnStack = pExecState->pReturnStack;
+	CompileHelper* pCompiler = pExecState->pCompiler;
+	DebugHelper* pDebugger = pExecState->pDebugger;
+	delete pExecState;
+	delete pInputProcessor;
+	delete pStack;
+	delete pReturnStack;
+	delete pCompiler;
+	delete pDebugger;
+	// Unless another ExecState on this thread is still in use, nothing is left on this thread's stacks, so everything
+	//  released is deleted now rather than at a safe point that might never come.  For the same reason the thread
+	//  gives up ownership of the objects that escaped from it
+	ZeroCountTable* pZCT = ZeroCountTable::GetZeroCountTable();
+	if (!pZCT->HasStacks()) {
+		pZCT->Reconcile();
+		pZCT->MergeEscapedObjects();
+		pZCT->Reconcile();
+	}
+}
+
+bool Bootstrap::InterpretForth(ExecState* pExecState, const std::string& toExecute) {
+	pExecState->pInputProcessor->SetInputString(toExecute);
+	return pExecState->pInputProcessor->Interpret(pExecState);
+}
+
+void Bootstrap::CreateTypeWords(ExecState* pExecState) {
+	std::stringstream ss;
+	ss << ": word_type " << ObjectType_Word << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": dict_type " << ObjectType_Dict << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": string_type " << ObjectType_String << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": readfile_type " << ObjectType_ReadFile << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": writefile_type " << ObjectType_WriteFile << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": readwritefile_type " << ObjectType_ReadWriteFile << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": array_type " << ObjectType_Array << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+
+	ss << ": vector3_type " << ObjectType_Vector3 << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": future_type " << ObjectType_Future << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": channel_type " << ObjectType_Channel << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": task_type " << ObjectType_Task << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+	ss.str(std::string());
+
+	ss << ": generator_type " << ObjectType_Generator << " typefromint ; ";
+	InterpretForth(pExecState, ss.str());
+}
+
+void Bootstrap::CreateFileTypes(ExecState* pExecState) {
+	std::stringstream ss;
+	ss << ": #stdout " << forth_stdout << " ; ";
+	InterpretForth(pExecState, ss.str());
+
+	ss.str(std::string());
+	ss << ": #stderr " << forth_stderr << " ; ";
+	InterpretForth(pExecState, ss.str());
+
+	ss.str(std::string());
+	ss << ": #stdin " << forth_stdin << " ; ";
+	InterpretForth(pExecState, ss.str());
+
+	ss.str(std::string());
+
+	InterpretForth(pExecState, "#stdout writefile_type construct constant stdout");
+	InterpretForth(pExecState, "#stderr writefile_type construct constant stderr");
+	InterpretForth(pExecState, "#stdin readfile_type construct constant stdin");
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+class ExecState;
+class ForthDict;
+
+// Brings up a new interpreter: registers the built-in types, then fills the dictionary either by registering the
+//  built-in words and interpreting the second-level words, or from a saved dictionary image.  Once initialised, the
+//  dictionary can be shared by further ExecStates running on other threads.
+class Bootstrap
+{
+public:
+	static void InitialiseTypeSystem(ExecState* pExecState);
+	static void InitialiseDict(ExecState* pExecState);
+	static bool InitialiseDictFromImage(ExecState* pExecState, const std::string& imagePath);
+
+	// Creates an ExecState with its own stacks, input processor and helpers.  Given a shared dictionary (see
+	//  ForthDict::Share) the ExecState gets a dictionary layered over it, and must then be created, used and
+	//  deleted on one thread; otherwise it gets a new, empty dictionary
+	static ExecState* CreateExecState(ForthDict* pSharedDict);
+	// Creates an ExecState using pDict itself, for another ExecState on the thread that owns pDict (a green task)
+	static ExecState* CreateExecStateUsingDict(ForthDict* pDict);
+	static void DeleteExecState(ExecState* pExecState);
+
+private:
+	static void CreateTypeWords(ExecState* pExecState);
+	static void CreateFileTypes(ExecState* pExecState);
+	static bool InterpretForth(ExecState* pExecState, const std::string& toExecute);
+};
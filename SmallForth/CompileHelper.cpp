@@ -116,6 +116,14 @@ void CompileHelper::CompileWBEIntoWordBeingCreated(ExecState* pExecState, WordBo
 	this->pWordUnderCreation->CompileLiteralIntoWord(pWBE);
 }
 
+void CompileHelper::CompileObjectWBEIntoWordBeingCreated(ExecState* /*pExecState*/, WordBodyElement* pWBE) {
+	this->pWordUnderCreation->CompileObjectLiteralIntoWord(pWBE);
+}
+
+void CompileHelper::CompileCFAWBEIntoWordBeingCreated(ExecState* /*pExecState*/, WordBodyElement* pWBE) {
+	this->pWordUnderCreation->CompileCFALiteralIntoWord(pWBE);
+}
+
 void CompileHelper::CompileTypeIntoWordBeingCreated(ExecState* pExecState, ForthType forthType) {
 	this->pWordUnderCreation->CompileTypeIntoWord(forthType);
 }
@@ -165,6 +173,8 @@ bool CompileHelper::RevealWord(ExecState* pExecState, bool revealToVocNotStack)
 	if (this->pWordUnderCreation == nullptr) {
 		return pExecState->CreateException("No word to reveal");
 	}
+	// Before it is added, as once added to a shared dictionary other threads may find it
+	this->pWordUnderCreation->SetWordVisibility(true);
 	if (revealToVocNotStack) {
 		pExecState->pDict->AddWord(this->pWordUnderCreation);
 	}
@@ -175,7 +185,6 @@ bool CompileHelper::RevealWord(ExecState* pExecState, bool revealToVocNotStack)
 			return pExecState->CreateStackOverflowException();
 		}
 	}
-	this->pWordUnderCreation->SetWordVisibility(true);
 	if (this->pLastWordCreated != nullptr) {
 		this->pLastWordCreated->DecReference();
 		this->pLastWordCreated = nullptr;
@@ -325,6 +334,7 @@ bool CompileHelper::ExecuteLastWordCompiled(ExecState* pExecState) {
 	XT executeXT = ppExecBody[0]->wordElement_XT;
 	pExecState->NestAndSetCFA(ppExecBody, 1);
 	try {
+		BuiltInExecuting builtIn(pExecState, executeXT);
 		response = executeXT(pExecState);
 	}
 	catch (...) {
@@ -24,6 +24,8 @@ public:
 	void CompileLiteralIntoWordBeingCreated(ExecState* pExecState, char literal);
 	void CompileLiteralIntoWordBeingCreated(ExecState* pExecState, double literal);
 	void CompileWBEIntoWordBeingCreated(ExecState* pExecState, WordBodyElement* pWBE);
+	void CompileObjectWBEIntoWordBeingCreated(ExecState* pExecState, WordBodyElement* pWBE);
+	void CompileCFAWBEIntoWordBeingCreated(ExecState* pExecState, WordBodyElement* pWBE);
 	void CompileTypeIntoWordBeingCreated(ExecState* pExecState, ForthType forthType);
 	void CompilePterIntoWordBeingCreated(ExecState* pExecState, void* voidPter);
 
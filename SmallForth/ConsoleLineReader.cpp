@@ -0,0 +1,400 @@
+#include <iostream>
+#include <conio.h>
+#include <Windows.h>
+#include "ConsoleLineReader.h"
+#include "ExecState.h"
+#include "InputProcessor.h"
+
+int ConsoleLineReader::HandlerRoutine(unsigned long fdwCtrlType) {
+	if (fdwCtrlType == CTRL_C_EVENT) {
+		InputProcessor::RequestExecutionHalt();
+		return TRUE;
+	}
+	return FALSE;
+}
+
+ConsoleLineReader::ConsoleLineReader() {
+	SetConsoleCtrlHandler(HandlerRoutine, TRUE);
+
+	commandHistoryLine = 0;
+	exitApplication = false;
+	historySize = 500;
+}
+
+// ctrl-c on an empty line ends the input, and so the application
+bool ConsoleLineReader::ReadLine(ExecState* pExecState, const std::string& prompt, std::string& line) {
+	std::ostream* pStdout = pExecState->GetStdout();
+	(*pStdout) << prompt;
+	// Cannot simply call getline, as that will not process ctrl-c correctly (ctrl-c on empy line exits programme. ctrl-c on line with input, cancels line)
+	//  As getting input from cin only processes the ctrl-c once enter has been pressed
+	line = ReadConsoleLine(pStdout);
+	return !this->exitApplication;
+}
+
+char ConsoleLineReader::ReadChar() {
+	int c = _getch();
+	return c;
+}
+
+std::string ConsoleLineReader::ReadConsoleLine(std::ostream* pStdout) {
+	// Have to process forward/backward arrows, home/end, up and down (through history), insert characters, delete/backspace without relying on the console implementation
+	// This is made more complex by the fact that the console, when told to advance from the last character on a console line (to the next line), actually keeps the cursor before the last 
+	//  character on the line. Doing this prevents the code from calculating the start position of the current line - cannot just store the start position as it moves around on resizing and scrolling
+	int cursorPositionInLine = 0;
+	std::string line;
+	while (true) {
+		int c = _getch();
+		if (c == 3) {
+			// ctrl-c
+			if (line.length() > 0) {
+				(*pStdout) << "^c";
+				line = std::string();
+				(*pStdout) << "\n";
+				cursorPositionInLine = 0;
+				return line;
+			}
+			else {
+				this->exitApplication = true;
+				return "";
+			}
+		}
+		if (c == 0xe0 || c==0x00) {
+			// Start of scanline codes
+			c = _getch();
+			cursorPositionInLine = ProcessScanLineCode(pStdout, line, cursorPositionInLine, c);
+		}
+		else if (c == 27) {
+			// escape
+			BlankCurrentLine(pStdout, line, cursorPositionInLine);
+			line = "";
+			cursorPositionInLine = 0;
+		}
+		else if (c == 9) {
+			// tab
+			cursorPositionInLine = InsertIntoLine(pStdout, line, cursorPositionInLine, ' ');
+			cursorPositionInLine = InsertIntoLine(pStdout, line, cursorPositionInLine, ' ');
+		}
+		else if (c == 8) {
+			// Backspace
+			if (cursorPositionInLine > 0) {
+				ProcessBackspace(pStdout, line, cursorPositionInLine);
+			}
+		}
+		else if (c == 13 || c == 10) {
+			// This is to ensure that over a multi-(console)-line input, if the cursor isn't on the final console line
+			//  that the further console output doesn't overwrite the input
+			MoveToLineEnd(pStdout, line, cursorPositionInLine);
+			(*pStdout) << '\n';
+			break;
+		}
+		else {
+			cursorPositionInLine = InsertIntoLine(pStdout, line, cursorPositionInLine, c);
+		}
+	}
+	if (line.length() > 0) {
+		AddLineToHistory(line);
+	}
+	return line;
+}
+
+int ConsoleLineReader::ProcessScanLineCode(std::ostream* pStdout, std::string& line, int cursorPositionInLine, int scanlineCode) {
+	if (scanlineCode == 0x4b && cursorPositionInLine > 0) {
+		// Left arrow
+		int x;
+		int y;
+		int width;
+		int height;
+		this->GetCursorPositionAndSize(x, y, width, height);
+		if (x == 0)
+		{
+			SetCursorPosition(width - 1, y - 1);
+		}
+		else {
+			SetCursorPosition(x - 1, y);
+		}
+
+		//(*pStdout) << '\b';
+		cursorPositionInLine--;
+	}
+	else if (scanlineCode == 0x4d && cursorPositionInLine < line.length()) {
+		// Right arrow
+
+		// Normal console behaviour is odd at the end of a console line. It doesn't move the cursor the next console-line, or move it after the last character (on the console line), but keeps 
+		//  it on (before) the last character on the line instead of after it.
+		// This code moves it to the next line (as can't place it after it), which ensures backspace from end of console line (or next console line), works correctly.
+		int x;
+		int y;
+		int width;
+		int height;
+		this->GetCursorPositionAndSize(x, y, width, height);
+		if (x < width-1) {
+			++x;
+		}
+		else {
+			x = 0;
+			++y;
+		}
+		++cursorPositionInLine;
+		this->SetCursorPosition(x, y);
+	}
+	else if (scanlineCode == 0x48 && commandHistoryLine > 0) {
+		// Go up in history
+		BlankCurrentLine(pStdout, line, cursorPositionInLine);
+		line = MoveUpInHistory();
+		(*pStdout) << line;
+		cursorPositionInLine = (int)line.length();
+	}
+	else if (scanlineCode == 0x50 && this->commandHistoryLine < this->commandHistory.size()) {
+		// Go down in history
+		BlankCurrentLine(pStdout, line, cursorPositionInLine);
+		line = MoveDownInHistory();
+		(*pStdout) << line;
+		cursorPositionInLine = (int)line.length();
+	}
+	else if (scanlineCode == 0x53 && cursorPositionInLine < line.length()) {
+		// Delete pressed
+		line = line.substr(0, cursorPositionInLine) + line.substr(cursorPositionInLine + 1);
+		WriteLineFromPosition(pStdout, line, cursorPositionInLine, true);
+	}
+	else if (scanlineCode == 0x47) {
+		// home
+		MoveToPosition(pStdout, line, cursorPositionInLine, 0);
+		cursorPositionInLine = 0;
+	}
+	else if (scanlineCode == 0x4f) {
+		// end
+		MoveToLineEnd(pStdout, line, cursorPositionInLine);
+	}
+
+	return cursorPositionInLine;
+}
+
+void ConsoleLineReader::MoveToLineEnd(std::ostream* pStdout, std::string& line, int& cursorPositionInLine) {
+	MoveToPosition(pStdout, line, cursorPositionInLine, (int)line.length());
+	cursorPositionInLine = (int)line.length();
+}
+
+void ConsoleLineReader::ProcessBackspace(std::ostream* pStdout, std::string& line, int& cursorPositionInLine) {
+	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+	int startX;
+	int startY;
+	CalculateLineStartPosition(cursorPositionInLine, startX, startY);
+
+	// Backspace won't work if cursor is currently at the start on the console line (as in the text line overspills)
+	int x;
+	int y;
+	int width;
+	int height;
+	this->GetCursorPositionAndSize(x, y, width, height);
+	if (y > startY && x == 0) {
+		SetCursorPosition(width - 1, y - 1);
+		(*pStdout) << " ";
+		SetCursorPosition(width-1, y - 1);
+	}
+	else {
+		// Backsace is fine here
+		(*pStdout) << (char)'\b';
+	}
+
+	line = line.substr(0, cursorPositionInLine - 1) + line.substr(cursorPositionInLine);
+	--cursorPositionInLine;
+	WriteLineFromPosition(pStdout, line, cursorPositionInLine, true);
+}
+
+int ConsoleLineReader::InsertIntoLine(std::ostream* pStdout, std::string& line, int cursorPositionInLine, char toInsert) {
+	// First insert the character into the string line
+	if (line.length() == 0) {
+		line += toInsert;
+	}
+	else if (cursorPositionInLine == 0) {
+		line.insert(line.begin(), toInsert);
+	}
+	else {
+		line.insert(cursorPositionInLine, 1, toInsert);
+	}
+	// Then update the console to display line correctly. False means do not add a space on the end (which is used when deleting characters)
+	//  Note, this method needs the cursorPosition, as it used to calculate where the line starts in the console, to re-draw the line fully
+	WriteLineFromPosition(pStdout, line, cursorPositionInLine, false);
+	int x;
+	int y;
+	int width;
+	int height;
+	this->GetCursorPositionAndSize(x, y, width, height);
+
+	// Ensure that if the cursor ends up at the end of the line, it is moved to the next line. To prevent errant behaviour by the console at line ends
+	if (x == width - 1) {
+		x = 0;
+		y++;
+		// Weirdly this line does not move console down if debugging
+		(*pStdout) << "\n";
+		if (y >= height) {
+			y = height - 1;
+		}
+	}
+	else {
+		x++;
+	}
+	SetCursorPosition(x, y);
+	return ++cursorPositionInLine;
+}
+
+void ConsoleLineReader::WriteLineFromPosition(std::ostream* pStdout, const std::string& line, int cursorPosition, bool addExtraSpaceForDeletion) {
+	int x;
+	int y;
+	GetCursorPosition(x, y);
+
+	int startX;
+	int startY;
+	this->CalculateLineStartPosition(cursorPosition, startX, startY);
+	SetCursorPosition(startX, startY);
+
+	int len = (int)line.length();
+
+	(*pStdout) << line;
+	if (addExtraSpaceForDeletion) {
+		len++;
+		(*pStdout) << " ";
+	}
+	int startX_AfterLineOut;
+	int startY_AfterLineOut;
+	this->CalculateLineStartPosition(len, startX_AfterLineOut, startY_AfterLineOut);
+	if (startY_AfterLineOut < startY) {
+		// Console has scrolled
+		y -= startY - startY_AfterLineOut;
+	}
+	SetCursorPosition(x, y);
+}
+
+void ConsoleLineReader::MoveToPosition(std::ostream* pStdout, const std::string& line, int currentPosition, int position) {
+	int x;
+	int y;
+	this->CalculatePositionInLine(currentPosition, position, x,y);
+	this->SetCursorPosition(x, y);
+}
+
+void ConsoleLineReader::BlankCurrentLine(std::ostream* pStdout, const std::string& line, int currentPosition) {
+
+	int startX;
+	int startY;
+	this->CalculateLineStartPosition(currentPosition, startX, startY);
+	this->SetCursorPosition(startX, startY);
+
+	for (int i = (int)line.length(); i > 0; --i) {
+		(*pStdout) << " ";
+	}
+	this->SetCursorPosition(startX, startY);
+}
+
+void ConsoleLineReader::CalculatePositionInLine(int currenmtPositionInLine, int newPosition, int& x, int& y) {
+	int startX;
+	int startY;
+	CalculateLineStartPosition(currenmtPositionInLine, startX, startY);
+
+	int width;
+	int height;
+	GetConsoleSize(width, height);
+
+	x = startX;
+	y = startY;
+
+	if (newPosition < width - startX) {
+		x = startX + newPosition;
+	}
+	else {
+		newPosition -= (width - startX);
+		x = 0;
+		y++;
+		x += (newPosition % width);
+		y += (newPosition / width);
+	}
+}
+
+void ConsoleLineReader::CalculateLineStartPosition(int currentPositionInLine, int& startX, int& startY) {
+	int width;
+	int height;
+	int x;
+	int y;
+	this->GetCursorPositionAndSize(x, y, width, height);
+	int lines = currentPositionInLine / width;
+	int offsetX = currentPositionInLine % width;
+
+	startX = x - offsetX;
+	startY = y - lines;
+
+	if (startX < 0) {
+		// Scrolled to next line
+		startY -= 1;
+		startX += width;
+	}
+}
+
+void ConsoleLineReader::GetCursorPositionAndSize(int& x, int& y, int& width, int& height) {
+	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+	CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
+	GetConsoleScreenBufferInfo(hStdout, &consoleInfo);
+	x = consoleInfo.dwCursorPosition.X;
+	y = consoleInfo.dwCursorPosition.Y;
+	width = consoleInfo.dwSize.X;
+	height = consoleInfo.dwSize.Y;
+}
+
+void ConsoleLineReader::GetConsoleSize(int& width, int& height) {
+	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+	CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
+	GetConsoleScreenBufferInfo(hStdout, &consoleInfo);
+	width = consoleInfo.dwSize.X;
+	height = consoleInfo.dwSize.Y;
+}
+
+void ConsoleLineReader::GetCursorPosition(int& x, int& y) {
+	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+	CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
+	GetConsoleScreenBufferInfo(hStdout, &consoleInfo);
+	x = consoleInfo.dwCursorPosition.X;
+	y = consoleInfo.dwCursorPosition.Y;
+}
+
+void ConsoleLineReader::SetCursorPosition(int x, int y) {
+	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+	COORD coords;
+	coords.X = x;
+	coords.Y = y;
+	SetConsoleCursorPosition(hStdout, coords);
+}
+
+std::string ConsoleLineReader::MoveUpInHistory() {
+	--commandHistoryLine;
+	return this->commandHistory[commandHistoryLine];
+}
+
+std::string ConsoleLineReader::MoveDownInHistory() {
+	++this->commandHistoryLine;
+	if (this->commandHistoryLine == this->commandHistory.size()) {
+		return std::string();
+	}
+	else {
+		return this->commandHistory[this->commandHistoryLine];
+	}
+}
+
+void ConsoleLineReader::AddLineToHistory(const std::string& line) {
+	if (commandHistoryLine == this->commandHistory.size()) {
+		this->commandHistory.push_back(line);
+		++commandHistoryLine;
+		while (this->commandHistory.size() > this->historySize) {
+			this->commandHistory.pop_front();
+			--commandHistoryLine;
+		}
+	}
+	else if (this->commandHistory[commandHistoryLine].compare(line) == 0) {
+		// Stay on current line
+	}
+	else {
+		while (this->commandHistory.size() > this->commandHistoryLine) {
+			this->commandHistory.pop_back();
+		}
+		this->commandHistory.push_back(line);
+		++this->commandHistoryLine;
+	}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <deque>
+#include <ostream>
+#include <string>
+#include "LineReader.h"
+
+// Reads lines from the Windows console a key at a time, with line editing, command history and ctrl-c handling
+class ConsoleLineReader : public LineReader
+{
+public:
+	ConsoleLineReader();
+
+	virtual bool ReadLine(ExecState* pExecState, const std::string& prompt, std::string& line) override;
+	virtual char ReadChar() override;
+
+private:
+	std::string ReadConsoleLine(std::ostream* pStdout);
+	int ProcessScanLineCode(std::ostream* pStdout, std::string& line, int cursorPositionInLine, int scanlineCode);
+	void MoveToLineEnd(std::ostream* pStdout, std::string& line, int& cursorPositionInLine);
+	void ProcessBackspace(std::ostream* pStdout, std::string& line, int& currenmtPositionInLine);
+	int InsertIntoLine(std::ostream* pStdout, std::string& line, int cursorPositionInLine, char toInsert);
+	void WriteLineFromPosition(std::ostream* pStdout, const std::string& line, int cursorPosition, bool addExtraSpaceForDeletion);
+	void MoveToPosition(std::ostream* pStdout, const std::string& line, int currentPosition, int position);
+	void BlankCurrentLine(std::ostream* pStdout, const std::string& line, int currentPosition);
+
+	void CalculatePositionInLine(int currenmtPositionInLine, int newPosition, int& x, int& y);
+	void CalculateLineStartPosition(int currenmtPositionInLine, int& startX, int& startY);
+	void SetCursorPosition(int x, int y);
+	void GetCursorPosition(int& x, int& y);
+	void GetCursorPositionAndSize(int& x, int& y, int& width, int& height);
+	void GetConsoleSize(int& width, int& height);
+
+	std::string MoveUpInHistory();
+	std::string MoveDownInHistory();
+	void AddLineToHistory(const std::string& line);
+
+	static int HandlerRoutine(unsigned long fdwCtrlType);
+
+private:
+	int commandHistoryLine;
+	int historySize;
+	std::deque<std::string> commandHistory;
+	bool exitApplication;
+};
@@ -0,0 +1,224 @@
+#include <chrono>
+#include <algorithm>
+#include "CycleCollector.h"
+#include "RefCountedObject.h"
+#include "ZeroCountTable.h"
+
+thread_local CycleCollector* CycleCollector::s_pCycleCollector;
+
+enum CycleColour : uint8_t {
+	// In use, or not yet visited
+	CycleColour_Black = 0,
+	// Visited by trial deletion, references from within the subgraph subtracted
+	CycleColour_Gray,
+	// Only referenced from within the subgraph - garbage
+	CycleColour_White
+};
+
+CycleCollector* CycleCollector::GetCycleCollector() {
+	if (s_pCycleCollector == nullptr) {
+		s_pCycleCollector = new CycleCollector();
+	}
+	return s_pCycleCollector;
+}
+
+void CycleCollector::DeleteCycleCollector() {
+	delete s_pCycleCollector;
+	s_pCycleCollector = nullptr;
+}
+
+CycleCollector::CycleCollector() {
+	this->budget = 256;
+	this->collecting = false;
+	this->steps = 0;
+	this->candidatesProcessed = 0;
+	this->objectsVisited = 0;
+	this->objectsCollected = 0;
+	this->lastStepMicroseconds = 0;
+	this->longestStepMicroseconds = 0;
+}
+
+void CycleCollector::AddCandidate(RefCountedObject* pObject) {
+	if (!pObject->cycleCandidate) {
+		pObject->cycleCandidate = true;
+		this->candidates.insert(pObject);
+	}
+}
+
+void CycleCollector::RemoveCandidate(RefCountedObject* pObject) {
+	if (pObject->cycleCandidate) {
+		pObject->cycleCandidate = false;
+		this->candidates.erase(pObject);
+	}
+}
+
+void CycleCollector::Collect() {
+	while (this->candidates.size() > 0 && !this->collecting) {
+		CollectStep();
+	}
+}
+
+void CycleCollector::CollectStep() {
+	if (this->collecting || this->candidates.size() == 0) {
+		return;
+	}
+	auto startTime = std::chrono::steady_clock::now();
+	this->collecting = true;
+
+	std::vector<RefCountedObject*> roots;
+	auto iter = this->candidates.begin();
+	while (iter != this->candidates.end() && roots.size() < this->budget) {
+		RefCountedObject* pObject = *iter;
+		iter = this->candidates.erase(iter);
+		pObject->cycleCandidate = false;
+		// Candidates whose count has since reached zero are left to the zero count table
+		if (pObject->referenceCount > 0) {
+			roots.push_back(pObject);
+		}
+	}
+	this->candidatesProcessed += roots.size();
+	CollectCandidates(roots);
+
+	this->collecting = false;
+	int64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+	this->lastStepMicroseconds = microseconds;
+	if (microseconds > this->longestStepMicroseconds) {
+		this->longestStepMicroseconds = microseconds;
+	}
+	++this->steps;
+}
+
+void CycleCollector::CollectCandidates(const std::vector<RefCountedObject*>& roots) {
+	for (RefCountedObject* pRoot : roots) {
+		MarkGray(pRoot);
+	}
+
+	std::unordered_set<RefCountedObject*> onStacks;
+	ZeroCountTable::GetZeroCountTable()->AddObjectsOnStacks(onStacks);
+	for (RefCountedObject* pRoot : roots) {
+		Scan(pRoot, onStacks);
+	}
+
+	std::vector<RefCountedObject*> garbage;
+	for (RefCountedObject* pRoot : roots) {
+		CollectWhite(pRoot, garbage);
+	}
+	if (garbage.size() == 0) {
+		return;
+	}
+
+	// The garbage objects refer to each other.  Hold a reference to each so none reaches zero whilst the references
+	//  between them are released, then release that reference so the zero count table deletes them.
+	for (RefCountedObject* pObject : garbage) {
+		++pObject->referenceCount;
+	}
+	for (RefCountedObject* pObject : garbage) {
+		pObject->ReleaseChildObjects();
+	}
+	for (RefCountedObject* pObject : garbage) {
+		RemoveCandidate(pObject);
+		pObject->DecReference();
+	}
+	this->objectsCollected += garbage.size();
+}
+
+void CycleCollector::GetChildren(RefCountedObject* pObject) {
+	this->children.clear();
+	pObject->AddChildObjects(this->children);
+	// Shared and escaped objects may be counted from other threads, so are treated as referenced from outside
+	this->children.erase(std::remove_if(this->children.begin(), this->children.end(),
+		[](RefCountedObject* pChild) { return pChild->IsShared() || pChild->IsEscaped(); }), this->children.end());
+	++this->objectsVisited;
+}
+
+// Subtracts the references made from within the subgraph reachable from pRoot
+void CycleCollector::MarkGray(RefCountedObject* pRoot) {
+	if (pRoot->cycleColour == CycleColour_Gray) {
+		return;
+	}
+	pRoot->cycleColour = CycleColour_Gray;
+	this->toVisit.push_back(pRoot);
+	while (this->toVisit.size() > 0) {
+		RefCountedObject* pObject = this->toVisit.back();
+		this->toVisit.pop_back();
+		GetChildren(pObject);
+		for (RefCountedObject* pChild : this->children) {
+			--pChild->referenceCount;
+			if (pChild->cycleColour != CycleColour_Gray) {
+				pChild->cycleColour = CycleColour_Gray;
+				this->toVisit.push_back(pChild);
+			}
+		}
+	}
+}
+
+// Objects still referenced from outside the subgraph, and everything they reach, are live.  The rest are white.
+void CycleCollector::Scan(RefCountedObject* pRoot, const std::unordered_set<RefCountedObject*>& onStacks) {
+	std::vector<RefCountedObject*> toScan;
+	toScan.push_back(pRoot);
+	while (toScan.size() > 0) {
+		RefCountedObject* pObject = toScan.back();
+		toScan.pop_back();
+		if (pObject->cycleColour != CycleColour_Gray) {
+			continue;
+		}
+		if (pObject->referenceCount > 0 || onStacks.find(pObject) != onStacks.end()) {
+			ScanBlack(pObject);
+		}
+		else {
+			pObject->cycleColour = CycleColour_White;
+			GetChildren(pObject);
+			toScan.insert(toScan.end(), this->children.begin(), this->children.end());
+		}
+	}
+}
+
+// Restores the references subtracted by MarkGray, from a live object and everything it reaches
+void CycleCollector::ScanBlack(RefCountedObject* pLiveObject) {
+	pLiveObject->cycleColour = CycleColour_Black;
+	this->toVisit.push_back(pLiveObject);
+	while (this->toVisit.size() > 0) {
+		RefCountedObject* pObject = this->toVisit.back();
+		this->toVisit.pop_back();
+		GetChildren(pObject);
+		for (RefCountedObject* pChild : this->children) {
+			++pChild->referenceCount;
+			if (pChild->cycleColour != CycleColour_Black) {
+				pChild->cycleColour = CycleColour_Black;
+				this->toVisit.push_back(pChild);
+			}
+		}
+	}
+}
+
+void CycleCollector::CollectWhite(RefCountedObject* pRoot, std::vector<RefCountedObject*>& garbage) {
+	if (pRoot->cycleColour != CycleColour_White) {
+		return;
+	}
+	pRoot->cycleColour = CycleColour_Black;
+	garbage.push_back(pRoot);
+	this->toVisit.push_back(pRoot);
+	while (this->toVisit.size() > 0) {
+		RefCountedObject* pObject = this->toVisit.back();
+		this->toVisit.pop_back();
+		GetChildren(pObject);
+		for (RefCountedObject* pChild : this->children) {
+			if (pChild->cycleColour == CycleColour_White) {
+				pChild->cycleColour = CycleColour_Black;
+				garbage.push_back(pChild);
+				this->toVisit.push_back(pChild);
+			}
+		}
+	}
+}
+
+void CycleCollector::WriteStatistics(std::ostream* pStream) const {
+	(*pStream) << "Candidates waiting:   " << this->candidates.size() << std::endl;
+	(*pStream) << "Step budget:          " << this->budget << std::endl;
+	(*pStream) << "Steps:                " << this->steps << std::endl;
+	(*pStream) << "Candidates processed: " << this->candidatesProcessed << std::endl;
+	(*pStream) << "Objects visited:      " << this->objectsVisited << std::endl;
+	(*pStream) << "Objects collected:    " << this->objectsCollected << std::endl;
+	(*pStream) << "Last step:            " << this->lastStepMicroseconds << "us" << std::endl;
+	(*pStream) << "Longest step:         " << this->longestStepMicroseconds << "us" << std::endl;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <unordered_set>
+#include <ostream>
+class RefCountedObject;
+
+// Collects cycles of objects (user-defined objects and arrays referring to each other) that reference counting
+//  alone never frees.  Uses trial deletion: an object whose count is decremented to a non-zero value is a
+//  candidate root of a garbage cycle.  Counts due to references from within the candidate's subgraph are
+//  subtracted; objects left with a zero count that are not on a stack are only referenced from within the
+//  subgraph, and are garbage.  References from word bodies and dictionary literals are counted, so are treated
+//  as external automatically; stack references are not counted (see ZeroCountTable) so the stacks are scanned.
+// Collection steps process at most 'budget' candidates each, to bound the pause.  Collected objects are released
+//  to the zero count table, and must only be collected at a safe point.  Like the zero count table, there is one
+//  collector per thread.  Cycles through shared or escaped objects are not collected.
+class CycleCollector
+{
+	CycleCollector();
+public:
+	static CycleCollector* GetCycleCollector();
+	// Only once nothing is left for it to collect, as the thread exits (see ZeroCountTable)
+	static void DeleteCycleCollector();
+
+	void AddCandidate(RefCountedObject* pObject);
+	void RemoveCandidate(RefCountedObject* pObject);
+
+	void Collect();
+	void CollectStep();
+	bool HasCandidates() const { return this->candidates.size() > 0; }
+	bool StepRecommended() const { return this->candidates.size() >= this->budget; }
+	void SetBudget(size_t budget) { this->budget = budget > 0 ? budget : 1; }
+
+	void WriteStatistics(std::ostream* pStream) const;
+
+private:
+	void CollectCandidates(const std::vector<RefCountedObject*>& roots);
+	void MarkGray(RefCountedObject* pRoot);
+	void Scan(RefCountedObject* pRoot, const std::unordered_set<RefCountedObject*>& onStacks);
+	void ScanBlack(RefCountedObject* pObject);
+	void CollectWhite(RefCountedObject* pRoot, std::vector<RefCountedObject*>& garbage);
+	void GetChildren(RefCountedObject* pObject);
+
+private:
+	static thread_local CycleCollector* s_pCycleCollector;
+
+	std::unordered_set<RefCountedObject*> candidates;
+	size_t budget;
+	bool collecting;
+
+	// Scratch space, kept to avoid reallocating on each step
+	std::vector<RefCountedObject*> children;
+	std::vector<RefCountedObject*> toVisit;
+
+	int64_t steps;
+	int64_t candidatesProcessed;
+	int64_t objectsVisited;
+	int64_t objectsCollected;
+	int64_t lastStepMicroseconds;
+	int64_t longestStepMicroseconds;
+};
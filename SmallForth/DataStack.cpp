@@ -2,6 +2,9 @@
 #include "DataStack.h"
 #include "ForthString.h"
 #include "TypeSystem.h"
+#include "ZeroCountTable.h"
+#include "WordBodyElement.h"
+#include "ForthWord.h"
 
 // TODO Implement stack using forth
 
@@ -12,9 +15,12 @@ DataStack::DataStack(int stackSize) {
 		this->stack.push_back(element);
 	}
 	this->topOfStack = -1;
+	ZeroCountTable::GetZeroCountTable()->RegisterStack(this);
 }
 
 DataStack::~DataStack() {
+	Clear();
+	ZeroCountTable::GetZeroCountTable()->UnregisterStack(this);
 }
 
 bool DataStack::Push(int64_t value) {
@@ -85,7 +91,7 @@ bool DataStack::Push(RefCountedObject* value) {
 	if (!MoveToNextSP()) {
 		return false;
 	}
-	this->stack[this->topOfStack].SetTo(value);
+	this->stack[this->topOfStack].SetToUncounted(value);
 	return true;
 }
 
@@ -93,7 +99,13 @@ bool DataStack::Push(ForthType forthType, WordBodyElement** ppLiteral) {
 	if (!MoveToNextSP()) {
 		return false;
 	}
-	this->stack[this->topOfStack].SetTo(forthType, ppLiteral);
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	if (!TypeSystem::IsPter(forthType) && pTS->TypeIsObject(forthType)) {
+		this->stack[this->topOfStack].SetToUncounted(forthType, static_cast<RefCountedObject*>((*ppLiteral)->refCountedPter));
+	}
+	else {
+		this->stack[this->topOfStack].SetTo(forthType, ppLiteral);
+	}
 	return true;
 }
 
@@ -112,7 +124,7 @@ bool DataStack::Push(const std::string& value) {
 		pForthString->DecReference();
 		return false;
 	}
-	this->stack[this->topOfStack].SetTo((RefCountedObject*)pForthString);
+	this->stack[this->topOfStack].SetToUncounted((RefCountedObject*)pForthString);
 	pForthString->DecReference();
 	return true;
 }
@@ -244,19 +256,20 @@ std::tuple<bool, std::string> DataStack::PullAsString() {
 		return { false, "No string on stack" };
 	}
 	ForthString* pForthString = (ForthString*)el.GetObject();
-	std::string containedString = pForthString->GetContainedString();
+	// Copied out, as once off the stack the string may be deleted at the next reconciliation
+	std::string containedString(pForthString->GetStringView());
 	ShrinkStack();
 	return { true, containedString };
 }
 
 StackElement DataStack::PullNoPter() {
 	if (this->topOfStack == -1) {
-		stack[0].RelinquishValue();
+		stack[0].RelinquishUncountedValue();
 		return stack[0];
 	}
 
-	StackElement& el = this->stack[this->topOfStack];
-	StackElement toReturn = std::move(el);
+	// The slot's reference is not counted, so the returned element takes a counted copy
+	StackElement toReturn(this->stack[this->topOfStack]);
 
 	ShrinkStack();
 
@@ -308,10 +321,8 @@ bool DataStack::SwapTOS() {
 	if (this->topOfStack == 0) {
 		return false;
 	}
-	StackElement tos = this->stack[this->topOfStack];
-	StackElement nextStackElement = this->stack[this->topOfStack-1];
-	this->stack[this->topOfStack] = nextStackElement;
-	this->stack[this->topOfStack - 1] = tos;
+	// Exchanging slots changes no references
+	this->stack[this->topOfStack].SwapUncounted(this->stack[this->topOfStack - 1]);
 
 	return true;
 }
@@ -328,8 +339,7 @@ bool DataStack::DupTOS() {
 	if (this->topOfStack == -1 || !MoveToNextSP()) {
 		return false;
 	}
-	StackElement tos = this->stack[this->topOfStack-1];
-	this->stack[this->topOfStack]=tos;
+	this->stack[this->topOfStack].CopyUncounted(this->stack[this->topOfStack - 1]);
 	return true;
 }
 
@@ -348,7 +358,7 @@ bool DataStack::Push(StackElement* pElement) {
 		return false;
 	}
 	++this->topOfStack;
-	this->stack[this->topOfStack] = *pElement;
+	this->stack[this->topOfStack].CopyUncounted(*pElement);
 	delete pElement;
 	return true;
 }
@@ -357,13 +367,33 @@ bool DataStack::Push(const StackElement& element) {
 	if (!MoveToNextSP()) {
 		return false;
 	}
-	this->stack[this->topOfStack] = element;
+	this->stack[this->topOfStack].CopyUncounted(element);
+	return true;
+}
+
+bool DataStack::MoveTopTo(DataStack* pTo) {
+	if (this->topOfStack == -1 || !pTo->Push(this->stack[this->topOfStack])) {
+		return false;
+	}
+	ShrinkStack();
 	return true;
 }
 
 void DataStack::Clear() {
 	while (this->topOfStack > -1) {
-		this->stack[this->topOfStack].RelinquishValue();
-		--this->topOfStack;
+		ShrinkStack();
+	}
+}
+
+// Includes the words of execution tokens, so a word that is redefined or forgotten lives whilst its xt is on a stack
+void DataStack::AddObjectsOnStack(std::unordered_set<RefCountedObject*>& objects) const {
+	for (int n = 0; n <= this->topOfStack; ++n) {
+		RefCountedObject* pObject = this->stack[n].GetDirectObject();
+		if (pObject == nullptr && this->stack[n].GetType() == StackElement_PterToCFA) {
+			pObject = ForthWord::FindWordFromBody(this->stack[n].GetWordBodyElement());
+		}
+		if (pObject != nullptr) {
+			objects.insert(pObject);
+		}
 	}
 }
\ No newline at end of file
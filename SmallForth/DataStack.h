@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <tuple>
+#include <unordered_set>
 #include "StackElement.h"
 
 class DataStack
@@ -48,13 +49,16 @@ public:
 
 	bool Push(StackElement* pElement);
 	bool Push(const StackElement& pElement);
+	// Moves the top element onto another stack, without copying it to the heap as Pull does
+	bool MoveTopTo(DataStack* pTo);
 
 	int Count() const { return topOfStack+1; }
+	void AddObjectsOnStack(std::unordered_set<RefCountedObject*>& objects) const;
 
 private:
 	bool MoveToNextSP();
 	inline void ShrinkStack() {
-		this->stack[this->topOfStack].RelinquishValue();
+		this->stack[this->topOfStack].RelinquishUncountedValue();
 		--this->topOfStack;
 	}
 
@@ -0,0 +1,1007 @@
+#include <fstream>
+#include <cstring>
+#include "DictionaryImage.h"
+#include "ExecState.h"
+#include "ForthDict.h"
+#include "ForthWord.h"
+#include "WordBodyElement.h"
+#include "StackElement.h"
+#include "TypeSystem.h"
+#include "ForthString.h"
+#include "ForthFile.h"
+#include "ForthArray.h"
+#include "UserDefinedObject.h"
+#include "PreBuiltWords.h"
+#include "MappedFile.h"
+
+static const char c_imageMagic[8] = { 'S', 'F', 'I', 'M', 'A', 'G', 'E', '\0' };
+
+// Code compiled into words by defining words, that no built-in word executes directly, so is saved under these names
+static const std::vector<std::pair<std::string, XT>>& GetUnnamedXTs() {
+	static const std::vector<std::pair<std::string, XT>> unnamedXTs = {
+		{ "(pushpter)", PreBuiltWords::BuiltIn_PushPter }
+	};
+	return unnamedXTs;
+}
+
+DictionaryImage::DictionaryImage(ExecState* pExecState) {
+	this->pExecState = pExecState;
+	this->pNativeDict = nullptr;
+	this->position = 0;
+	this->corrupt = false;
+}
+
+DictionaryImage::~DictionaryImage() {
+	if (this->pNativeDict != nullptr) {
+		this->pNativeDict->DecReference();
+		this->pNativeDict = nullptr;
+	}
+}
+
+// Saving
+
+bool DictionaryImage::Save(const std::string& path) {
+	if (this->pExecState->GetIntTLSVariable(ExecState::c_compileStateIndex) != 0) {
+		return this->pExecState->CreateException("Cannot save an image whilst compiling a word");
+	}
+	if (this->pExecState->pDict->GetSharedDict() != nullptr) {
+		return this->pExecState->CreateException("Cannot save an image from a dictionary layered over a shared dictionary");
+	}
+	GatherNativeWords();
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+
+	// Defining objects of user types are found first, so each instance is created after the type it belongs to
+	std::vector<RegisteredType*> userTypes;
+	for (auto& idAndType : pTS->typeIdToRegisteredType) {
+		if (idAndType.second->definingObject != nullptr) {
+			userTypes.push_back(idAndType.second);
+			VisitObject(idAndType.second->definingObject);
+		}
+	}
+	std::vector<std::vector<ForthWord*>> chains;
+	this->pExecState->pDict->GetWordChains(chains);
+	for (std::vector<ForthWord*>& chain : chains) {
+		for (ForthWord* pWord : chain) {
+			VisitWord(pWord);
+		}
+	}
+	// Classifying a word or object finds the words and objects it refers to
+	size_t nextWord = 0;
+	size_t nextObject = 0;
+	while (nextWord < this->words.size() || nextObject < this->objects.size()) {
+		bool success;
+		if (nextWord < this->words.size()) {
+			success = ClassifyWord(this->words[nextWord++]);
+		}
+		else {
+			success = ClassifyObject(this->objects[nextObject++]);
+		}
+		if (!success) {
+			return false;
+		}
+	}
+
+	this->buffer.assign(c_imageMagic, sizeof(c_imageMagic));
+	WriteUint32(c_version);
+
+	// Built-in types, which must have the same ids when the image is loaded
+	WriteUint32((uint32_t)(pTS->typeIdToRegisteredType.size() - userTypes.size()));
+	for (auto& idAndType : pTS->typeIdToRegisteredType) {
+		if (idAndType.second->definingObject == nullptr) {
+			WriteUint32(idAndType.first);
+			WriteString(idAndType.second->name);
+		}
+	}
+	WriteUint32((uint32_t)this->nativesUsed.size());
+	for (ForthWord* pWord : this->nativesUsed) {
+		WriteString(pWord->GetName());
+	}
+	WriteUint32((uint32_t)this->xtSymbols.size());
+	for (const std::string& name : this->xtSymbols) {
+		WriteString(name);
+	}
+
+	WriteUint32((uint32_t)this->words.size());
+	for (ForthWord* pWord : this->words) {
+		WriteString(pWord->GetName());
+		WriteUint8((pWord->immediate ? 1 : 0) | (pWord->visible ? 2 : 0));
+		WriteUint32((uint32_t)pWord->bodySize);
+	}
+	WriteUint32((uint32_t)this->objects.size());
+	for (size_t n = 0; n < this->objects.size(); n++) {
+		RefCountedObject* pObject = this->objects[n];
+		WriteUint8(this->objectKinds[n]);
+		switch (this->objectKinds[n]) {
+		case Object_String:
+			WriteString(((ForthString*)pObject)->GetStringView());
+			break;
+		case Object_Word:
+			WriteUint32((uint32_t)this->objectElements[n][0].ref);
+			break;
+		case Object_SystemFile:
+			WriteUint32(pObject->GetObjectTypeId());
+			WriteUint32(((ForthFile*)pObject)->GetSystemFile());
+			break;
+		case Object_Array:
+			WriteUint32(((ForthArray*)pObject)->containedType);
+			break;
+		case Object_UserObject: {
+			UserDefinedObject* pUserObject = (UserDefinedObject*)pObject;
+			RegisteredType* pType = pTS->GetRegisteredTypeForTypeId(pObject->GetObjectTypeId());
+			WriteString(pUserObject->objectName);
+			WriteUint32((uint32_t)pUserObject->stateCount);
+			WriteUint32(pObject->GetObjectTypeId());
+			WriteUint8(pUserObject->defaultObject ? 1 : 0);
+			WriteUint32(pType->definingObject == pObject ? (uint32_t)-1 : (uint32_t)this->objectIndices[pType->definingObject]);
+			break;
+		}
+		}
+	}
+	WriteUint32((uint32_t)userTypes.size());
+	for (RegisteredType* pType : userTypes) {
+		WriteUint32(pType->id);
+		WriteString(pType->name);
+		WriteUint32((uint32_t)this->objectIndices[pType->definingObject]);
+	}
+	WriteUint32(pTS->nextUserObjectTypeId);
+
+	for (size_t n = 0; n < this->words.size(); n++) {
+		for (const Element& element : this->wordElements[n]) {
+			WriteElement(element);
+		}
+		ForthWord* pWord = this->words[n];
+		WriteUint32((uint32_t)pWord->referencedWords.size());
+		for (ForthWord* pReferenced : pWord->referencedWords) {
+			WriteUint32((uint32_t)this->wordIndices[pReferenced]);
+		}
+		WriteUint32((uint32_t)pWord->referencedObjects.size());
+		for (RefCountedObject* pReferenced : pWord->referencedObjects) {
+			WriteUint32((uint32_t)this->objectIndices[pReferenced]);
+		}
+	}
+	for (size_t n = 0; n < this->objects.size(); n++) {
+		if (this->objectKinds[n] == Object_Array || this->objectKinds[n] == Object_UserObject) {
+			const std::vector<Element>& elements = this->objectElements[n];
+			std::vector<ForthType> types;
+			if (this->objectKinds[n] == Object_Array) {
+				ForthArray* pArray = (ForthArray*)this->objects[n];
+				for (size_t index = 0; index < pArray->Count(); index++) {
+					types.push_back(pArray->GetElement(index).elementType);
+				}
+			}
+			else {
+				for (StackElement* pStackElement : ((UserDefinedObject*)this->objects[n])->state) {
+					types.push_back(pStackElement != nullptr ? (ForthType)pStackElement->elementType : (ForthType)StackElement_Undefined);
+				}
+			}
+			WriteUint32((uint32_t)elements.size());
+			for (size_t index = 0; index < elements.size(); index++) {
+				WriteStackElement(types[index], elements[index]);
+			}
+		}
+		if (this->objectKinds[n] == Object_UserObject) {
+			RegisteredType* pType = pTS->GetRegisteredTypeForTypeId(this->objects[n]->GetObjectTypeId());
+			if (pType->definingObject == this->objects[n]) {
+				std::vector<std::vector<ForthWord*>> methodChains;
+				((UserDefinedObject*)this->objects[n])->pDictionary->GetWordChains(methodChains);
+				WriteChains(methodChains);
+			}
+		}
+	}
+	WriteChains(chains);
+
+	WriteUint32(ExecState::c_maxStates);
+	for (int n = 0; n < ExecState::c_maxStates; n++) {
+		WriteInt64(this->pExecState->boolStates[n]->wordElement_int);
+		WriteInt64(this->pExecState->intStates[n]->wordElement_int);
+	}
+
+	std::ofstream imageFile(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!imageFile.is_open()) {
+		return this->pExecState->CreateException("Could not create image file");
+	}
+	imageFile.write(this->buffer.data(), this->buffer.size());
+	if (!imageFile.good()) {
+		return this->pExecState->CreateException("Could not write image file");
+	}
+	return true;
+}
+
+// Registers the built-in words into a dictionary of their own, to find which words the image can refer to by name
+void DictionaryImage::GatherNativeWords() {
+	this->pNativeDict = new ForthDict();
+	this->pNativeDict->IncReference();
+	PreBuiltWords::RegisterWords(this->pNativeDict);
+
+	std::vector<std::vector<ForthWord*>> chains;
+	this->pNativeDict->GetWordChains(chains);
+	for (std::vector<ForthWord*>& chain : chains) {
+		ForthWord* pNative = chain.back();
+		this->nativeWords[pNative->GetName()] = pNative;
+		this->xtNames.insert({ pNative->body[0]->wordElement_XT, pNative->GetName() });
+	}
+	for (const std::pair<std::string, XT>& unnamedXT : GetUnnamedXTs()) {
+		this->xtNames.insert({ unnamedXT.second, unnamedXT.first });
+	}
+}
+
+// Words that are exactly as registered by a built-in word are saved by name
+bool DictionaryImage::IsNativeWord(ForthWord* pWord) const {
+	auto iter = this->nativeWords.find(pWord->GetName());
+	if (iter == this->nativeWords.end()) {
+		return false;
+	}
+	ForthWord* pNative = iter->second;
+	return pWord->bodySize == 1 && pWord->body[0] != nullptr && pWord->immediate == pNative->immediate &&
+		pWord->body[0]->wordElement_XT == pNative->body[0]->wordElement_XT;
+}
+
+int32_t DictionaryImage::VisitWord(ForthWord* pWord) {
+	auto iter = this->wordIndices.find(pWord);
+	if (iter != this->wordIndices.end()) {
+		return iter->second;
+	}
+	int32_t ref;
+	if (IsNativeWord(pWord)) {
+		ref = -(int32_t)this->nativesUsed.size() - 1;
+		this->nativesUsed.push_back(pWord);
+	}
+	else {
+		ref = (int32_t)this->words.size();
+		this->words.push_back(pWord);
+		this->wordElements.emplace_back();
+	}
+	this->wordIndices[pWord] = ref;
+	return ref;
+}
+
+int32_t DictionaryImage::VisitObject(RefCountedObject* pObject) {
+	if (pObject == nullptr) {
+		return -1;
+	}
+	auto iter = this->objectIndices.find(pObject);
+	if (iter != this->objectIndices.end()) {
+		return iter->second;
+	}
+	int32_t index = (int32_t)this->objects.size();
+	this->objects.push_back(pObject);
+	this->objectKinds.push_back(Object_String);
+	this->objectElements.emplace_back();
+	this->objectIndices[pObject] = index;
+	return index;
+}
+
+// The first element is the code the word executes.  Other elements are pointers to the bodies of the words it
+//  calls, or data such as jump offsets.  Literals are a type followed by a value, after pushliteral and in
+//  words created by variable, create and constant; the type says whether the value is an object or a pointer.
+bool DictionaryImage::ClassifyWord(ForthWord* pWord) {
+	std::vector<Element> elements;
+	XT firstXT = pWord->bodySize > 0 && pWord->body[0] != nullptr ? pWord->body[0]->wordElement_XT : nullptr;
+	int typedLiteralAt = -1;
+	if (firstXT == PreBuiltWords::BuiltIn_PushPter || firstXT == PreBuiltWords::BuiltIn_FetchLiteral) {
+		typedLiteralAt = 2;
+	}
+	for (int n = 0; n < pWord->bodySize; n++) {
+		WordBodyElement* pElement = pWord->body[n];
+		Element element = {};
+		if (pElement == nullptr) {
+			element.kind = Element_Null;
+		}
+		else if (n == 0) {
+			auto iter = this->xtNames.find(pElement->wordElement_XT);
+			if (iter == this->xtNames.end()) {
+				std::string message = "Cannot save " + pWord->GetName() + " in an image, as its code is not a built-in word";
+				return this->pExecState->CreateException(message.c_str());
+			}
+			auto indexIter = this->xtIndices.find(pElement->wordElement_XT);
+			if (indexIter == this->xtIndices.end()) {
+				indexIter = this->xtIndices.insert({ pElement->wordElement_XT, (uint32_t)this->xtSymbols.size() }).first;
+				this->xtSymbols.push_back(iter->second);
+			}
+			element.kind = Element_XT;
+			element.index = indexIter->second;
+		}
+		else if (n == typedLiteralAt && pWord->body[n - 1] != nullptr) {
+			if (!ClassifyLiteral(pWord->body[n - 1]->forthType, pElement, element)) {
+				return false;
+			}
+		}
+		else {
+			ForthWord* pCalled = ForthWord::FindWordFromBody(pElement->wordElement_BodyPter);
+			if (pCalled != nullptr) {
+				element.kind = Element_Body;
+				element.ref = VisitWord(pCalled);
+				if (pCalled->bodySize > 0 && pCalled->body[0]->wordElement_XT == PreBuiltWords::BuiltIn_PushUpcomingLiteral) {
+					typedLiteralAt = n + 2;
+				}
+			}
+			else {
+				element.kind = Element_Raw;
+				element.raw = pElement->wordElement_int;
+			}
+		}
+		if (pElement != nullptr) {
+			element.refCount = pElement->refCount;
+		}
+		elements.push_back(element);
+	}
+	for (ForthWord* pReferenced : pWord->referencedWords) {
+		VisitWord(pReferenced);
+	}
+	for (RefCountedObject* pReferenced : pWord->referencedObjects) {
+		VisitObject(pReferenced);
+	}
+	this->wordElements[this->wordIndices[pWord]] = std::move(elements);
+	return true;
+}
+
+bool DictionaryImage::ClassifyLiteral(ForthType type, WordBodyElement* pElement, Element& element) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	if (pTS->IsPter(type)) {
+		return ClassifySlot(pElement->refCountedPter, element);
+	}
+	else if (type == StackElement_PterToCFA) {
+		ForthWord* pWord = ForthWord::FindWordFromBody(pElement->wordElement_BodyPter);
+		if (pWord == nullptr) {
+			return this->pExecState->CreateException("Cannot save a pointer to a word that no longer exists");
+		}
+		element.kind = Element_Body;
+		element.ref = VisitWord(pWord);
+	}
+	else if (type == StackElement_XT) {
+		return this->pExecState->CreateException("Cannot save an XT literal in an image");
+	}
+	else if (pTS->TypeIsObject(type)) {
+		element.kind = Element_Object;
+		element.ref = VisitObject(static_cast<RefCountedObject*>(pElement->refCountedPter));
+	}
+	else {
+		element.kind = Element_Raw;
+		element.raw = pElement->wordElement_int;
+	}
+	return true;
+}
+
+// Pointers are to an element in a word body, or to a thread-local state variable
+bool DictionaryImage::ClassifySlot(void* pSlot, Element& element) {
+	WordBodyElement** ppSlot = static_cast<WordBodyElement**>(pSlot);
+	if (ppSlot == nullptr) {
+		element.kind = Element_Raw;
+		element.raw = 0;
+		return true;
+	}
+	uintptr_t address = reinterpret_cast<uintptr_t>(ppSlot);
+	uintptr_t boolStates = reinterpret_cast<uintptr_t>(this->pExecState->boolStates);
+	uintptr_t intStates = reinterpret_cast<uintptr_t>(this->pExecState->intStates);
+	if (address >= boolStates && address < boolStates + sizeof(this->pExecState->boolStates)) {
+		element.kind = Element_BoolState;
+		element.index = (uint32_t)(ppSlot - this->pExecState->boolStates);
+		return true;
+	}
+	if (address >= intStates && address < intStates + sizeof(this->pExecState->intStates)) {
+		element.kind = Element_IntState;
+		element.index = (uint32_t)(ppSlot - this->pExecState->intStates);
+		return true;
+	}
+	for (auto& bodyAndWord : ForthWord::GetWordsByBody()) {
+		ForthWord* pWord = bodyAndWord.second;
+		uintptr_t body = reinterpret_cast<uintptr_t>(pWord->body);
+		if (address >= body && address < body + pWord->bodySize * sizeof(WordBodyElement*)) {
+			element.kind = Element_Slot;
+			element.ref = VisitWord(pWord);
+			element.index = (uint32_t)(ppSlot - pWord->body);
+			return true;
+		}
+	}
+	return this->pExecState->CreateException("Cannot save a pointer that does not point into a word");
+}
+
+bool DictionaryImage::ClassifyStackElement(const StackElement& stackElement, Element& element) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	ForthType type = stackElement.elementType;
+	element = {};
+	if (pTS->IsPter(type) || type == StackElement_XT) {
+		return this->pExecState->CreateException("Cannot save a pointer held in an object");
+	}
+	else if (type == StackElement_PterToCFA) {
+		ForthWord* pWord = ForthWord::FindWordFromBody(stackElement.valueWordBodyPter);
+		if (pWord == nullptr) {
+			return this->pExecState->CreateException("Cannot save a pointer to a word that no longer exists");
+		}
+		element.kind = Element_Body;
+		element.ref = VisitWord(pWord);
+	}
+	else if (pTS->TypeIsObject(type)) {
+		element.kind = Element_Object;
+		element.ref = VisitObject(stackElement.valueRefObject);
+	}
+	else {
+		element.kind = Element_Raw;
+		element.raw = stackElement.valueInt64;
+	}
+	return true;
+}
+
+bool DictionaryImage::ClassifyObject(RefCountedObject* pObject) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	int32_t index = this->objectIndices[pObject];
+	ForthType type = pObject->GetObjectTypeId();
+	ObjectKind kind;
+	std::vector<Element> elements;
+	if (type == ObjectType_String) {
+		kind = Object_String;
+	}
+	else if (type == ObjectType_Word) {
+		kind = Object_Word;
+		Element element = {};
+		element.kind = Element_Body;
+		element.ref = VisitWord((ForthWord*)pObject);
+		elements.push_back(element);
+	}
+	else if ((type == ObjectType_ReadFile || type == ObjectType_WriteFile || type == ObjectType_ReadWriteFile) &&
+		((ForthFile*)pObject)->GetSystemFile() != forth_undefinedSystemFile) {
+		kind = Object_SystemFile;
+	}
+	else if (type == ObjectType_Array) {
+		kind = Object_Array;
+		ForthArray* pArray = (ForthArray*)pObject;
+		for (size_t index = 0; index < pArray->Count(); index++) {
+			Element element;
+			if (!ClassifyStackElement(pArray->GetElement(index), element)) {
+				return false;
+			}
+			elements.push_back(element);
+		}
+	}
+	else if (pTS->TypeIsUserObject(type)) {
+		kind = Object_UserObject;
+		UserDefinedObject* pUserObject = (UserDefinedObject*)pObject;
+		for (StackElement* pStackElement : pUserObject->state) {
+			Element element = {};
+			element.kind = Element_Null;
+			if (pStackElement != nullptr && !ClassifyStackElement(*pStackElement, element)) {
+				return false;
+			}
+			elements.push_back(element);
+		}
+		RegisteredType* pType = pTS->GetRegisteredTypeForTypeId(type);
+		if (pType == nullptr) {
+			return this->pExecState->CreateException("Cannot save an object whose type is not registered");
+		}
+		VisitObject(pType->definingObject);
+		if (pType->definingObject == pObject) {
+			std::vector<std::vector<ForthWord*>> methodChains;
+			pUserObject->pDictionary->GetWordChains(methodChains);
+			for (std::vector<ForthWord*>& chain : methodChains) {
+				for (ForthWord* pWord : chain) {
+					VisitWord(pWord);
+				}
+			}
+		}
+	}
+	else {
+		std::string message = "Cannot save an object of type " + pTS->TypeToString(type) + " in an image";
+		return this->pExecState->CreateException(message.c_str());
+	}
+	this->objectKinds[index] = kind;
+	this->objectElements[index] = std::move(elements);
+	return true;
+}
+
+void DictionaryImage::WriteElement(const Element& element) {
+	WriteUint8(element.kind);
+	WriteUint32((uint32_t)element.refCount);
+	switch (element.kind) {
+	case Element_Null: break;
+	case Element_Raw: WriteInt64(element.raw); break;
+	case Element_XT: WriteUint32(element.index); break;
+	case Element_Body: WriteUint32((uint32_t)element.ref); break;
+	case Element_Object: WriteUint32((uint32_t)element.ref); break;
+	case Element_Slot: WriteUint32((uint32_t)element.ref); WriteUint32(element.index); break;
+	case Element_BoolState: WriteUint32(element.index); break;
+	case Element_IntState: WriteUint32(element.index); break;
+	}
+}
+
+void DictionaryImage::WriteStackElement(ForthType type, const Element& element) {
+	WriteUint32(type);
+	WriteElement(element);
+}
+
+void DictionaryImage::WriteChains(const std::vector<std::vector<ForthWord*>>& chains) {
+	WriteUint32((uint32_t)chains.size());
+	for (const std::vector<ForthWord*>& chain : chains) {
+		WriteUint32((uint32_t)chain.size());
+		for (ForthWord* pWord : chain) {
+			WriteUint32((uint32_t)this->wordIndices[pWord]);
+		}
+	}
+}
+
+void DictionaryImage::WriteUint8(uint8_t n) {
+	this->buffer += (char)n;
+}
+
+void DictionaryImage::WriteUint32(uint32_t n) {
+	this->buffer.append(reinterpret_cast<const char*>(&n), sizeof(n));
+}
+
+void DictionaryImage::WriteInt64(int64_t n) {
+	this->buffer.append(reinterpret_cast<const char*>(&n), sizeof(n));
+}
+
+void DictionaryImage::WriteString(std::string_view s) {
+	WriteUint32((uint32_t)s.length());
+	this->buffer.append(s);
+}
+
+// Loading
+
+bool DictionaryImage::Load(const std::string& path) {
+	MappedFile imageFile;
+	if (!imageFile.Open(path)) {
+		return this->pExecState->CreateException("Could not open image file");
+	}
+	this->contents = imageFile.GetContents();
+	this->position = 0;
+	this->corrupt = false;
+	if (!ReadHeader()) {
+		return false;
+	}
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+
+	// Words are created with empty bodies first, so that elements pointing into any word's body can be fixed up
+	uint32_t wordCount = ReadUint32();
+	for (uint32_t n = 0; n < wordCount && !this->corrupt; n++) {
+		std::string name(ReadString());
+		uint8_t flags = ReadUint8();
+		uint32_t bodySize = ReadUint32();
+		if (bodySize > this->contents.length()) {
+			Corrupt();
+			break;
+		}
+		ForthWord* pWord = new ForthWord(name);
+		pWord->IncReference();
+		pWord->SetImmediate((flags & 1) != 0);
+		pWord->SetWordVisibility((flags & 2) != 0);
+		if (bodySize > 0) {
+			pWord->body = new WordBodyElement * [bodySize];
+			for (uint32_t index = 0; index < bodySize; index++) {
+				pWord->body[index] = nullptr;
+			}
+			pWord->bodySize = (int)bodySize;
+			pWord->BodyMoved(nullptr);
+		}
+		this->words.push_back(pWord);
+	}
+
+	uint32_t objectCount = ReadUint32();
+	for (uint32_t n = 0; n < objectCount && !this->corrupt; n++) {
+		ObjectKind kind = (ObjectKind)ReadUint8();
+		RefCountedObject* pObject = nullptr;
+		switch (kind) {
+		case Object_String:
+			pObject = new ForthString(ReadString());
+			break;
+		case Object_Word:
+			pObject = GetWord((int32_t)ReadUint32());
+			break;
+		case Object_SystemFile: {
+			ForthType type = ReadUint32();
+			pObject = new ForthFile(type, (SystemFiles)ReadUint32());
+			break;
+		}
+		case Object_Array: {
+			ForthArray* pArray = new ForthArray(nullptr);
+			pArray->SetContainedType(ReadUint32());
+			pObject = pArray;
+			break;
+		}
+		case Object_UserObject: {
+			std::string name(ReadString());
+			int stateCount = (int)ReadUint32();
+			ForthType type = ReadUint32();
+			bool defaultObject = ReadUint8() != 0;
+			int32_t definingIndex = (int32_t)ReadUint32();
+			ForthDict* pMethods = nullptr;
+			if (definingIndex >= 0) {
+				// Instances share their defining object's methods
+				if ((uint32_t)definingIndex >= n || this->objectKinds[definingIndex] != Object_UserObject) {
+					Corrupt();
+					break;
+				}
+				pMethods = ((UserDefinedObject*)this->objects[definingIndex])->pDictionary;
+			}
+			UserDefinedObject* pUserObject = new UserDefinedObject(name, stateCount, pMethods);
+			pUserObject->SetType(type);
+			pUserObject->defaultObject = defaultObject;
+			pObject = pUserObject;
+			break;
+		}
+		default:
+			Corrupt();
+			break;
+		}
+		if (pObject == nullptr) {
+			Corrupt();
+			break;
+		}
+		pObject->IncReference();
+		this->objects.push_back(pObject);
+		this->objectKinds.push_back(kind);
+	}
+
+	uint32_t userTypeCount = ReadUint32();
+	for (uint32_t n = 0; n < userTypeCount && !this->corrupt; n++) {
+		ForthType id = ReadUint32();
+		std::string name(ReadString());
+		int32_t definingIndex = (int32_t)ReadUint32();
+		RefCountedObject* pDefiningObject = GetObject(definingIndex);
+		if (pDefiningObject == nullptr || this->objectKinds[definingIndex] != Object_UserObject ||
+			!pTS->RegisterType(this->pExecState, name, id, nullptr, nullptr, (UserDefinedObject*)pDefiningObject)) {
+			Corrupt();
+			break;
+		}
+	}
+	uint32_t nextUserObjectTypeId = ReadUint32();
+	if (!this->corrupt) {
+		pTS->nextUserObjectTypeId = nextUserObjectTypeId;
+	}
+
+	for (ForthWord* pWord : this->words) {
+		if (this->corrupt) {
+			break;
+		}
+		for (int n = 0; n < pWord->bodySize; n++) {
+			Element element;
+			if (!ReadElement(element)) {
+				break;
+			}
+			pWord->body[n] = CreateElement(element);
+		}
+		uint32_t referencedWordCount = ReadUint32();
+		for (uint32_t n = 0; n < referencedWordCount && !this->corrupt; n++) {
+			ForthWord* pReferenced = GetWord((int32_t)ReadUint32());
+			if (pReferenced != nullptr) {
+				pReferenced->IncReference();
+				pWord->referencedWords.push_back(pReferenced);
+			}
+		}
+		uint32_t referencedObjectCount = ReadUint32();
+		for (uint32_t n = 0; n < referencedObjectCount && !this->corrupt; n++) {
+			RefCountedObject* pReferenced = GetObject((int32_t)ReadUint32());
+			if (pReferenced != nullptr) {
+				pReferenced->IncReference();
+				pWord->referencedObjects.push_back(pReferenced);
+			}
+		}
+	}
+
+	for (size_t n = 0; n < this->objects.size() && !this->corrupt; n++) {
+		if (this->objectKinds[n] == Object_Array) {
+			ForthArray* pArray = (ForthArray*)this->objects[n];
+			uint32_t elementCount = ReadUint32();
+			for (uint32_t index = 0; index < elementCount && !this->corrupt; index++) {
+				StackElement* pStackElement = CreateStackElement();
+				// A packed array can only hold values of its own type
+				if (pArray->IsPacked() && pStackElement->GetType() != pArray->GetContainedType()) {
+					Corrupt();
+				}
+				else {
+					pArray->AddElement(*pStackElement);
+				}
+				delete pStackElement;
+			}
+		}
+		else if (this->objectKinds[n] == Object_UserObject) {
+			UserDefinedObject* pUserObject = (UserDefinedObject*)this->objects[n];
+			uint32_t elementCount = ReadUint32();
+			for (uint32_t index = 0; index < elementCount && !this->corrupt; index++) {
+				pUserObject->state.push_back(CreateStackElement());
+			}
+			RegisteredType* pType = pTS->GetRegisteredTypeForTypeId(pUserObject->GetObjectTypeId());
+			if (pType != nullptr && pType->definingObject == pUserObject) {
+				ReadChains(pUserObject->pDictionary);
+			}
+		}
+	}
+
+	if (!this->corrupt) {
+		this->pExecState->pDict->RemoveAllWords();
+		ReadChains(this->pExecState->pDict);
+	}
+
+	if (ReadUint32() == ExecState::c_maxStates) {
+		for (int n = 0; n < ExecState::c_maxStates && !this->corrupt; n++) {
+			this->pExecState->boolStates[n]->wordElement_int = ReadInt64();
+			this->pExecState->intStates[n]->wordElement_int = ReadInt64();
+		}
+	}
+	else {
+		Corrupt();
+	}
+	pTS->InvalidateMethodCache();
+
+	// Everything loaded is now referenced from the dictionary, or from what it refers to
+	for (ForthWord* pWord : this->words) {
+		pWord->DecReference();
+	}
+	for (RefCountedObject* pObject : this->objects) {
+		pObject->DecReference();
+	}
+	for (ForthWord* pWord : this->nativesUsed) {
+		pWord->DecReference();
+	}
+	if (this->corrupt) {
+		return this->pExecState->CreateException("Image file is corrupt");
+	}
+	return true;
+}
+
+// Checks the image was saved by this build, and finds the built-in words and code it refers to.  Nothing is changed
+//  until this succeeds.
+bool DictionaryImage::ReadHeader() {
+	if (this->contents.substr(0, sizeof(c_imageMagic)) != std::string_view(c_imageMagic, sizeof(c_imageMagic))) {
+		return this->pExecState->CreateException("Not an image file");
+	}
+	this->position = sizeof(c_imageMagic);
+	if (ReadUint32() != c_version) {
+		return this->pExecState->CreateException("Image file is from a different version");
+	}
+
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	if (pTS->nextUserObjectTypeId != pTS->firstUserObjectTypeId) {
+		return this->pExecState->CreateException("An image can only be loaded before any object types are defined");
+	}
+	uint32_t typeCount = ReadUint32();
+	for (uint32_t n = 0; n < typeCount && !this->corrupt; n++) {
+		uint32_t id = ReadUint32();
+		std::string name(ReadString());
+		if (!this->corrupt && pTS->GetBaseTypeIdForName(name) != id) {
+			return this->pExecState->CreateException("Image was saved with different built-in types");
+		}
+	}
+
+	std::vector<std::vector<ForthWord*>> chains;
+	this->pExecState->pDict->GetWordChains(chains);
+	for (std::vector<ForthWord*>& chain : chains) {
+		this->nativeWords[chain.back()->GetName()] = chain.back();
+	}
+	uint32_t nativeCount = ReadUint32();
+	for (uint32_t n = 0; n < nativeCount && !this->corrupt; n++) {
+		std::string name(ReadString());
+		auto iter = this->nativeWords.find(name);
+		if (iter == this->nativeWords.end()) {
+			for (ForthWord* pWord : this->nativesUsed) {
+				pWord->DecReference();
+			}
+			this->nativesUsed.clear();
+			std::string message = "Image uses built-in word " + name + ", which does not exist";
+			return this->pExecState->CreateException(message.c_str());
+		}
+		// Held while the dictionary is replaced by the image's
+		iter->second->IncReference();
+		this->nativesUsed.push_back(iter->second);
+	}
+
+	uint32_t xtCount = ReadUint32();
+	for (uint32_t n = 0; n < xtCount && !this->corrupt; n++) {
+		std::string name(ReadString());
+		XT xt = nullptr;
+		for (const std::pair<std::string, XT>& unnamedXT : GetUnnamedXTs()) {
+			if (unnamedXT.first == name) {
+				xt = unnamedXT.second;
+			}
+		}
+		auto iter = this->nativeWords.find(name);
+		if (xt == nullptr && iter != this->nativeWords.end()) {
+			xt = iter->second->body[0]->wordElement_XT;
+		}
+		if (xt == nullptr) {
+			std::string message = "Image uses the code of built-in word " + name + ", which does not exist";
+			this->corrupt = true;
+			this->pExecState->CreateException(message.c_str());
+			break;
+		}
+		this->xts.push_back(xt);
+	}
+	if (this->corrupt) {
+		for (ForthWord* pWord : this->nativesUsed) {
+			pWord->DecReference();
+		}
+		this->nativesUsed.clear();
+		if (!this->pExecState->exceptionThrown) {
+			return this->pExecState->CreateException("Image file is corrupt");
+		}
+		return false;
+	}
+	return true;
+}
+
+bool DictionaryImage::ReadElement(Element& element) {
+	element = {};
+	element.kind = (ElementKind)ReadUint8();
+	element.refCount = (int16_t)ReadUint32();
+	switch (element.kind) {
+	case Element_Null: break;
+	case Element_Raw: element.raw = ReadInt64(); break;
+	case Element_XT: element.index = ReadUint32(); break;
+	case Element_Body: element.ref = (int32_t)ReadUint32(); break;
+	case Element_Object: element.ref = (int32_t)ReadUint32(); break;
+	case Element_Slot: element.ref = (int32_t)ReadUint32(); element.index = ReadUint32(); break;
+	case Element_BoolState: element.index = ReadUint32(); break;
+	case Element_IntState: element.index = ReadUint32(); break;
+	default: Corrupt(); break;
+	}
+	return !this->corrupt;
+}
+
+// Fixes up any reference the element holds to the address of what it now refers to
+WordBodyElement* DictionaryImage::CreateElement(const Element& element) {
+	if (element.kind == Element_Null) {
+		return nullptr;
+	}
+	WordBodyElement* pElement = new WordBodyElement();
+	pElement->refCount = element.refCount;
+	switch (element.kind) {
+	case Element_Raw:
+		pElement->wordElement_int = element.raw;
+		break;
+	case Element_XT:
+		if (element.index < this->xts.size()) {
+			pElement->wordElement_XT = this->xts[element.index];
+		}
+		else {
+			Corrupt();
+		}
+		break;
+	case Element_Body: {
+		ForthWord* pWord = GetWord(element.ref);
+		pElement->wordElement_BodyPter = pWord != nullptr ? pWord->body : nullptr;
+		break;
+	}
+	case Element_Object:
+		pElement->refCountedPter = element.ref >= 0 ? GetObject(element.ref) : nullptr;
+		break;
+	case Element_Slot: {
+		ForthWord* pWord = GetWord(element.ref);
+		if (pWord != nullptr && element.index < (uint32_t)pWord->bodySize) {
+			pElement->refCountedPter = pWord->body + element.index;
+		}
+		else {
+			Corrupt();
+		}
+		break;
+	}
+	case Element_BoolState:
+	case Element_IntState:
+		if (element.index < (uint32_t)ExecState::c_maxStates) {
+			WordBodyElement** pStates = element.kind == Element_BoolState ? this->pExecState->boolStates : this->pExecState->intStates;
+			pElement->refCountedPter = pStates + element.index;
+		}
+		else {
+			Corrupt();
+		}
+		break;
+	default:
+		break;
+	}
+	return pElement;
+}
+
+StackElement* DictionaryImage::CreateStackElement() {
+	StackElement* pStackElement = new StackElement();
+	ForthType type = ReadUint32();
+	Element element;
+	if (!ReadElement(element)) {
+		return pStackElement;
+	}
+	switch (element.kind) {
+	case Element_Raw:
+		pStackElement->elementType = type;
+		pStackElement->valueInt64 = element.raw;
+		break;
+	case Element_Body: {
+		ForthWord* pWord = GetWord(element.ref);
+		if (pWord != nullptr) {
+			pStackElement->elementType = type;
+			pStackElement->valueWordBodyPter = pWord->body;
+		}
+		break;
+	}
+	case Element_Object: {
+		RefCountedObject* pObject = element.ref >= 0 ? GetObject(element.ref) : nullptr;
+		pStackElement->elementType = type;
+		pStackElement->valueRefObject = pObject;
+		if (pObject != nullptr) {
+			pObject->IncReference();
+		}
+		break;
+	}
+	case Element_Null:
+		break;
+	default:
+		Corrupt();
+		break;
+	}
+	return pStackElement;
+}
+
+ForthWord* DictionaryImage::GetWord(int32_t ref) {
+	if (ref >= 0 && (size_t)ref < this->words.size()) {
+		return this->words[ref];
+	}
+	else if (ref < 0 && (size_t)(-(int64_t)ref - 1) < this->nativesUsed.size()) {
+		return this->nativesUsed[-(int64_t)ref - 1];
+	}
+	Corrupt();
+	return nullptr;
+}
+
+RefCountedObject* DictionaryImage::GetObject(int32_t index) {
+	if (index >= 0 && (size_t)index < this->objects.size()) {
+		return this->objects[index];
+	}
+	Corrupt();
+	return nullptr;
+}
+
+bool DictionaryImage::ReadChains(ForthDict* pDict) {
+	uint32_t chainCount = ReadUint32();
+	for (uint32_t n = 0; n < chainCount && !this->corrupt; n++) {
+		uint32_t chainLength = ReadUint32();
+		for (uint32_t index = 0; index < chainLength && !this->corrupt; index++) {
+			ForthWord* pWord = GetWord((int32_t)ReadUint32());
+			if (pWord != nullptr) {
+				pDict->AddWord(pWord);
+			}
+		}
+	}
+	return !this->corrupt;
+}
+
+uint8_t DictionaryImage::ReadUint8() {
+	if (this->position + sizeof(uint8_t) > this->contents.length()) {
+		Corrupt();
+		return 0;
+	}
+	return (uint8_t)this->contents[this->position++];
+}
+
+uint32_t DictionaryImage::ReadUint32() {
+	uint32_t n = 0;
+	if (this->position + sizeof(n) > this->contents.length()) {
+		Corrupt();
+		return 0;
+	}
+	memcpy(&n, this->contents.data() + this->position, sizeof(n));
+	this->position += sizeof(n);
+	return n;
+}
+
+int64_t DictionaryImage::ReadInt64() {
+	int64_t n = 0;
+	if (this->position + sizeof(n) > this->contents.length()) {
+		Corrupt();
+		return 0;
+	}
+	memcpy(&n, this->contents.data() + this->position, sizeof(n));
+	this->position += sizeof(n);
+	return n;
+}
+
+// A view into the mapped image, only valid while loading
+std::string_view DictionaryImage::ReadString() {
+	uint32_t length = ReadUint32();
+	if (this->position + length > this->contents.length()) {
+		Corrupt();
+		return std::string_view();
+	}
+	std::string_view s = this->contents.substr(this->position, length);
+	this->position += length;
+	return s;
+}
+
+void DictionaryImage::Corrupt() {
+	this->corrupt = true;
+}
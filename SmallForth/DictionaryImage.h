@@ -0,0 +1,121 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include "ForthDefs.h"
+class ExecState;
+class ForthDict;
+class ForthWord;
+class RefCountedObject;
+class StackElement;
+class WordBodyElement;
+
+// A binary image of the initialised dictionary: every word reachable from the dictionary and from user object types,
+//  the objects compiled into them as literals, the user object types and the thread-local state variables.
+//  Booting from an image registers the built-in (C++) words and types as usual, then rebuilds everything else from
+//  the image rather than interpreting the Forth that defined it.
+// Nothing in the image is an address.  Built-in words and their code (XTs) are saved by name and found again in the
+//  freshly registered dictionary; other words and objects are saved by index, and a word body element pointing into
+//  a word body is saved as (word, offset) and fixed up once every word's body has been allocated.
+// Objects that can be saved are strings, words, the standard files, arrays and user-defined objects.
+class DictionaryImage
+{
+public:
+	DictionaryImage(ExecState* pExecState);
+	~DictionaryImage();
+
+	bool Save(const std::string& path);
+	bool Load(const std::string& path);
+
+private:
+	enum ElementKind : uint8_t {
+		Element_Null = 0,
+		Element_Raw,
+		Element_XT,
+		Element_Body,
+		Element_Object,
+		Element_Slot,
+		Element_BoolState,
+		Element_IntState
+	};
+	enum ObjectKind : uint8_t {
+		Object_String = 0,
+		Object_Word,
+		Object_SystemFile,
+		Object_Array,
+		Object_UserObject
+	};
+	// A word body element or stack element, with any address replaced by an index.  Word references are image word
+	//  indices, or -(n+1) for built-in word n
+	struct Element {
+		ElementKind kind;
+		int16_t refCount;
+		int64_t raw;
+		int32_t ref;
+		uint32_t index;
+	};
+
+	// Saving
+	void GatherNativeWords();
+	bool IsNativeWord(ForthWord* pWord) const;
+	int32_t VisitWord(ForthWord* pWord);
+	int32_t VisitObject(RefCountedObject* pObject);
+	bool ClassifyWord(ForthWord* pWord);
+	bool ClassifyLiteral(ForthType type, WordBodyElement* pElement, Element& element);
+	bool ClassifyStackElement(const StackElement& stackElement, Element& element);
+	bool ClassifySlot(void* pSlot, Element& element);
+	bool ClassifyObject(RefCountedObject* pObject);
+	void WriteElement(const Element& element);
+	void WriteStackElement(ForthType type, const Element& element);
+	void WriteChains(const std::vector<std::vector<ForthWord*>>& chains);
+	void WriteUint8(uint8_t n);
+	void WriteUint32(uint32_t n);
+	void WriteInt64(int64_t n);
+	void WriteString(std::string_view s);
+
+	// Loading
+	bool ReadHeader();
+	bool ReadElement(Element& element);
+	WordBodyElement* CreateElement(const Element& element);
+	StackElement* CreateStackElement();
+	ForthWord* GetWord(int32_t ref);
+	RefCountedObject* GetObject(int32_t index);
+	bool ReadChains(ForthDict* pDict);
+	uint8_t ReadUint8();
+	uint32_t ReadUint32();
+	int64_t ReadInt64();
+	std::string_view ReadString();
+	void Corrupt();
+
+private:
+	static const uint32_t c_version = 1;
+
+	ExecState* pExecState;
+
+	// Built-in words by name.  When saving they are registered into a dictionary of their own
+	std::unordered_map<std::string, ForthWord*> nativeWords;
+	ForthDict* pNativeDict;
+	std::vector<ForthWord*> nativesUsed;
+
+	std::vector<ForthWord*> words;
+	std::vector<RefCountedObject*> objects;
+	std::vector<ObjectKind> objectKinds;
+
+	// Saving
+	std::unordered_map<XT, std::string> xtNames;
+	std::unordered_map<XT, uint32_t> xtIndices;
+	std::vector<std::string> xtSymbols;
+	std::unordered_map<ForthWord*, int32_t> wordIndices;
+	std::vector<std::vector<Element>> wordElements;
+	std::unordered_map<RefCountedObject*, int32_t> objectIndices;
+	std::vector<std::vector<Element>> objectElements;
+	std::string buffer;
+
+	// Loading
+	std::vector<XT> xts;
+	std::string_view contents;
+	size_t position;
+	bool corrupt;
+};
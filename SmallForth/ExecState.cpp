@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cstring>
+#include <cerrno>
 #include "ForthDefs.h"
 #include "ExecState.h"
 #include "DataStack.h"
@@ -10,6 +12,10 @@
 #include "CompileHelper.h"
 #include "DebugHelper.h"
 #include "WordBodyElement.h"
+#include "GreenTask.h"
+#include "PreBuiltWords.h"
+#include "ZeroCountTable.h"
+#include "CycleCollector.h"
 
 ExecState::ExecState() 
 : ExecState(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr) {
@@ -23,6 +29,10 @@ ExecState::ExecState(DataStack* pStack, ForthDict* pDict, InputProcessor* pInput
 	this->pReturnStack = pReturnStack;
 	this->pCompiler = pCompiler;
 	this->pDebugger = pDebugger;
+	this->pScheduler = nullptr;
+	this->pGenerator = nullptr;
+	this->maxNestingDepth = 0;
+	this->builtInsExecuting = 0;
 
 	this->pExecBody = nullptr;
 	this->ip = 0;
@@ -52,10 +62,22 @@ ExecState::ExecState(DataStack* pStack, ForthDict* pDict, InputProcessor* pInput
 }
 
 ExecState::~ExecState() {
+	if (this->pScheduler != nullptr && this->pScheduler->IsRoot(this)) {
+		delete this->pScheduler;
+	}
+	this->pScheduler = nullptr;
 	delete this->pTempStack;
 	this->pTempStack = nullptr;
 	delete this->pSelfStack;
 	this->pSelfStack = nullptr;
+	for (int n = 0; n < c_maxStates; ++n) {
+		delete this->boolStates[n];
+		this->boolStates[n] = nullptr;
+		delete this->intStates[n];
+		this->intStates[n] = nullptr;
+	}
+	delete[] this->pzException;
+	this->pzException = nullptr;
 
 	this->pDict->DecReference();
 	this->pDict = nullptr;
@@ -196,29 +218,16 @@ bool ExecState::CreateException(const char* pzException) {
 		delete[] this->pzException;
 		this->pzException = nullptr;
 	}
-	int size = (int)strlen(pzException)+1;
+	size_t size = strlen(pzException)+1;
 	this->pzException = new char[size];
-	strcpy_s(this->pzException, size, pzException);
+	memcpy(this->pzException, pzException, size);
 	return false;
 }
 
 bool ExecState::CreateExceptionUsingErrorNo(const char* pzException) {
-	const int size = 512;
-	int sizeRemaining = size;
-	char buff[size];
-	char* buffPter = buff;
-	if (strcpy_s(buffPter, size, pzException) != 0) {
-		buffPter = buff;
-		sizeRemaining = size;
-	}
-	else {
-		int len = (int)strlen(buff);
-		sizeRemaining -= len;
-		buffPter += len;
-	}
-
-	strerror_s(buffPter, sizeRemaining, errno);
-	return CreateException(buff);
+	std::string message = pzException;
+	message += strerror(errno);
+	return CreateException(message.c_str());
 }
 
 
@@ -515,7 +524,7 @@ bool ExecState::GetConstant(const std::string& constantName, RefCountedObject*&
 }
 
 
-bool ExecState::ExecuteWordDirectly(const std::string& word) {
+bool ExecState::ExecuteWordDirectly(std::string_view word) {
 	TypeSystem* pTS = TypeSystem::GetTypeSystem();
 	ForthWord* pWord = pTS->FindWordInTOSWord(this, word);
 	bool executeOnTOSObject = false;
@@ -528,7 +537,11 @@ bool ExecState::ExecuteWordDirectly(const std::string& word) {
 	if (pWord == nullptr) {
 		return CreateException("Could not find word in dictionary");
 	}
+	return ExecuteWord(pWord, executeOnTOSObject);
+}
 
+bool ExecState::ExecuteWord(ForthWord* pWord, bool executeOnTOSObject) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
 	WordBodyElement** ppExecBody = pWord->GetPterToBody();
 	XT executeXT = ppExecBody[0]->wordElement_XT;
 
@@ -547,6 +560,7 @@ bool ExecState::ExecuteWordDirectly(const std::string& word) {
 	NestAndSetCFA(ppExecBody, 1);
 	bool returnResult = true;
 	try {
+		BuiltInExecuting builtIn(this, executeXT);
 		returnResult = executeXT(this);
 	}
 	catch (...) {
@@ -594,4 +608,36 @@ RefCountedObject* ExecState::GetCurrentSelfPter() {
 	RefCountedObject* pSelf = pElement->GetObject();
 	pSelf->IncReference();
 	return pSelf;
-}
\ No newline at end of file
+}
+
+// Called between words, where nothing is held uncounted other than by the built-in words still executing.  Green tasks
+//  and generators suspended on this thread are inside built-in words (pause, next and the like), but those hold
+//  whatever they use counted or on the stacks
+void ExecState::SafePoint(unsigned int builtInsAllowed) {
+	if (this->builtInsExecuting > builtInsAllowed) {
+		return;
+	}
+	ZeroCountTable* pZCT = ZeroCountTable::GetZeroCountTable();
+	if (!pZCT->ReconcileRecommended()) {
+		return;
+	}
+	CycleCollector* pCycleCollector = CycleCollector::GetCycleCollector();
+	if (pCycleCollector->StepRecommended()) {
+		pCycleCollector->CollectStep();
+	}
+	pZCT->Reconcile();
+}
+
+BuiltInExecuting::BuiltInExecuting(ExecState* pExecState, XT xt) {
+	this->pExecState = pExecState;
+	this->counted = !PreBuiltWords::RunsOtherWords(xt);
+	if (this->counted) {
+		++this->pExecState->builtInsExecuting;
+	}
+}
+
+BuiltInExecuting::~BuiltInExecuting() {
+	if (this->counted) {
+		--this->pExecState->builtInsExecuting;
+	}
+}
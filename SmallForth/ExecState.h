@@ -2,6 +2,7 @@
 #include <vector>
 #include <stack>
 #include <string>
+#include <string_view>
 
 class StackElement;
 class DataStack;
@@ -13,6 +14,8 @@ class TypeSystem;
 class CompileHelper;
 class DebugHelper;
 class WordBodyElement;
+class GreenScheduler;
+class ForthGenerator;
 
 struct ExecSubState {
 	WordBodyElement** pterToCFA;
@@ -78,7 +81,12 @@ public:
 	bool CreateTempStackOverflowException();
 	bool CreateTempStackUnderflowException();
 
-	bool ExecuteWordDirectly(const std::string& word);
+	// Deletes unreferenced objects, if enough are waiting (see ZeroCountTable), unless more built-in words than
+	//  builtInsAllowed are part way through executing
+	void SafePoint(unsigned int builtInsAllowed = 0);
+
+	bool ExecuteWordDirectly(std::string_view word);
+	bool ExecuteWord(ForthWord* pWord, bool executeOnTOSObject);
 	InputWord GetNextWordFromInput();
 
 	bool NestSelfPointer(RefCountedObject* pSelf);
@@ -115,15 +123,40 @@ public:
 
 	CompileHelper* pCompiler;
 	DebugHelper* pDebugger;
+	// Switches between green tasks made by task, and this ExecState if it made them.  Owned by that ExecState, and
+	//  nullptr until it makes one
+	GreenScheduler* pScheduler;
+	// Set on the ExecState a generator runs on, so yield can find it
+	ForthGenerator* pGenerator;
+	// How deeply words can nest before DoCol raises an exception, or 0 for no limit.  Set for ExecStates running on a
+	//  MachineStack, as a thread's own stack is far larger
+	size_t maxNestingDepth;
+	// Built-in words part way through executing, other than those that only run other words (see BuiltInExecuting).
+	//  They may hold objects that are on no stack, so safe points are skipped whilst any are
+	unsigned int builtInsExecuting;
 
 	static const int c_compileStateIndex = 0; // Index into int threadlocal variables
 	static const int c_debugStateIndex = 1; // Index into int threadlocal variables
+	static const int c_compileForTypeIndex = 2; // Index into int threadlocal variables, holds a type
 	static const int c_postponedExecIndex = 0; // Index into bool threadlocal variables
 	static const int c_insideCommentIndex = 1; // Index into bool threadlocal variables
 	static const int c_insideCommentLineIndex = 2; // Index into bool threadlocal variables
 
 private:
+	friend class DictionaryImage;
 	static const int c_maxStates = 10;
 	WordBodyElement* boolStates[c_maxStates];
 	WordBodyElement* intStates[c_maxStates];
 };
+
+// Counts xt as a built-in word executing on pExecState whilst in scope, unless it only runs other words (DoCol and
+//  execute), so holds nothing uncounted itself
+class BuiltInExecuting {
+public:
+	BuiltInExecuting(ExecState* pExecState, XT xt);
+	~BuiltInExecuting();
+
+private:
+	ExecState* pExecState;
+	bool counted;
+};
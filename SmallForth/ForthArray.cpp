@@ -1,13 +1,48 @@
 #include "ForthDefs.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include "ForthArray.h"
 #include "ExecState.h"
 #include "DataStack.h"
 #include "StackElement.h"
 #include "TypeSystem.h"
+#include "ObjectPool.h"
+#include "ForthFuture.h"
+#include "ThreadPool.h"
+#include "PreBuiltWords.h"
+#include "Bootstrap.h"
+
+// One of the parallel words, run a chunk at a time by workers on the thread pool, each with an ExecState of its own
+struct ArrayJob {
+	ForthDict* pDict;
+	const ForthArray* pArray;
+	int operation;
+	WordBodyElement** pCFA;
+	StackElement initial;
+	size_t elementCount;
+	size_t chunkCount;
+	// Each chunk's outputs are written by the worker that takes it, and read once every worker has finished
+	std::vector<std::vector<StackElement>> chunkOutputs;
+	std::atomic<size_t> nextChunk;
+	// The first chunk that failed.  Chunks before it are still run, so the exception reported is always the first
+	std::atomic<size_t> failedChunk;
+
+	std::mutex mutex;
+	std::condition_variable finishedCondition;
+	size_t runningWorkers;
+	std::string exception;
+};
 
 ForthArray::ForthArray(ForthDict* pDict) :
 	RefCountedObject(pDict) {
 	objectType = ObjectType_Array;
+	canReferenceObjects = true;
+	this->containedType = StackElement_Undefined;
+	this->packedSize = 0;
 }
 
 ForthArray::~ForthArray()
@@ -15,6 +50,103 @@ ForthArray::~ForthArray()
 	this->elements.erase(this->elements.begin(), this->elements.end());
 }
 
+static ObjectPool* GetForthArrayPool() {
+	static thread_local ObjectPool* pPool = ObjectPool::ForThread("array", sizeof(ForthArray));
+	return pPool;
+}
+
+void* ForthArray::operator new(size_t size) {
+	return GetForthArrayPool()->Allocate(size);
+}
+
+void ForthArray::operator delete(void* pBlock, size_t size) {
+	GetForthArrayPool()->Release(pBlock, size);
+}
+
+void ForthArray::SetContainedType(ForthType t) {
+	this->containedType = t;
+	switch (t) {
+	case StackElement_Char: this->packedSize = sizeof(char); break;
+	case StackElement_Int: this->packedSize = sizeof(int64_t); break;
+	case StackElement_Float: this->packedSize = sizeof(double); break;
+	case StackElement_Bool: this->packedSize = sizeof(bool); break;
+	default: this->packedSize = 0; break;
+	}
+}
+
+// Copied rather than cast, as the buffer is of bytes
+template<typename T> T ForthArray::LoadPacked(size_t index) const {
+	T value;
+	memcpy(&value, this->packedElements.data() + index * sizeof(T), sizeof(T));
+	return value;
+}
+
+template<typename T> void ForthArray::StorePacked(size_t index, T value) {
+	memcpy(this->packedElements.data() + index * sizeof(T), &value, sizeof(T));
+}
+
+void ForthArray::AddElement(const StackElement& element) {
+	if (!IsPacked()) {
+		this->elements.push_back(element);
+		return;
+	}
+	this->packedElements.resize(this->packedElements.size() + this->packedSize);
+	SetElement(Count() - 1, element);
+}
+
+void ForthArray::SetElement(size_t index, const StackElement& element) {
+	switch (this->containedType) {
+	case StackElement_Char: StorePacked(index, element.GetChar()); break;
+	case StackElement_Int: StorePacked(index, element.GetInt()); break;
+	case StackElement_Float: StorePacked(index, element.GetFloat()); break;
+	case StackElement_Bool: StorePacked(index, element.GetBool()); break;
+	default: this->elements[index] = element; break;
+	}
+}
+
+StackElement ForthArray::GetElement(size_t index) const {
+	switch (this->containedType) {
+	case StackElement_Char: return StackElement(LoadPacked<char>(index));
+	case StackElement_Int: return StackElement(LoadPacked<int64_t>(index));
+	case StackElement_Float: return StackElement(LoadPacked<double>(index));
+	case StackElement_Bool: return StackElement(LoadPacked<bool>(index));
+	default: return this->elements[index];
+	}
+}
+
+bool ForthArray::PushElement(DataStack* pStack, size_t index) const {
+	switch (this->containedType) {
+	case StackElement_Char: return pStack->Push(LoadPacked<char>(index));
+	case StackElement_Int: return pStack->Push(LoadPacked<int64_t>(index));
+	case StackElement_Float: return pStack->Push(LoadPacked<double>(index));
+	case StackElement_Bool: return pStack->Push(LoadPacked<bool>(index));
+	default: return pStack->Push(this->elements[index]);
+	}
+}
+
+void ForthArray::Reserve(size_t count) {
+	if (IsPacked()) {
+		this->packedElements.reserve(count * this->packedSize);
+	}
+	else {
+		this->elements.reserve(count);
+	}
+}
+
+void ForthArray::AddChildObjects(std::vector<RefCountedObject*>& children) const {
+	for (const StackElement& element : this->elements) {
+		RefCountedObject* pObject = element.GetDirectObject();
+		if (pObject != nullptr) {
+			children.push_back(pObject);
+		}
+	}
+}
+
+void ForthArray::ReleaseChildObjects() {
+	this->elements.clear();
+	this->packedElements.clear();
+}
+
 std::string ForthArray::GetObjectType()
 {
 	return "Array";
@@ -23,7 +155,7 @@ std::string ForthArray::GetObjectType()
 bool ForthArray::ToString(ExecState* pExecState) const {
 	TypeSystem* pTS = TypeSystem::GetTypeSystem();
 	std::string str = "Array: " + pTS->TypeToString(containedType) + " size: ";
-	str += std::to_string(this->elements.size());
+	str += std::to_string(Count());
 
 	if (!pExecState->pStack->Push(str)) {
 		return pExecState->CreateStackOverflowException("whilst creating string description of an array");
@@ -66,7 +198,7 @@ bool ForthArray::Construct(ExecState* pExecState) {
 
 
 bool ForthArray::GetSize(ExecState* pExecState) {
-	int64_t size = this->elements.size();
+	int64_t size = Count();
 	if (!pExecState->pStack->Push(size)) {
 		return pExecState->CreateStackOverflowException("whilst getting size of array");
 	}
@@ -82,7 +214,10 @@ bool ForthArray::Append(ExecState* pExecState) {
 	if (elementType != this->containedType) {
 		return pExecState->CreateException("Incorrect type for array");
 	}
-	this->elements.push_back(elementToAppend);
+	if (!EscapeElement(pExecState, elementToAppend)) {
+		return false;
+	}
+	AddElement(elementToAppend);
 	return true;
 }
 
@@ -94,11 +229,10 @@ bool ForthArray::ElementAtIndex(ExecState* pExecState) {
 		return pExecState->CreateException("Cannot get element in array - need an integer index");
 	}
 	int index = (int)pExecState->pStack->PullAsInt();
-	if (index < 0 || index >= (int)this->elements.size()) {
+	if (index < 0 || index >= (int)Count()) {
 		return pExecState->CreateException("Element index out of range whilst accessing an array");
 	}
-	StackElement& elementAtIndex = elements[index];
-	if (!pExecState->pStack->Push(elementAtIndex)) {
+	if (!PushElement(pExecState->pStack, index)) {
 		return pExecState->CreateStackOverflowException("whilst pushing an array element");
 	}
 	return true;
@@ -112,7 +246,7 @@ bool ForthArray::SetElementAtIndex(ExecState* pExecState) {
 		return pExecState->CreateException("Cannot set element in array - need an integer index");
 	}
 	int index = (int)pExecState->pStack->PullAsInt();
-	if (index < 0 || index >= (int)this->elements.size()) {
+	if (index < 0 || index >= (int)Count()) {
 		return pExecState->CreateException("Element index out of range whilst accessing an array to set an element");
 	}
 	if (pExecState->pStack->Count() == 0) {
@@ -122,7 +256,329 @@ bool ForthArray::SetElementAtIndex(ExecState* pExecState) {
 		return pExecState->CreateException("Cannot set element in array - need a matching element type");
 	}
 	StackElement elementToSet = pExecState->pStack->PullNoPter();
+	if (!EscapeElement(pExecState, elementToSet)) {
+		return false;
+	}
+
+	SetElement(index, elementToSet);
+	return true;
+}
 
-	this->elements[index] = elementToSet;
+// Whatever is stored in an array that has escaped to another thread escapes with it
+bool ForthArray::EscapeElement(ExecState* pExecState, const StackElement& element) {
+	if (!IsEscaped()) {
+		return true;
+	}
+	std::vector<RefCountedObject*> roots;
+	roots.push_back(element.GetDirectObject());
+	if (!RefCountedObject::EscapeObjects(roots)) {
+		return pExecState->CreateException("Only values, strings, arrays, channels and shared objects can be stored in an array used by another thread");
+	}
 	return true;
 }
+
+// ( array xt -- array' ) An array of what xt ( x -- y ) makes of each element
+bool ForthArray::BuiltIn_Map(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_Map, false);
+}
+
+// ( array xt -- array' ) An array of the elements for which xt ( x -- b ) is true
+bool ForthArray::BuiltIn_Filter(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_Filter, false);
+}
+
+// ( array x xt -- x' ) Folds the elements into x, from the first, with xt ( x element -- x' )
+bool ForthArray::BuiltIn_Reduce(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_Reduce, false);
+}
+
+// ( array xt -- ) Runs xt ( x -- ) on each element
+bool ForthArray::BuiltIn_ForEach(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_ForEach, false);
+}
+
+// ( array xt -- array' ) As array-map, with the array split between the threads of the pool
+bool ForthArray::BuiltIn_MapParallel(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_Map, true);
+}
+
+// ( array xt -- array' ) As array-filter, with the array split between the threads of the pool
+bool ForthArray::BuiltIn_FilterParallel(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_Filter, true);
+}
+
+// ( array x xt -- x' ) As array-reduce, with each chunk of the array folded into x on the thread pool, then the
+//  chunks' results folded together in order.  So xt must be associative, and x must make no difference to it (0 for +)
+bool ForthArray::BuiltIn_ReduceParallel(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_Reduce, true);
+}
+
+// ( array xt -- ) As array-foreach, with the array split between the threads of the pool, so in no particular order
+bool ForthArray::BuiltIn_ForEachParallel(ExecState* pExecState) {
+	return RunOperation(pExecState, ArrayOperation_ForEach, true);
+}
+
+const char* ForthArray::OperationName(ArrayOperation operation, bool parallel) {
+	switch (operation) {
+	case ArrayOperation_Map: return parallel ? "array-map-parallel" : "array-map";
+	case ArrayOperation_Filter: return parallel ? "array-filter-parallel" : "array-filter";
+	case ArrayOperation_Reduce: return parallel ? "array-reduce-parallel" : "array-reduce";
+	default: return parallel ? "array-foreach-parallel" : "array-foreach";
+	}
+}
+
+bool ForthArray::RunOperation(ExecState* pExecState, ArrayOperation operation, bool parallel) {
+	std::string name = OperationName(operation, parallel);
+	if (!pExecState->pStack->TOSIsType(StackElement_PterToCFA)) {
+		std::string message = name + " expects an execution token on the top of the stack";
+		return pExecState->CreateException(message.c_str());
+	}
+	WordBodyElement** pCFA = pExecState->pStack->PullAsCFA();
+	StackElement initial;
+	if (operation == ArrayOperation_Reduce) {
+		if (pExecState->pStack->Count() == 0) {
+			std::string info = "whilst getting the initial value for " + name;
+			return pExecState->CreateStackUnderflowException(info.c_str());
+		}
+		initial = pExecState->pStack->PullNoPter();
+	}
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		std::string info = "whilst getting the array for " + name;
+		return pExecState->CreateStackUnderflowException(info.c_str());
+	}
+	if (pElement->GetType() != ObjectType_Array) {
+		delete pElement;
+		pElement = nullptr;
+		std::string message = name + " requires an array";
+		return pExecState->CreateException(message.c_str());
+	}
+
+	// The element's reference keeps the array alive whilst xt runs
+	ForthArray* pArray = (ForthArray*)pElement->GetObject();
+	if (parallel && operation == ArrayOperation_Reduce && initial.GetType() != pArray->containedType) {
+		delete pElement;
+		pElement = nullptr;
+		std::string message = name + " combines partial results with xt, so x must be the type of the array's elements";
+		return pExecState->CreateException(message.c_str());
+	}
+	std::vector<StackElement> outputs;
+	bool succeeded;
+	// An array that fits in one chunk isn't worth handing to another thread
+	if (parallel && pArray->Count() > c_parallelChunkSize) {
+		succeeded = pArray->ApplyInParallel(pExecState, operation, pCFA, initial, outputs);
+	}
+	else {
+		succeeded = pArray->ApplyToRange(pExecState, operation, pCFA, 0, pArray->Count(), initial, false, outputs);
+	}
+	ForthType containedType = pArray->containedType;
+	delete pElement;
+	pElement = nullptr;
+	if (!succeeded) {
+		return false;
+	}
+
+	if (operation == ArrayOperation_Reduce) {
+		if (!pExecState->pStack->Push(outputs[0])) {
+			return pExecState->CreateStackOverflowException("whilst pushing the result of a reduction");
+		}
+	}
+	else if (operation != ArrayOperation_ForEach) {
+		if (operation == ArrayOperation_Map && outputs.size() > 0) {
+			containedType = outputs[0].GetType();
+			for (const StackElement& output : outputs) {
+				if (output.GetType() != containedType) {
+					std::string message = name + " expects xt to make the same type for every element";
+					return pExecState->CreateException(message.c_str());
+				}
+			}
+		}
+		ForthArray* pNewArray = new ForthArray(nullptr);
+		pNewArray->SetContainedType(containedType);
+		if (pNewArray->IsPacked()) {
+			pNewArray->Reserve(outputs.size());
+			for (const StackElement& output : outputs) {
+				pNewArray->AddElement(output);
+			}
+		}
+		else {
+			pNewArray->elements.swap(outputs);
+		}
+		if (!pExecState->pStack->Push((RefCountedObject*)pNewArray)) {
+			return pExecState->CreateStackOverflowException("whilst pushing an array");
+		}
+	}
+	return true;
+}
+
+bool ForthArray::ApplyToRange(ExecState* pExecState, ArrayOperation operation, WordBodyElement** pCFA, size_t start,
+	size_t end, const StackElement& initial, bool escapeOutputs, std::vector<StackElement>& outputs) const {
+	DataStack* pStack = pExecState->pStack;
+	int depth = pStack->Count();
+	if (operation == ArrayOperation_Reduce) {
+		if (!pStack->Push(initial)) {
+			return pExecState->CreateStackOverflowException("whilst pushing the initial value of a reduction");
+		}
+		++depth;
+	}
+	// The size is checked each time, in case xt shrinks the array
+	for (size_t n = start; n < end && n < Count(); n++) {
+		if (!PushElement(pStack, n) || !pStack->Push(pCFA)) {
+			return pExecState->CreateStackOverflowException("whilst pushing an array element");
+		}
+		if (!PreBuiltWords::BuiltIn_Execute(pExecState)) {
+			return false;
+		}
+
+		switch (operation) {
+		case ArrayOperation_Map:
+			if (pStack->Count() != depth + 1) {
+				return pExecState->CreateException("xt must leave one value in place of each element");
+			}
+			if (!TakeOutput(pExecState, escapeOutputs, outputs)) {
+				return false;
+			}
+			break;
+		case ArrayOperation_Filter:
+			if (pStack->Count() != depth + 1 || !pStack->TOSIsType(StackElement_Bool)) {
+				return pExecState->CreateException("xt must leave a bool in place of each element");
+			}
+			if (pStack->PullAsBool()) {
+				outputs.push_back(GetElement(n));
+			}
+			break;
+		case ArrayOperation_Reduce:
+			if (pStack->Count() != depth) {
+				return pExecState->CreateException("xt must leave one value in place of the value and element reduced");
+			}
+			break;
+		default:
+			if (pStack->Count() != depth) {
+				return pExecState->CreateException("xt must consume each element and leave nothing");
+			}
+			break;
+		}
+		// The array word itself holds everything it uses counted, so between elements is a safe point
+		pExecState->SafePoint(1);
+	}
+	if (operation == ArrayOperation_Reduce) {
+		return TakeOutput(pExecState, escapeOutputs, outputs);
+	}
+	return true;
+}
+
+bool ForthArray::TakeOutput(ExecState* pExecState, bool escape, std::vector<StackElement>& outputs) {
+	StackElement output = pExecState->pStack->PullNoPter();
+	if (!escape) {
+		outputs.push_back(output);
+		return true;
+	}
+	outputs.emplace_back();
+	if (!ForthTask::ToTaskValue(&output, outputs.back())) {
+		return pExecState->CreateException("Only values, strings, arrays, channels and shared objects can be passed back from the thread pool");
+	}
+	return true;
+}
+
+bool ForthArray::ApplyInParallel(ExecState* pExecState, ArrayOperation operation, WordBodyElement** pCFA,
+	const StackElement& initial, std::vector<StackElement>& outputs) {
+	// The workers read the array, its elements and the initial value from other threads
+	std::vector<RefCountedObject*> roots;
+	roots.push_back(this);
+	RefCountedObject* pInitialObject = initial.GetDirectObject();
+	if (pInitialObject != nullptr) {
+		roots.push_back(pInitialObject);
+	}
+	if (!RefCountedObject::EscapeObjects(roots)) {
+		return pExecState->CreateException("Only values, strings, arrays, channels and shared objects can be used on the thread pool");
+	}
+
+	ThreadPool* pPool = ThreadPool::GetThreadPool();
+	std::shared_ptr<ArrayJob> pJob = std::make_shared<ArrayJob>();
+	pJob->pDict = ForthFuture::ShareDictionaryView(pExecState);
+	pJob->pArray = this;
+	pJob->operation = operation;
+	pJob->pCFA = pCFA;
+	pJob->initial = initial;
+	pJob->elementCount = Count();
+	pJob->chunkCount = (pJob->elementCount + c_parallelChunkSize - 1) / c_parallelChunkSize;
+	pJob->chunkOutputs.resize(pJob->chunkCount);
+	pJob->nextChunk = 0;
+	pJob->failedChunk = pJob->chunkCount;
+	pJob->runningWorkers = std::min(pPool->GetWorkerCount(), pJob->chunkCount);
+	for (size_t n = pJob->runningWorkers; n > 0; n--) {
+		pPool->Submit([pJob]() { RunChunks(pJob.get()); });
+	}
+
+	pPool->BeginBlocking();
+	{
+		std::unique_lock<std::mutex> lock(pJob->mutex);
+		pJob->finishedCondition.wait(lock, [&pJob]() { return pJob->runningWorkers == 0; });
+	}
+	pPool->EndBlocking();
+
+	if (pJob->exception.size() > 0) {
+		return pExecState->CreateException(pJob->exception.c_str());
+	}
+	if (operation != ArrayOperation_Reduce) {
+		for (std::vector<StackElement>& chunkOutput : pJob->chunkOutputs) {
+			outputs.insert(outputs.end(), chunkOutput.begin(), chunkOutput.end());
+		}
+		return true;
+	}
+
+	// Folds the chunks' results together in order, here, so the result doesn't depend on which worker finished first
+	DataStack* pStack = pExecState->pStack;
+	int depth = pStack->Count();
+	if (!pStack->Push(pJob->chunkOutputs[0][0])) {
+		return pExecState->CreateStackOverflowException("whilst combining the results of a reduction");
+	}
+	for (size_t n = 1; n < pJob->chunkCount; n++) {
+		if (!pStack->Push(pJob->chunkOutputs[n][0]) || !pStack->Push(pCFA)) {
+			return pExecState->CreateStackOverflowException("whilst combining the results of a reduction");
+		}
+		if (!PreBuiltWords::BuiltIn_Execute(pExecState)) {
+			return false;
+		}
+		if (pStack->Count() != depth + 1) {
+			return pExecState->CreateException("xt must leave one value in place of the value and element reduced");
+		}
+	}
+	return TakeOutput(pExecState, false, outputs);
+}
+
+// Runs on a pool thread.  The ExecState is created and deleted here, as its stacks belong to this thread
+void ForthArray::RunChunks(ArrayJob* pJob) {
+	ExecState* pExecState = Bootstrap::CreateExecState(pJob->pDict);
+	while (true) {
+		size_t chunk = pJob->nextChunk.fetch_add(1);
+		if (chunk >= pJob->chunkCount || chunk > pJob->failedChunk.load()) {
+			break;
+		}
+		size_t start = chunk * c_parallelChunkSize;
+		size_t end = std::min(start + c_parallelChunkSize, pJob->elementCount);
+		bool succeeded = false;
+		try {
+			succeeded = pJob->pArray->ApplyToRange(pExecState, (ArrayOperation)pJob->operation, pJob->pCFA, start, end,
+				pJob->initial, true, pJob->chunkOutputs[chunk]);
+		}
+		catch (...) {
+			pExecState->CreateException("Execution caused exception");
+		}
+		if (!succeeded) {
+			std::lock_guard<std::mutex> lock(pJob->mutex);
+			if (chunk < pJob->failedChunk.load()) {
+				pJob->failedChunk = chunk;
+				pJob->exception = pExecState->pzException != nullptr ? pExecState->pzException : "unknown";
+			}
+			break;
+		}
+	}
+	Bootstrap::DeleteExecState(pExecState);
+
+	{
+		std::lock_guard<std::mutex> lock(pJob->mutex);
+		--pJob->runningWorkers;
+	}
+	pJob->finishedCondition.notify_all();
+}
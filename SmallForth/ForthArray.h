@@ -1,9 +1,13 @@
 #pragma once
+#include <stdint.h>
 #include <vector>
 #include "RefCountedObject.h"
 
 class ExecState;
+class DataStack;
 class StackElement;
+class WordBodyElement;
+struct ArrayJob;
 
 class ForthArray :
     public RefCountedObject
@@ -11,6 +15,9 @@ class ForthArray :
 public:
 	ForthArray(ForthDict* pDict);
 	~ForthArray();
+
+	static void* operator new(size_t size);
+	static void operator delete(void* pBlock, size_t size);
 	virtual std::string GetObjectType();
 	virtual bool ToString(ExecState* pExecState) const;
 
@@ -18,16 +25,72 @@ public:
 
 	static bool Construct(ExecState* pExecState);
 
-	void SetContainedType(ForthType t) { this->containedType = t; }
+	// Set before any element is added.  Arrays of chars, ints, floats and bools hold their values packed, one after
+	//  another, rather than as stack elements, and box them only when they are accessed
+	void SetContainedType(ForthType t);
 	ForthType GetContainedType() const { return this->containedType; }
 
+	bool IsPacked() const { return this->packedSize > 0; }
+	size_t Count() const { return IsPacked() ? this->packedElements.size() / this->packedSize : this->elements.size(); }
+	// The element must be of the contained type
+	void AddElement(const StackElement& element);
+	void SetElement(size_t index, const StackElement& element);
+	StackElement GetElement(size_t index) const;
+	// Pushes the element straight onto the stack, without boxing it first
+	bool PushElement(DataStack* pStack, size_t index) const;
+	void Reserve(size_t count);
+
+	virtual void AddChildObjects(std::vector<RefCountedObject*>& children) const;
+	virtual void ReleaseChildObjects();
+	virtual bool CanEscape() const { return true; }
+
+	static bool BuiltIn_Map(ExecState* pExecState);
+	static bool BuiltIn_Filter(ExecState* pExecState);
+	static bool BuiltIn_Reduce(ExecState* pExecState);
+	static bool BuiltIn_ForEach(ExecState* pExecState);
+	static bool BuiltIn_MapParallel(ExecState* pExecState);
+	static bool BuiltIn_FilterParallel(ExecState* pExecState);
+	static bool BuiltIn_ReduceParallel(ExecState* pExecState);
+	static bool BuiltIn_ForEachParallel(ExecState* pExecState);
+
 private:
+	enum ArrayOperation {
+		ArrayOperation_Map,
+		ArrayOperation_Filter,
+		ArrayOperation_Reduce,
+		ArrayOperation_ForEach
+	};
+
+	static bool RunOperation(ExecState* pExecState, ArrayOperation operation, bool parallel);
+	// Applies xt to the elements from start up to end.  Map and filter add to outputs, and reduce starts from initial
+	//  and adds what it ends with.  Outputs passed back to another thread are escaped
+	bool ApplyToRange(ExecState* pExecState, ArrayOperation operation, WordBodyElement** pCFA, size_t start, size_t end,
+		const StackElement& initial, bool escapeOutputs, std::vector<StackElement>& outputs) const;
+	bool ApplyInParallel(ExecState* pExecState, ArrayOperation operation, WordBodyElement** pCFA,
+		const StackElement& initial, std::vector<StackElement>& outputs);
+	static void RunChunks(ArrayJob* pJob);
+	static bool TakeOutput(ExecState* pExecState, bool escape, std::vector<StackElement>& outputs);
+	static const char* OperationName(ArrayOperation operation, bool parallel);
+	template<typename T> T LoadPacked(size_t index) const;
+	template<typename T> void StorePacked(size_t index, T value);
+
+
+	friend class DictionaryImage;
 	bool GetSize(ExecState* pExecState);
 	bool Append(ExecState* pExecState);
 	bool ElementAtIndex(ExecState* pExecState);
 	bool SetElementAtIndex(ExecState* pExecState);
+	bool EscapeElement(ExecState* pExecState, const StackElement& element);
 private:
 	ForthType containedType;
+	// Unless packed
 	std::vector<StackElement> elements;
+	// If packed, the values, each packedSize bytes long
+	std::vector<uint8_t> packedElements;
+	size_t packedSize;
+
+	// The parallel words split arrays into chunks of this many elements, whatever the number of threads, so a
+	//  reduction combines the same partial results in the same order each time
+	static const size_t c_parallelChunkSize = 1024;
 };
 
@@ -0,0 +1,375 @@
+#include "ForthDefs.h"
+#include <chrono>
+#include <thread>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+#include "ForthChannel.h"
+#include "ForthFuture.h"
+#include "ExecState.h"
+#include "DataStack.h"
+#include "ThreadPool.h"
+#include "GreenTask.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+	"Futex waits need an atomic uint32_t to be a plain uint32_t");
+
+// Sleeps whilst *pValue is expected, for at most milliseconds unless that is negative.  May return early
+static void FutexWait(std::atomic<uint32_t>* pValue, uint32_t expected, int milliseconds) {
+#if defined(_WIN32)
+	WaitOnAddress((volatile VOID*)pValue, &expected, sizeof(expected), milliseconds < 0 ? INFINITE : (DWORD)milliseconds);
+#elif defined(__linux__)
+	struct timespec timeout;
+	timeout.tv_sec = milliseconds / 1000;
+	timeout.tv_nsec = (milliseconds % 1000) * 1000000L;
+	syscall(SYS_futex, (uint32_t*)pValue, FUTEX_WAIT_PRIVATE, expected, milliseconds < 0 ? nullptr : &timeout, nullptr, 0);
+#else
+	if (pValue->load() == expected) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+#endif
+}
+
+static void FutexWake(std::atomic<uint32_t>* pValue, bool all) {
+#if defined(_WIN32)
+	if (all) {
+		WakeByAddressAll((PVOID)pValue);
+	}
+	else {
+		WakeByAddressSingle((PVOID)pValue);
+	}
+#elif defined(__linux__)
+	syscall(SYS_futex, (uint32_t*)pValue, FUTEX_WAKE_PRIVATE, all ? INT32_MAX : 1, nullptr, nullptr, 0);
+#endif
+}
+
+size_t ChannelQueue::RoundUpCapacity(size_t capacity) {
+	size_t rounded = 2;
+	while (rounded < capacity) {
+		rounded *= 2;
+	}
+	return rounded;
+}
+
+SpscQueue::SpscQueue(size_t capacity) {
+	this->slots.resize(RoundUpCapacity(capacity));
+	this->mask = this->slots.size() - 1;
+	this->head = 0;
+	this->tail = 0;
+}
+
+bool SpscQueue::TryPush(const StackElement& element) {
+	size_t position = this->tail.load(std::memory_order_relaxed);
+	if (position - this->head.load(std::memory_order_acquire) == this->slots.size()) {
+		return false;
+	}
+	this->slots[position & this->mask] = element;
+	this->tail.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+bool SpscQueue::TryPop(StackElement& element) {
+	size_t position = this->head.load(std::memory_order_relaxed);
+	if (position == this->tail.load(std::memory_order_acquire)) {
+		return false;
+	}
+	element = std::move(this->slots[position & this->mask]);
+	this->head.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+size_t SpscQueue::Count() const {
+	return this->tail.load(std::memory_order_acquire) - this->head.load(std::memory_order_acquire);
+}
+
+MpmcQueue::MpmcQueue(size_t capacity) {
+	size_t cellCount = RoundUpCapacity(capacity);
+	this->cells.reset(new Cell[cellCount]);
+	this->mask = cellCount - 1;
+	// Cell n is first ready to be pushed to at position n
+	for (size_t n = 0; n < cellCount; n++) {
+		this->cells[n].sequence.store(n, std::memory_order_relaxed);
+	}
+	this->pushPosition = 0;
+	this->popPosition = 0;
+}
+
+bool MpmcQueue::TryPush(const StackElement& element) {
+	size_t position = this->pushPosition.load(std::memory_order_relaxed);
+	Cell* pCell;
+	while (true) {
+		pCell = &this->cells[position & this->mask];
+		intptr_t difference = (intptr_t)pCell->sequence.load(std::memory_order_acquire) - (intptr_t)position;
+		if (difference == 0) {
+			if (this->pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			// Not yet popped from the previous time round
+			return false;
+		}
+		else {
+			position = this->pushPosition.load(std::memory_order_relaxed);
+		}
+	}
+	pCell->element = element;
+	pCell->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+bool MpmcQueue::TryPop(StackElement& element) {
+	size_t position = this->popPosition.load(std::memory_order_relaxed);
+	Cell* pCell;
+	while (true) {
+		pCell = &this->cells[position & this->mask];
+		intptr_t difference = (intptr_t)pCell->sequence.load(std::memory_order_acquire) - (intptr_t)(position + 1);
+		if (difference == 0) {
+			if (this->popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			// Not yet pushed to
+			return false;
+		}
+		else {
+			position = this->popPosition.load(std::memory_order_relaxed);
+		}
+	}
+	element = std::move(pCell->element);
+	// Ready to be pushed to next time round
+	pCell->sequence.store(position + this->mask + 1, std::memory_order_release);
+	return true;
+}
+
+size_t MpmcQueue::Count() const {
+	size_t pushed = this->pushPosition.load(std::memory_order_acquire);
+	size_t popped = this->popPosition.load(std::memory_order_acquire);
+	return pushed > popped ? pushed - popped : 0;
+}
+
+ForthChannel::ForthChannel(ChannelQueue* pQueue) :
+	RefCountedObject(nullptr) {
+	this->objectType = ObjectType_Channel;
+	this->pQueue = pQueue;
+	this->closed = false;
+	this->pushes = 0;
+	this->pops = 0;
+	this->waitingReceivers = 0;
+	this->waitingSenders = 0;
+}
+
+ForthChannel::~ForthChannel() {
+	delete this->pQueue;
+	this->pQueue = nullptr;
+}
+
+std::string ForthChannel::GetObjectType() {
+	return "channel";
+}
+
+bool ForthChannel::ToString(ExecState* pExecState) const {
+	std::string description = "channel (" + std::to_string(this->pQueue->Count()) + " of " + std::to_string(this->pQueue->GetCapacity());
+	description += IsClosed() ? ", closed)" : ")";
+	if (!pExecState->pStack->Push(description)) {
+		return pExecState->CreateStackOverflowException();
+	}
+	return true;
+}
+
+bool ForthChannel::InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke) {
+	switch (functionToInvoke) {
+	case Function_GetSize:
+		if (!pExecState->pStack->Push((int64_t)this->pQueue->Count())) {
+			return pExecState->CreateStackOverflowException("whilst getting size of channel");
+		}
+		return true;
+	case Function_Close:
+		Close();
+		return true;
+	default:
+		return pExecState->CreateException("Cannot invoke that function on a channel object");
+	}
+}
+
+// Only wakes anything if there are waiters.  Receivers only wait on an empty channel, and senders on a full one, so in
+//  practice that is the push that makes the channel non-empty, or the pop that makes it non-full
+void ForthChannel::Signal(std::atomic<uint32_t>& event, std::atomic<uint32_t>& waiters, bool all) {
+	// Pairs with the fence in Wait: either the waiter sees the change to the queue, or this sees the waiter
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_relaxed) > 0) {
+		event.fetch_add(1);
+		FutexWake(&event, all);
+	}
+}
+
+bool ForthChannel::CanProceed(bool sending) const {
+	if (IsClosed()) {
+		return true;
+	}
+	size_t count = this->pQueue->Count();
+	return sending ? count < this->pQueue->GetCapacity() : count > 0;
+}
+
+// Waits until there may be room to send, or something to receive, or the channel is closed.  It counts itself in
+//  as a waiter, then checks the queue again, and only sleeps (telling the pool, if on a worker) if it still can't
+//  proceed
+void ForthChannel::Wait(bool sending) {
+	std::atomic<uint32_t>& event = sending ? this->pops : this->pushes;
+	std::atomic<uint32_t>& waiters = sending ? this->waitingSenders : this->waitingReceivers;
+	uint32_t seen = event.load(std::memory_order_acquire);
+	waiters.fetch_add(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!CanProceed(sending)) {
+		// On a worker, the task at the other end may be queued behind this one
+		ThreadPool* pPool = ThreadPool::OnWorkerThread() ? ThreadPool::GetThreadPool() : nullptr;
+		if (pPool != nullptr) {
+			pPool->BeginBlocking();
+		}
+		FutexWait(&event, seen, -1);
+		if (pPool != nullptr) {
+			pPool->EndBlocking();
+		}
+	}
+	waiters.fetch_sub(1);
+}
+
+// Waits for room, returning false if the channel is closed
+bool ForthChannel::Send(const StackElement& element, GreenScheduler* pScheduler) {
+	while (!IsClosed()) {
+		if (this->pQueue->TryPush(element)) {
+			Signal(this->pushes, this->waitingReceivers, false);
+			return true;
+		}
+		if (pScheduler == nullptr || !pScheduler->PauseWhileWaiting()) {
+			Wait(true);
+		}
+	}
+	return false;
+}
+
+// Returns false if the channel is empty and (when waiting) closed
+bool ForthChannel::Receive(StackElement& element, bool wait, GreenScheduler* pScheduler) {
+	while (true) {
+		bool closedBeforePop = IsClosed();
+		if (this->pQueue->TryPop(element)) {
+			Signal(this->pops, this->waitingSenders, false);
+			return true;
+		}
+		// Anything sent before the close has been received
+		if (!wait || closedBeforePop) {
+			return false;
+		}
+		if (pScheduler == nullptr || !pScheduler->PauseWhileWaiting()) {
+			Wait(false);
+		}
+	}
+}
+
+void ForthChannel::Close() {
+	this->closed.store(true, std::memory_order_release);
+	Signal(this->pushes, this->waitingReceivers, true);
+	Signal(this->pops, this->waitingSenders, true);
+}
+
+// ( n -- channel ) A channel holding up to n values (rounded up to a power of two), for any number of senders and receivers
+bool ForthChannel::Construct(ExecState* pExecState) {
+	return ConstructChannel(pExecState, false);
+}
+
+// ( n -- channel ) As channel_type construct, for exactly one sending and one receiving ExecState
+bool ForthChannel::BuiltIn_SpscChannel(ExecState* pExecState) {
+	return ConstructChannel(pExecState, true);
+}
+
+bool ForthChannel::ConstructChannel(ExecState* pExecState, bool singleEnded) {
+	if (!pExecState->pStack->TOSIsType(StackElement_Int)) {
+		return pExecState->CreateException("Cannot construct channel, requires ( n -- channel )");
+	}
+	int64_t capacity = pExecState->pStack->PullAsInt();
+	if (capacity < 1 || capacity > (1 << 24)) {
+		return pExecState->CreateException("Channel capacity must be between 1 and 16777216");
+	}
+	ChannelQueue* pQueue;
+	if (singleEnded) {
+		pQueue = new SpscQueue((size_t)capacity);
+	}
+	else {
+		pQueue = new MpmcQueue((size_t)capacity);
+	}
+	if (!pExecState->pStack->Push((RefCountedObject*)new ForthChannel(pQueue))) {
+		return pExecState->CreateStackOverflowException("whilst pushing a channel");
+	}
+	return true;
+}
+
+// ( x channel -- ) Waits whilst the channel is full
+bool ForthChannel::BuiltIn_Send(ExecState* pExecState) {
+	if (!pExecState->pStack->TOSIsType((ElementType)ObjectType_Channel)) {
+		return pExecState->CreateException("send requires a channel");
+	}
+	StackElement* pElementChannel = pExecState->pStack->Pull();
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		delete pElementChannel;
+		pElementChannel = nullptr;
+		return pExecState->CreateStackUnderflowException("whilst getting value to send");
+	}
+	ForthChannel* pChannel = (ForthChannel*)pElementChannel->GetObject();
+	StackElement value;
+	bool success;
+	if (!ForthTask::ToTaskValue(pElement, value)) {
+		success = pExecState->CreateException("Only values, strings, arrays, channels and shared objects can be sent on a channel");
+	}
+	else if (!pChannel->Send(value, pExecState->pScheduler)) {
+		success = pExecState->CreateException("Cannot send on a closed channel");
+	}
+	else {
+		success = true;
+	}
+	delete pElement;
+	pElement = nullptr;
+	delete pElementChannel;
+	pElementChannel = nullptr;
+	return success;
+}
+
+// ( channel -- x true | false ) Waits whilst the channel is empty.  False once the channel is closed and empty
+bool ForthChannel::BuiltIn_Receive(ExecState* pExecState) {
+	return ReceiveWord(pExecState, true);
+}
+
+// ( channel -- x true | false ) False if the channel is empty, without waiting
+bool ForthChannel::BuiltIn_TryReceive(ExecState* pExecState) {
+	return ReceiveWord(pExecState, false);
+}
+
+bool ForthChannel::ReceiveWord(ExecState* pExecState, bool wait) {
+	if (!pExecState->pStack->TOSIsType((ElementType)ObjectType_Channel)) {
+		return pExecState->CreateException("Receiving requires a channel");
+	}
+	// Held counted whilst waiting, as it is no longer on the stack
+	StackElement* pElementChannel = pExecState->pStack->Pull();
+	ForthChannel* pChannel = (ForthChannel*)pElementChannel->GetObject();
+	StackElement value;
+	bool received = pChannel->Receive(value, wait, pExecState->pScheduler);
+	delete pElementChannel;
+	pElementChannel = nullptr;
+
+	if (received && !pExecState->pStack->Push(value)) {
+		return pExecState->CreateStackOverflowException("whilst pushing a received value");
+	}
+	if (!pExecState->pStack->Push(received)) {
+		return pExecState->CreateStackOverflowException("whilst pushing whether a value was received");
+	}
+	return true;
+}
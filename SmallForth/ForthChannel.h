@@ -0,0 +1,113 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "RefCountedObject.h"
+#include "StackElement.h"
+class GreenScheduler;
+
+// A bounded queue of stack elements.  Both kinds are lock-free: pushing to a full queue, or popping from an empty one,
+//  fails rather than waits
+class ChannelQueue
+{
+public:
+	virtual ~ChannelQueue() { }
+	virtual bool TryPush(const StackElement& element) = 0;
+	virtual bool TryPop(StackElement& element) = 0;
+	virtual size_t Count() const = 0;
+	size_t GetCapacity() const { return this->mask + 1; }
+
+protected:
+	// Capacities are rounded up to a power of two, so positions wrap with a mask
+	static size_t RoundUpCapacity(size_t capacity);
+	size_t mask;
+};
+
+// A ring for one sending thread and one receiving thread.  Each end writes only its own position
+class SpscQueue : public ChannelQueue
+{
+public:
+	SpscQueue(size_t capacity);
+
+	virtual bool TryPush(const StackElement& element);
+	virtual bool TryPop(StackElement& element);
+	virtual size_t Count() const;
+
+private:
+	std::vector<StackElement> slots;
+	// Kept on separate cache lines, as the two ends update them from different threads
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+};
+
+// A ring for any number of sending and receiving threads (Vyukov's bounded queue).  Each cell has a sequence number
+//  saying whether it is ready to be pushed to or popped from at a given position, and the ends claim positions with a
+//  compare and swap
+class MpmcQueue : public ChannelQueue
+{
+public:
+	MpmcQueue(size_t capacity);
+
+	virtual bool TryPush(const StackElement& element);
+	virtual bool TryPop(StackElement& element);
+	virtual size_t Count() const;
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		StackElement element;
+	};
+	std::unique_ptr<Cell[]> cells;
+	alignas(64) std::atomic<size_t> pushPosition;
+	alignas(64) std::atomic<size_t> popPosition;
+};
+
+// A bounded channel for passing values between ExecStates, on the same or different threads.  Anything that can be
+//  passed to a task can be sent (see ForthTask::ToTaskValue), and the channel itself can be passed to tasks.  A sender
+//  waits whilst the channel is full and a receiver whilst it is empty.  Waiting threads sleep on a futex (WaitOnAddress
+//  on Windows) until the other end moves, and the other end only signals whilst something is waiting, so sending and
+//  receiving otherwise cost no more than the queue.  A pool worker about to sleep tells the pool, which starts another
+//  worker if all are waiting, as the task at the other end may be queued behind it.  A green task (or the ExecState
+//  that made it) pauses instead, whilst other green tasks on its thread can run.
+class ForthChannel : public RefCountedObject
+{
+public:
+	ForthChannel(ChannelQueue* pQueue);
+	~ForthChannel();
+
+	virtual std::string GetObjectType();
+	virtual bool ToString(ExecState* pExecState) const;
+	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
+	// What is sent escapes as it is sent, so the channel holds nothing that needs to escape with it
+	virtual bool CanEscape() const { return true; }
+
+	// Given the scheduler of the green tasks on this thread, lets them run rather than waiting, as one may be the other end
+	bool Send(const StackElement& element, GreenScheduler* pScheduler);
+	bool Receive(StackElement& element, bool wait, GreenScheduler* pScheduler);
+	void Close();
+	bool IsClosed() const { return this->closed.load(std::memory_order_acquire); }
+
+	static bool Construct(ExecState* pExecState);
+	static bool BuiltIn_SpscChannel(ExecState* pExecState);
+	static bool BuiltIn_Send(ExecState* pExecState);
+	static bool BuiltIn_Receive(ExecState* pExecState);
+	static bool BuiltIn_TryReceive(ExecState* pExecState);
+
+private:
+	static bool ConstructChannel(ExecState* pExecState, bool singleEnded);
+	static bool ReceiveWord(ExecState* pExecState, bool wait);
+	static void Signal(std::atomic<uint32_t>& event, std::atomic<uint32_t>& waiters, bool all);
+	bool CanProceed(bool sending) const;
+	void Wait(bool sending);
+
+private:
+	ChannelQueue* pQueue;
+	std::atomic<bool> closed;
+	// Bumped after a push, or a pop, whilst anything is waiting for one.  A waiting thread sleeps until the one it
+	//  waits on changes
+	std::atomic<uint32_t> pushes;
+	std::atomic<uint32_t> pops;
+	std::atomic<uint32_t> waitingReceivers;
+	std::atomic<uint32_t> waitingSenders;
+};
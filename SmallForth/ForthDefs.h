@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include <string>
+#include <string_view>
 
 using std::int64_t;
 
@@ -77,7 +78,11 @@ enum ObjectTypes {
 	ObjectType_WriteFile,
 	ObjectType_ReadWriteFile,
 	ObjectType_Array,
-	ObjectType_Vector3
+	ObjectType_Vector3,
+	ObjectType_Future,
+	ObjectType_Channel,
+	ObjectType_Task,
+	ObjectType_Generator
 };
 
 enum SystemFiles {
@@ -87,7 +92,8 @@ enum SystemFiles {
 	forth_stderr = 3
 };
 
+// A view into the input buffer, only valid until the next word is read from the input
 struct InputWord {
-	std::string word;
+	std::string_view word;
 	int postDelimiterCount;
 };
@@ -1,77 +1,379 @@
 #include "ForthDefs.h"
-#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "ForthDict.h"
 #include "ForthWord.h"
 #include "ExecState.h"
 #include "DataStack.h"
 #include "WordBodyElement.h"
+#include "TypeSystem.h"
+
+// This will break if characters in string are UTF-8, or anything more exotic than that.
+// TODO Consider using unicode libraries
+static inline char FoldCase(char c) {
+	return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+// First two characters (case-folded) of every word added to any dictionary.  Bits are never cleared, so a forgotten
+//  word's prefix still sends words through the lookups, which is merely slower.  Atomic, as dictionaries on
+//  different threads add words concurrently.
+static std::atomic<uint64_t> s_wordPrefixes[65536 / 64];
+
+// Epoch-based reclamation of replaced tables.  A thread reading a dictionary publishes the epoch it started reading
+//  in, and each replacement of a table moves the epoch on.  A table replaced in epoch e can still be read by threads
+//  that started reading in e or earlier, so is deleted once every reading thread started later.  Reads are not
+//  nested in practice, but a layered lookup reads two dictionaries, so the depth is counted
+struct ReaderEpoch {
+	ReaderEpoch();
+	~ReaderEpoch();
+	// 0 whilst not reading
+	std::atomic<uint64_t> epoch;
+	int depth;
+};
+
+static std::atomic<uint64_t> s_epoch(1);
+static std::mutex s_readersMutex;
+static std::vector<ReaderEpoch*> s_readers;
+static thread_local ReaderEpoch t_reader;
+
+ReaderEpoch::ReaderEpoch() :
+	epoch(0), depth(0) {
+	std::lock_guard<std::mutex> lock(s_readersMutex);
+	s_readers.push_back(this);
+}
+
+ReaderEpoch::~ReaderEpoch() {
+	std::lock_guard<std::mutex> lock(s_readersMutex);
+	for (size_t n = 0; n < s_readers.size(); n++) {
+		if (s_readers[n] == this) {
+			s_readers[n] = s_readers.back();
+			s_readers.pop_back();
+			break;
+		}
+	}
+}
+
+// Held whilst reading a dictionary's table.  Takes no lock
+class ReadSection
+{
+public:
+	ReadSection() {
+		ReaderEpoch& reader = t_reader;
+		if (reader.depth++ == 0) {
+			// Sequentially consistent, so that a writer either sees this epoch, or has already published the table
+			//  this thread is about to read
+			reader.epoch.store(s_epoch.load());
+		}
+	}
+	~ReadSection() {
+		ReaderEpoch& reader = t_reader;
+		if (--reader.depth == 0) {
+			reader.epoch.store(0, std::memory_order_release);
+		}
+	}
+};
+
+static uint64_t OldestReadingEpoch() {
+	uint64_t oldest = UINT64_MAX;
+	std::lock_guard<std::mutex> lock(s_readersMutex);
+	for (ReaderEpoch* pReader : s_readers) {
+		uint64_t epoch = pReader->epoch.load();
+		if (epoch != 0 && epoch < oldest) {
+			oldest = epoch;
+		}
+	}
+	return oldest;
+}
 
 ForthDict::ForthDict() :
 	RefCountedObject() {
 	objectType = ObjectType_Dict;
+	this->pTable.store(new DictTable(64), std::memory_order_relaxed);
+	this->pSharedDict = nullptr;
+}
+
+ForthDict::ForthDict(ForthDict* pSharedDict) :
+	ForthDict() {
+	this->pSharedDict = pSharedDict;
+	this->pSharedDict->IncReference();
 }
 
 ForthDict::~ForthDict() {
-	for (std::map<std::string, ForthWord*>::iterator iter = words.begin(); iter != words.end(); iter++) {
-		ForthWord* pWord = iter->second;
-		pWord->DecReference();
+	if (this->pSharedDict != nullptr) {
+		this->pSharedDict->DecReference();
+		this->pSharedDict = nullptr;
+	}
+	// Nothing can be reading a dictionary that is being deleted
+	DictTable* pTable = this->pTable.load(std::memory_order_relaxed);
+	for (DictEntry& entry : pTable->entries) {
+		if (entry.pWord != nullptr) {
+			entry.pWord->DecReference();
+			for (ForthWord* pWord : entry.previousVersions) {
+				pWord->DecReference();
+			}
+		}
 	}
+	delete pTable;
+	DeleteReplacedTables(true);
 }
 
-void ForthDict::AddWord(ForthWord* wordToAdd) {
-	std::string wordName = wordToAdd->GetName();
-	std::transform(wordName.begin(), wordName.end(), wordName.begin(),
-		[](unsigned char c) { return std::tolower(c); });
-	wordToAdd->IncReference();
-	this->words[wordName] = wordToAdd;
+// FNV-1a over the case-folded name
+uint32_t ForthDict::HashName(std::string_view wordName) {
+	uint32_t hash = 2166136261u;
+	for (char c : wordName) {
+		hash ^= (unsigned char)FoldCase(c);
+		hash *= 16777619u;
+	}
+	return hash;
 }
 
-ForthWord* ForthDict::FindWord(const std::string& wordName) const {
-	// This will break if characters in string are UTF-8, or anything more exotic than that.
-	// TODO Consider using unicode libraries
-	std::string lowerCaseName = wordName;
-	std::transform(lowerCaseName.begin(), lowerCaseName.end(), lowerCaseName.begin(),
-		[](unsigned char c) { return std::tolower(c); });
+bool ForthDict::FoldedNameMatches(const std::string& foldedName, std::string_view wordName) {
+	if (foldedName.length() != wordName.length()) {
+		return false;
+	}
+	for (size_t n = 0; n < wordName.length(); n++) {
+		if (foldedName[n] != FoldCase(wordName[n])) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	auto wordIter = this->words.find(lowerCaseName);
-	if (wordIter == this->words.end()) {
-		return nullptr;
+void ForthDict::FoldName(std::string_view wordName, std::string& foldedName) {
+	foldedName.assign(wordName);
+	for (char& c : foldedName) {
+		c = FoldCase(c);
 	}
-	if (wordIter->second->Visible()) {
-		return wordIter->second;
+}
+
+size_t ForthDict::GetPrefixKey(std::string_view wordName) {
+	if (wordName.length() == 0) {
+		return 0;
 	}
-	return nullptr;
+	size_t key = (size_t)(unsigned char)FoldCase(wordName[0]) << 8;
+	if (wordName.length() > 1) {
+		key |= (unsigned char)FoldCase(wordName[1]);
+	}
+	return key;
+}
+
+bool ForthDict::CouldBeWord(std::string_view wordName) {
+	size_t key = GetPrefixKey(wordName);
+	return (s_wordPrefixes[key / 64].load(std::memory_order_relaxed) & ((uint64_t)1 << (key % 64))) != 0;
+}
+
+bool ForthDict::NameMatches(const DictEntry& entry, uint32_t hash, std::string_view wordName) {
+	return entry.hash == hash && FoldedNameMatches(entry.foldedName, wordName);
+}
+
+// Returns the slot holding wordName, or the empty slot where it would be added
+size_t ForthDict::FindSlot(const DictTable* pTable, std::string_view wordName, uint32_t hash) {
+	size_t mask = pTable->entries.size() - 1;
+	size_t slot = hash & mask;
+	while (pTable->entries[slot].pWord != nullptr && !NameMatches(pTable->entries[slot], hash, wordName)) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
 }
 
-ForthWord* ForthDict::FindWordFromCFAPter(WordBodyElement** pPterToCFA) {
-	for (std::map<std::string, ForthWord*>::iterator iter = words.begin(); iter != words.end(); iter++) {
-		ForthWord* pWord = iter->second;
-		if (pWord->GetPterToBody() == pPterToCFA) {
-			return pWord;
+void ForthDict::Grow(DictTable* pTable) {
+	std::vector<DictEntry> oldEntries(pTable->entries.size() * 2);
+	oldEntries.swap(pTable->entries);
+	size_t mask = pTable->entries.size() - 1;
+	for (DictEntry& entry : oldEntries) {
+		if (entry.pWord != nullptr) {
+			size_t slot = entry.hash & mask;
+			while (pTable->entries[slot].pWord != nullptr) {
+				slot = (slot + 1) & mask;
+			}
+			pTable->entries[slot] = std::move(entry);
 		}
 	}
-	return nullptr;
 }
 
-bool ForthDict::ForgetWord(std::string wordName) {
-	std::transform(wordName.begin(), wordName.end(), wordName.begin(),
-		[](unsigned char c) { return std::tolower(c); });
+ForthDict::DictTable* ForthDict::BeginWrite() {
+	DictTable* pTable = this->pTable.load(std::memory_order_relaxed);
+	// Only the owning thread uses a dictionary that is not shared, so its table is changed in place
+	return IsShared() ? new DictTable(*pTable) : pTable;
+}
 
-	std::map<std::string, ForthWord*>::iterator word = this->words.find(wordName);
-	if (word != this->words.end()) {
-		word->second->SetWordVisibility(false);
-		// TODO Forgetting word will delete it - not required.  Will cause pointers to inside word to point at freed memory
-		word->second->DecReference();
+// Called with writeMutex held.  Makes the new table the one found by lookups
+void ForthDict::Publish(DictTable* pNewTable) {
+	DictTable* pOldTable = this->pTable.load(std::memory_order_relaxed);
+	if (pNewTable == pOldTable) {
+		return;
+	}
+	// Both sequentially consistent: a thread that reads the moved-on epoch also reads the new table
+	this->pTable.store(pNewTable);
+	if (IsShared()) {
+		this->replacedTables.push_back(std::make_pair(s_epoch.fetch_add(1), pOldTable));
+		DeleteReplacedTables(false);
 	}
 	else {
-		return false;
+		delete pOldTable;
 	}
+}
+
+// Deletes the replaced tables no thread can still be reading, or all of them
+void ForthDict::DeleteReplacedTables(bool all) {
+	if (this->replacedTables.size() == 0) {
+		return;
+	}
+	uint64_t oldestReading = all ? UINT64_MAX : OldestReadingEpoch();
+	size_t kept = 0;
+	for (std::pair<uint64_t, DictTable*>& replaced : this->replacedTables) {
+		if (replaced.first < oldestReading) {
+			delete replaced.second;
+		}
+		else {
+			this->replacedTables[kept++] = replaced;
+		}
+	}
+	this->replacedTables.resize(kept);
+}
 
+void ForthDict::AddWord(ForthWord* wordToAdd) {
+	std::lock_guard<std::mutex> lock(this->writeMutex);
+	if (IsShared() && !wordToAdd->IsShared()) {
+		// Other threads will use the word once it is published, so it can no longer be reference counted
+		std::vector<RefCountedObject*> roots;
+		roots.push_back(wordToAdd);
+		RefCountedObject::ShareObjects(roots);
+	}
+	std::string wordName = wordToAdd->GetName();
+	uint32_t hash = HashName(wordName);
+	size_t key = GetPrefixKey(wordName);
+	// Before the word is published, so no thread finds the word yet rules it out by its prefix
+	s_wordPrefixes[key / 64].fetch_or((uint64_t)1 << (key % 64), std::memory_order_relaxed);
+	DictTable* pCurrentTable = this->pTable.load(std::memory_order_relaxed);
+	if (pCurrentTable->entries[FindSlot(pCurrentTable, wordName, hash)].pWord == wordToAdd) {
+		return;
+	}
+
+	DictTable* pTable = BeginWrite();
+	if ((pTable->wordCount + 1) * 4 > pTable->entries.size() * 3) {
+		Grow(pTable);
+	}
+	DictEntry& entry = pTable->entries[FindSlot(pTable, wordName, hash)];
+	wordToAdd->IncReference();
+	if (entry.pWord == nullptr) {
+		entry.hash = hash;
+		FoldName(wordName, entry.foldedName);
+		pTable->wordCount++;
+	}
+	else {
+		entry.previousVersions.push_back(entry.pWord);
+	}
+	entry.pWord = wordToAdd;
+	Publish(pTable);
+}
+
+ForthWord* ForthDict::FindWord(std::string_view wordName) const {
+	ReadSection readSection;
+	return FindWord(wordName, HashName(wordName));
+}
+
+// Called in a read section
+ForthWord* ForthDict::FindWord(std::string_view wordName, uint32_t hash) const {
+	const DictTable* pTable = this->pTable.load();
+	const DictEntry& entry = pTable->entries[FindSlot(pTable, wordName, hash)];
+	if (entry.pWord != nullptr && entry.pWord->Visible()) {
+		return entry.pWord;
+	}
+	if (this->pSharedDict != nullptr) {
+		return this->pSharedDict->FindWord(wordName, hash);
+	}
+	return nullptr;
+}
+
+// Also finds words that are no longer reachable by name, while other words still use them
+ForthWord* ForthDict::FindWordFromCFAPter(WordBodyElement** pPterToCFA) const {
+	return ForthWord::FindWordFromBody(pPterToCFA);
+}
+
+bool ForthDict::ForgetWord(std::string_view wordName) {
+	std::lock_guard<std::mutex> lock(this->writeMutex);
+	uint32_t hash = HashName(wordName);
+	DictTable* pCurrentTable = this->pTable.load(std::memory_order_relaxed);
+	if (pCurrentTable->entries[FindSlot(pCurrentTable, wordName, hash)].pWord == nullptr) {
+		return false;
+	}
+	DictTable* pTable = BeginWrite();
+	size_t slot = FindSlot(pTable, wordName, hash);
+	DictEntry& entry = pTable->entries[slot];
+	ForthWord* pWord = entry.pWord;
+	if (entry.previousVersions.size() > 0) {
+		entry.pWord = entry.previousVersions.back();
+		entry.previousVersions.pop_back();
+	}
+	else {
+		EraseSlot(pTable, slot);
+	}
+	Publish(pTable);
+	// Other threads may still be running a shared word, and it is immortal anyway
+	if (!pWord->IsShared()) {
+		pWord->SetWordVisibility(false);
+		// Words compiled to use this definition keep it alive; otherwise it is deleted at the next safe point
+		pWord->DecReference();
+	}
 	return true;
 }
 
+// Removes an entry by shifting back the entries after it in the same probe run, so no tombstones are needed
+void ForthDict::EraseSlot(DictTable* pTable, size_t slot) {
+	std::vector<DictEntry>& entries = pTable->entries;
+	size_t mask = entries.size() - 1;
+	size_t next = (slot + 1) & mask;
+	while (entries[next].pWord != nullptr) {
+		size_t home = entries[next].hash & mask;
+		// Move the entry back if its home slot is not in the (cyclic) range slot+1 .. next
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			entries[slot] = std::move(entries[next]);
+			slot = next;
+		}
+		next = (next + 1) & mask;
+	}
+	entries[slot].pWord = nullptr;
+	entries[slot].foldedName.clear();
+	entries[slot].previousVersions.clear();
+	pTable->wordCount--;
+}
+
 int ForthDict::WordCount() const {
-	return (int)this->words.size();
+	ReadSection readSection;
+	return (int)this->pTable.load()->wordCount;
+}
+
+void ForthDict::GetWordChains(std::vector<std::vector<ForthWord*>>& chains) const {
+	ReadSection readSection;
+	for (const DictEntry& entry : this->pTable.load()->entries) {
+		if (entry.pWord != nullptr) {
+			std::vector<ForthWord*> chain = entry.previousVersions;
+			chain.push_back(entry.pWord);
+			chains.push_back(std::move(chain));
+		}
+	}
+}
+
+void ForthDict::RemoveAllWords() {
+	std::lock_guard<std::mutex> lock(this->writeMutex);
+	for (DictEntry& entry : this->pTable.load(std::memory_order_relaxed)->entries) {
+		if (entry.pWord != nullptr) {
+			entry.pWord->DecReference();
+			for (ForthWord* pWord : entry.previousVersions) {
+				pWord->DecReference();
+			}
+		}
+	}
+	Publish(new DictTable(64));
+}
+
+void ForthDict::Share() {
+	std::vector<RefCountedObject*> roots;
+	roots.push_back(this);
+	TypeSystem::GetTypeSystem()->AddUserTypeDefinitions(this, roots);
+	RefCountedObject::ShareObjects(roots);
 }
 
 std::string ForthDict::GetObjectType() {
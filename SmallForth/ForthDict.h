@@ -1,28 +1,92 @@
 #pragma once
 #include "RefCountedObject.h"
 #include <string>
-#include <map>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
 
 class ForthWord;
 class WordBodyElement;
 
+// Words are held in an open-addressing hash table (linear probing) keyed on the case-folded name.  Each entry keeps
+//  the hash and folded name, so a lookup hashes the name once, folding case as it goes, and compares without
+//  allocating.
+// Each name has a chain of versions: redefining a word hides the previous definition, and forgetting it reveals the
+//  previous one again.  A forgotten definition is released, and deleted once no other word uses it.
+// For ExecStates running on several threads, an initialised dictionary is shared, after which it is read-only, and
+//  each ExecState gets a dictionary of its own layered over it.  Words not found in the layered dictionary are looked
+//  up in the shared one, and new definitions (including redefinitions of shared words) go in the layered dictionary.
+// Lookups take no lock.  The table is replaced rather than changed once the dictionary is shared: a writer copies it,
+//  changes the copy and publishes it with one atomic store, so a word added to a shared dictionary (see deploy) is seen
+//  by every thread's next lookup, and never half added.  Replaced tables are deleted once no thread can still be
+//  reading them (epoch-based reclamation, see ForthDict.cpp).  Writers take a mutex, so are one at a time.
 class ForthDict : public RefCountedObject
 {
 public:
 	ForthDict();
+	ForthDict(ForthDict* pSharedDict);
 	~ForthDict();
 
 	void AddWord(ForthWord* wordToAdd);
-	ForthWord* FindWord(const std::string& word) const;
+	ForthWord* FindWord(std::string_view wordName) const;
+	// Makes this dictionary, its words, the objects they refer to and the user object types defined with it shared
+	//  (see RefCountedObject::IsShared).  Must be called before any other thread uses the dictionary, and nothing
+	//  shared should be changed afterwards
+	void Share();
+	bool IsEmpty() const { return WordCount() == 0; }
+	ForthDict* GetSharedDict() const { return this->pSharedDict; }
 
-	ForthWord* FindWordFromCFAPter(WordBodyElement** pPterToCFA);
-	bool ForgetWord(std::string wordName);
+	ForthWord* FindWordFromCFAPter(WordBodyElement** pPterToCFA) const;
+	bool ForgetWord(std::string_view wordName);
 	int WordCount() const;
+	// Every version of every word, one chain per name, oldest version first
+	void GetWordChains(std::vector<std::vector<ForthWord*>>& chains) const;
+	void RemoveAllWords();
+
+	static uint32_t HashName(std::string_view wordName);
+	static bool FoldedNameMatches(const std::string& foldedName, std::string_view wordName);
+	static void FoldName(std::string_view wordName, std::string& foldedName);
+	// False if no word in any dictionary starts with the same first two characters, so wordName cannot be a word
+	static bool CouldBeWord(std::string_view wordName);
 
 	virtual std::string GetObjectType();
 	virtual bool ToString(ExecState* pExecState) const;
 	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
 
 private:
-	std::map<std::string, ForthWord*> words;
+	struct DictEntry {
+		uint32_t hash;
+		// Newest version, the one found by name
+		ForthWord* pWord;
+		std::string foldedName;
+		// Hidden versions, oldest first
+		std::vector<ForthWord*> previousVersions;
+	};
+	struct DictTable {
+		DictTable(size_t capacity) : entries(capacity), wordCount(0) { }
+		// Capacity is always a power of two, and kept at most three quarters full so probe sequences stay short
+		std::vector<DictEntry> entries;
+		size_t wordCount;
+	};
+
+	ForthWord* FindWord(std::string_view wordName, uint32_t hash) const;
+	static bool NameMatches(const DictEntry& entry, uint32_t hash, std::string_view wordName);
+	static size_t FindSlot(const DictTable* pTable, std::string_view wordName, uint32_t hash);
+	static void Grow(DictTable* pTable);
+	static void EraseSlot(DictTable* pTable, size_t slot);
+	static size_t GetPrefixKey(std::string_view wordName);
+	// Called with writeMutex held.  The table to change: the current one, or a copy of it if other threads may be
+	//  reading it
+	DictTable* BeginWrite();
+	void Publish(DictTable* pNewTable);
+	void DeleteReplacedTables(bool all);
+
+private:
+	std::atomic<DictTable*> pTable;
+	std::mutex writeMutex;
+	// Tables replaced whilst the dictionary was shared, with the epoch each was replaced in
+	std::vector<std::pair<uint64_t, DictTable*>> replacedTables;
+	ForthDict* pSharedDict;
 };
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstring>
 #include "ForthFile.h"
 #include "ExecState.h"
 #include "DataStack.h"
@@ -8,6 +9,7 @@
 ForthFile::ForthFile(ForthType objectType, const std::string& filename) :
 	RefCountedObject(nullptr) {
 	this->pFile = nullptr;
+	this->pStream = nullptr;
 	this->filename = filename;
 	this->objectType = objectType;
 	this->systemFile = forth_undefinedSystemFile;
@@ -18,17 +20,24 @@ ForthFile::ForthFile(ForthType objectType, const std::string& filename) :
 ForthFile::ForthFile(ForthType objectType, SystemFiles systemFile) :
 	RefCountedObject(nullptr) {
 	this->pFile = nullptr;
+	this->pStream = nullptr;
 	this->objectType = objectType;
 	this->systemFile = systemFile;
+	// The standard streams are shared with the C++ streams, by sharing their buffers
 	switch (systemFile) {
-	case forth_stdout: this->filename = "stdout"; break;
-	case forth_stderr: this->filename = "stderr"; break;
+	case forth_stdout: this->filename = "stdout"; this->pStream = new std::iostream(std::cout.rdbuf()); break;
+	case forth_stderr: this->filename = "stderr"; this->pStream = new std::iostream(std::cerr.rdbuf()); break;
+	case forth_stdin: this->filename = "stdin"; this->pStream = new std::iostream(std::cin.rdbuf()); break;
 	default: this->filename = "unknown system file"; break;
 	}
 	InitialiseReadWriteFlags();
 }
 
 ForthFile::~ForthFile() {
+	if (this->pStream != this->pFile) {
+		delete this->pStream;
+	}
+	this->pStream = nullptr;
 	delete this->pFile;
 	this->pFile = nullptr;
 }
@@ -83,8 +92,7 @@ bool ForthFile::ConstructReadFile(ExecState* pExecState) {
 	}
 	else if (pElementConstructWith->GetType() == ObjectType_String) {
 		ForthString* pFilename = (ForthString* )pElementConstructWith->GetObject();
-		std::string filename = pFilename->GetContainedString();
-		success = ConstructWithPath(ObjectType_ReadFile, pExecState, filename);
+		success = ConstructWithPath(ObjectType_ReadFile, pExecState, pFilename->GetStringView());
 	}
 	else {
 		success = pExecState->CreateException("Cannot construct read file, requires ( $\n -- file )");
@@ -107,8 +115,7 @@ bool ForthFile::ConstructWriteFile(ExecState* pExecState) {
 	}
 	else if (pElementConstructWith->GetType() == ObjectType_String) {
 		ForthString* pFilename = (ForthString*)pElementConstructWith->GetObject();
-		std::string filename = pFilename->GetContainedString();
-		success = ConstructWithPath(ObjectType_WriteFile, pExecState, filename);
+		success = ConstructWithPath(ObjectType_WriteFile, pExecState, pFilename->GetStringView());
 	}
 	else {
 		success = pExecState->CreateException("Cannot construct write file, requires ( $\n -- file )");
@@ -127,8 +134,7 @@ bool ForthFile::ConstructReadWriteFile(ExecState* pExecState) {
 	bool success;
 	if (pElementConstructWith->GetType() == ObjectType_String) {
 		ForthString* pFilename = (ForthString*)pElementConstructWith->GetObject();
-		std::string filename = pFilename->GetContainedString();
-		success = ConstructWithPath(ObjectType_ReadWriteFile, pExecState, filename);
+		success = ConstructWithPath(ObjectType_ReadWriteFile, pExecState, pFilename->GetStringView());
 	}
 	else {
 		success = pExecState->CreateException("Cannot construct read/write file, requires ( $ -- file )");
@@ -146,17 +152,14 @@ bool ForthFile::ConstructStandardFile(ExecState* pExecState, SystemFiles stdFile
 	bool success = false;
 	if (stdFileToConstruct == forth_stdout) {
 		pForthFile = new ForthFile(ObjectType_WriteFile, stdFileToConstruct);
-		pForthFile->pFile = new std::fstream(stdout);
 		success = true;
 	}
 	else if (stdFileToConstruct == forth_stderr) {
 		pForthFile = new ForthFile(ObjectType_WriteFile, stdFileToConstruct);
-		pForthFile->pFile = new std::fstream(stderr);
 		success = true;
 	}
 	else if (stdFileToConstruct == forth_stdin) {
 		pForthFile = new ForthFile(ObjectType_ReadFile, stdFileToConstruct);
-		pForthFile->pFile = new std::fstream(stdin);
 		success = true;
 	}
 	else {
@@ -175,7 +178,7 @@ bool ForthFile::ConstructStandardFile(ExecState* pExecState, SystemFiles stdFile
 }
 
 
-bool ForthFile::ConstructWithPath(ForthType objectType, ExecState* pExecState, const std::string& filepath) {
+bool ForthFile::ConstructWithPath(ForthType objectType, ExecState* pExecState, std::string_view filepath) {
 	std::ios::openmode mode;
 
 	switch (objectType) {
@@ -183,16 +186,17 @@ bool ForthFile::ConstructWithPath(ForthType objectType, ExecState* pExecState, c
 		break;
 	case ObjectType_WriteFile: mode = std::ios::out | std::ios::app;
 		break;
-	case ObjectType_ReadWriteFile: mode = std::ios::in | std::ios::out || std::ios::app;
+	case ObjectType_ReadWriteFile: mode = std::ios::in | std::ios::out | std::ios::app;
 		break;
 	default:
 		return pExecState->CreateException("Could not open a file as read/write access is unknown");
 	}
 
-	ForthFile* pForthFile = new ForthFile(objectType, filepath);
+	ForthFile* pForthFile = new ForthFile(objectType, std::string(filepath));
 	pForthFile->pFile = new std::fstream();
+	pForthFile->pStream = pForthFile->pFile;
 
-	pForthFile->pFile->open(filepath, mode);
+	pForthFile->pFile->open(pForthFile->filename, mode);
 	bool success = true;
 	if (pForthFile->pFile->bad()) {
 		success = pExecState->CreateExceptionUsingErrorNo("Could not open file, bad state: ");
@@ -214,7 +218,7 @@ bool ForthFile::ConstructWithPath(ForthType objectType, ExecState* pExecState, c
 }
 
 bool ForthFile::Append(ExecState* pExecState) {
-	if (pFile->is_open() == false) {
+	if (!IsOpen()) {
 		return pExecState->CreateException("Cannot append to a file that is not open");
 	}
 	else if (!this->writeFile) {
@@ -224,21 +228,18 @@ bool ForthFile::Append(ExecState* pExecState) {
 		return false;
 	}
 
-	std::string str;
-	bool success;
-	tie(success, str) = pExecState->pStack->PullAsString();
-	if (success) {
-		(*this->pFile) << str;
-		return true;
-	}
-	else {
-		return pExecState->CreateException(str.c_str());
+	if (pExecState->pStack->GetTOSType() != ObjectType_String) {
+		return pExecState->CreateException("No string on stack");
 	}
+	ForthString* pString = (ForthString*)pExecState->pStack->PullAsObject();
+	(*this->pStream) << pString->GetStringView();
+	pString->DecReference();
+	return true;
 }
 
 
 bool ForthFile::CloseFile(ExecState* pExecState) {
-	if (pFile->is_open() == false) {
+	if (!IsOpen()) {
 		return pExecState->CreateException("Cannot close a file that is not open");
 	}
 	else if (this->systemFile != forth_undefinedSystemFile) {
@@ -249,7 +250,7 @@ bool ForthFile::CloseFile(ExecState* pExecState) {
 }
 
 bool ForthFile::Read(ExecState* pExecState) {
-	if (pFile->is_open() == false) {
+	if (!IsOpen()) {
 		return pExecState->CreateException("Cannot read from a file that is not open");
 	}
 	else if (!this->readFile) {
@@ -257,7 +258,7 @@ bool ForthFile::Read(ExecState* pExecState) {
 	}
 
 	std::string next;
-	(*pFile) >> next;
+	(*pStream) >> next;
 	if (!pExecState->pStack->Push(next)) {
 		return pExecState->CreateStackOverflowException("whilst pushing the output from reading a file");
 	}
@@ -266,7 +267,7 @@ bool ForthFile::Read(ExecState* pExecState) {
 }
 
 bool ForthFile::ReadLine(ExecState* pExecState) {
-	if (pFile->is_open() == false) {
+	if (!IsOpen()) {
 		return pExecState->CreateException("Cannot read from a file that is not open");
 	}
 	else if (!this->readFile) {
@@ -279,10 +280,10 @@ bool ForthFile::ReadLine(ExecState* pExecState) {
 	char buff[buffLen];
 	bool loop = true;
 	while (loop) {
-		pFile->getline(buff, buffLen, '\n');
+		pStream->getline(buff, buffLen, '\n');
 		int receivedLen = (int)strlen(buff);
 
- 		if (pFile->rdstate() & std::ios_base::failbit) {
+ 		if (pStream->rdstate() & std::ios_base::failbit) {
 			if (buff[0] == '\0') {
 				// no data read
 				loop = false;
@@ -294,7 +295,7 @@ bool ForthFile::ReadLine(ExecState* pExecState) {
 				}
 				// Fail bit set - clear it and loop to get more charactesr
 				line.append(buff);
-				pFile->clear(pFile->rdstate() & ~std::ios_base::failbit);
+				pStream->clear(pStream->rdstate() & ~std::ios_base::failbit);
 			}
 		}
 		else if (receivedLen>0) {
@@ -319,13 +320,13 @@ bool ForthFile::ReadLine(ExecState* pExecState) {
 }
 
 bool ForthFile::ReadChar(ExecState* pExecState) {
-	if (pFile->is_open() == false) {
+	if (!IsOpen()) {
 		return pExecState->CreateException("Cannot read from a file that is not open");
 	}
 	else if (!this->readFile) {
 		return pExecState->CreateException("Cannot read from a file that is not open with read permissions");
 	}
-	int c = pFile->get();
+	int c = pStream->get();
 	char chToPush;
 	if (c == EOF) {
 		chToPush = '\0';
@@ -341,11 +342,11 @@ bool ForthFile::ReadChar(ExecState* pExecState) {
 }
 
 bool ForthFile::IsEOF(ExecState* pExecState) {
-	if (pFile->is_open() == false) {
+	if (!IsOpen()) {
 		return pExecState->CreateException("Cannot determine EOF state from a file that is not open");
 	}
 	bool success = true;
-	if (!pExecState->pStack->Push(pFile->eof())) {
+	if (!pExecState->pStack->Push(pStream->eof())) {
 		success = pExecState->CreateStackOverflowException("whilst reading eof state of a file");
 	}
 	return success;
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <fstream>
 
 #include "RefCountedObject.h"
@@ -12,7 +13,8 @@ public:
     ForthFile(ForthType objectType, SystemFiles systemFile);
     ~ForthFile();
 
-    std::fstream* GetContainedStream() { return this->pFile; }
+    std::iostream* GetContainedStream() { return this->pStream; }
+    SystemFiles GetSystemFile() const { return this->systemFile; }
     static bool ConstructReadFile(ExecState* pExecState);
     static bool ConstructWriteFile(ExecState* pExecState);
     static bool ConstructReadWriteFile(ExecState* pExecState);
@@ -21,6 +23,7 @@ public:
     virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
 private:
     void InitialiseReadWriteFlags();
+    bool IsOpen() const { return this->systemFile != forth_undefinedSystemFile || this->pFile->is_open(); }
     bool Append(ExecState* pExecState);
     bool Read(ExecState* pExecState);
     bool ReadLine(ExecState* pExecState);
@@ -29,14 +32,17 @@ private:
     bool CloseFile(ExecState* pExecState);
 
     static bool ConstructStandardFile(ExecState* pExecState, SystemFiles stdFileToConstruct);
-    static bool ConstructWithPath(ForthType objectType, ExecState* pExecState, const std::string& filepath);
+    static bool ConstructWithPath(ForthType objectType, ExecState* pExecState, std::string_view filepath);
 
 protected:
     std::string filename;
     SystemFiles systemFile;
 
 private:
+    // Null for the standard files
     std::fstream* pFile;
+    // What is read and written: the file, or a stream over a standard stream's buffer
+    std::iostream* pStream;
 
     bool readFile;
     bool writeFile;
@@ -0,0 +1,253 @@
+#include "ForthDefs.h"
+#include <chrono>
+#include "ForthFuture.h"
+#include "ForthDict.h"
+#include "ExecState.h"
+#include "DataStack.h"
+#include "TypeSystem.h"
+#include "PreBuiltWords.h"
+#include "Bootstrap.h"
+#include "ThreadPool.h"
+#include "GreenTask.h"
+
+ForthTask::ForthTask(ForthDict* pDict, WordBodyElement** pCFA) {
+	this->pDict = pDict;
+	this->pCFA = pCFA;
+	this->done = false;
+}
+
+// Runs on a pool thread.  The ExecState is created and deleted here, as its stacks belong to this thread
+void ForthTask::Run() {
+	ExecState* pExecState = Bootstrap::CreateExecState(this->pDict);
+	bool succeeded = true;
+	for (const StackElement& value : this->arguments) {
+		if (!PushTaskValue(pExecState, value)) {
+			succeeded = false;
+			break;
+		}
+	}
+	// Counted on the stack from here on
+	this->arguments.clear();
+	if (succeeded) {
+		succeeded = pExecState->pStack->Push(this->pCFA) && PreBuiltWords::BuiltIn_Execute(pExecState);
+	}
+
+	std::vector<StackElement> values;
+	std::string exceptionText;
+	if (!succeeded && pExecState->exceptionThrown) {
+		exceptionText = pExecState->pzException != nullptr ? pExecState->pzException : "unknown";
+	}
+	else {
+		values.resize(pExecState->pStack->Count());
+		for (size_t n = values.size(); n > 0; n--) {
+			StackElement* pElement = pExecState->pStack->Pull();
+			if (!ToTaskValue(pElement, values[n - 1])) {
+				exceptionText = "Only values, strings, arrays, channels and shared objects can be returned from a task";
+			}
+			delete pElement;
+			pElement = nullptr;
+		}
+		if (exceptionText.size() > 0) {
+			values.clear();
+		}
+	}
+	Bootstrap::DeleteExecState(pExecState);
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->results.swap(values);
+		this->exception = exceptionText;
+		this->done = true;
+	}
+	this->doneCondition.notify_all();
+}
+
+bool ForthTask::IsDone() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->done;
+}
+
+void ForthTask::Wait() {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->doneCondition.wait(lock, [this]() { return this->done; });
+}
+
+bool ForthTask::WaitFor(int milliseconds) {
+	std::unique_lock<std::mutex> lock(this->mutex);
+	return this->doneCondition.wait_for(lock, std::chrono::milliseconds(milliseconds), [this]() { return this->done; });
+}
+
+bool ForthTask::ToTaskValue(const StackElement* pElement, StackElement& value) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	ForthType type = pElement->GetType();
+	if (pTS->IsValue(type)) {
+		value = *pElement;
+		return true;
+	}
+	RefCountedObject* pObject = pElement->GetDirectObject();
+	if (pObject == nullptr) {
+		return false;
+	}
+	std::vector<RefCountedObject*> roots;
+	roots.push_back(pObject);
+	if (!RefCountedObject::EscapeObjects(roots)) {
+		return false;
+	}
+	value = *pElement;
+	return true;
+}
+
+bool ForthTask::PushTaskValue(ExecState* pExecState, const StackElement& value) {
+	if (!pExecState->pStack->Push(value)) {
+		return pExecState->CreateStackOverflowException("whilst pushing a task value");
+	}
+	return true;
+}
+
+ForthFuture::ForthFuture(std::shared_ptr<ForthTask> pTask) :
+	RefCountedObject(nullptr) {
+	this->objectType = ObjectType_Future;
+	this->pTask = pTask;
+}
+
+ForthFuture::~ForthFuture() {
+}
+
+std::string ForthFuture::GetObjectType() {
+	return "future";
+}
+
+bool ForthFuture::ToString(ExecState* pExecState) const {
+	std::string description = this->pTask->IsDone() ? "future (done)" : "future (running)";
+	if (!pExecState->pStack->Push(description)) {
+		return pExecState->CreateStackOverflowException();
+	}
+	return true;
+}
+
+bool ForthFuture::InvokeFunctionIndex(ExecState* pExecState, ObjectFunction /*functionToInvoke*/) {
+	return pExecState->CreateException("Cannot invoke that function on a future object");
+}
+
+// The dictionary a task sees: the caller's dictionary as it is now.  Sharing makes it read-only, so the caller
+//  carries on with a new dictionary layered over it.  Later spawns reuse the shared dictionary until the caller
+//  defines something more
+ForthDict* ForthFuture::ShareDictionaryView(ExecState* pExecState) {
+	ForthDict* pDict = pExecState->pDict;
+	if (pDict->IsShared()) {
+		return pDict;
+	}
+	if (pDict->IsEmpty() && pDict->GetSharedDict() != nullptr) {
+		return pDict->GetSharedDict();
+	}
+	pDict->Share();
+	ForthDict* pLayer = new ForthDict(pDict);
+	pLayer->IncReference();
+	pExecState->pDict = pLayer;
+	return pDict;
+}
+
+// ( a1 .. an n xt -- future ) Runs xt on the thread pool, with a1 .. an on its stack
+bool ForthFuture::BuiltIn_Spawn(ExecState* pExecState) {
+	if (!pExecState->pStack->TOSIsType(StackElement_PterToCFA)) {
+		return pExecState->CreateException("spawn expects an execution token on the top of the stack");
+	}
+	WordBodyElement** pCFA = pExecState->pStack->PullAsCFA();
+	if (!pExecState->pStack->TOSIsType(StackElement_Int)) {
+		return pExecState->CreateException("spawn expects the number of arguments under the execution token");
+	}
+	int64_t argumentCount = pExecState->pStack->PullAsInt();
+	if (argumentCount < 0 || argumentCount > pExecState->pStack->Count()) {
+		return pExecState->CreateStackUnderflowException("whilst getting arguments for spawn");
+	}
+
+	// Shared first, so objects held by the dictionary can be passed
+	ForthDict* pView = ShareDictionaryView(pExecState);
+	std::shared_ptr<ForthTask> pTask = std::make_shared<ForthTask>(pView, pCFA);
+	pTask->arguments.resize((size_t)argumentCount);
+	bool passable = true;
+	for (size_t n = pTask->arguments.size(); n > 0; n--) {
+		StackElement* pElement = pExecState->pStack->Pull();
+		if (!ForthTask::ToTaskValue(pElement, pTask->arguments[n - 1])) {
+			passable = false;
+		}
+		delete pElement;
+		pElement = nullptr;
+	}
+	if (!passable) {
+		return pExecState->CreateException("Only values, strings, arrays, channels and shared objects can be passed to a task");
+	}
+
+	ThreadPool::GetThreadPool()->Submit([pTask]() { pTask->Run(); });
+	if (!pExecState->pStack->Push(new ForthFuture(pTask))) {
+		return pExecState->CreateStackOverflowException("whilst pushing a future");
+	}
+	return true;
+}
+
+// ( future -- r1 .. rn ) Waits for the task, then pushes what it left on its stack.  Also awaits a green task
+bool ForthFuture::BuiltIn_Await(ExecState* pExecState) {
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		return pExecState->CreateStackUnderflowException("whilst getting future to await");
+	}
+	if (pElement->GetType() == ObjectType_Task) {
+		// The element keeps the task alive whilst waiting
+		bool awaited = GreenTask::Await(pExecState, (GreenTask*)pElement->GetObject());
+		delete pElement;
+		pElement = nullptr;
+		return awaited;
+	}
+	if (pElement->GetType() != ObjectType_Future) {
+		delete pElement;
+		pElement = nullptr;
+		return pExecState->CreateException("await requires a future or a task");
+	}
+	std::shared_ptr<ForthTask> pTask = ((ForthFuture*)pElement->GetObject())->pTask;
+	if (!pTask->IsDone()) {
+		// On a worker, the task waited for may be queued behind this one
+		ThreadPool* pPool = ThreadPool::GetThreadPool();
+		pPool->BeginBlocking();
+		pTask->Wait();
+		pPool->EndBlocking();
+	}
+	delete pElement;
+	pElement = nullptr;
+
+	if (pTask->exception.size() > 0) {
+		std::string message = "Task failed: " + pTask->exception;
+		return pExecState->CreateException(message.c_str());
+	}
+	for (const StackElement& value : pTask->results) {
+		if (!ForthTask::PushTaskValue(pExecState, value)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// ( future -- b ) True if the task (or green task) has finished, so await would not wait
+bool ForthFuture::BuiltIn_IsReady(ExecState* pExecState) {
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		return pExecState->CreateStackUnderflowException("whilst getting future");
+	}
+	if (pElement->GetType() != ObjectType_Future && pElement->GetType() != ObjectType_Task) {
+		delete pElement;
+		pElement = nullptr;
+		return pExecState->CreateException("isReady requires a future or a task");
+	}
+	bool ready;
+	if (pElement->GetType() == ObjectType_Task) {
+		ready = ((GreenTask*)pElement->GetObject())->IsDone();
+	}
+	else {
+		ready = ((ForthFuture*)pElement->GetObject())->pTask->IsDone();
+	}
+	delete pElement;
+	pElement = nullptr;
+	if (!pExecState->pStack->Push(ready)) {
+		return pExecState->CreateStackOverflowException("whilst pushing whether a future is ready");
+	}
+	return true;
+}
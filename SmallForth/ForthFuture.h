@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "RefCountedObject.h"
+#include "StackElement.h"
+class ForthDict;
+class WordBodyElement;
+
+// A word run on the thread pool with its own ExecState, over the dictionary of the ExecState that spawned it
+class ForthTask
+{
+public:
+	ForthTask(ForthDict* pDict, WordBodyElement** pCFA);
+
+	void Run();
+	bool IsDone();
+	void Wait();
+	bool WaitFor(int milliseconds);
+
+	// Values, shared objects, and strings, arrays and channels (which escape to the other thread, see
+	//  RefCountedObject::EscapeObjects) can be passed to and returned from a task.  Other objects can't
+	static bool ToTaskValue(const StackElement* pElement, StackElement& value);
+	static bool PushTaskValue(ExecState* pExecState, const StackElement& value);
+
+	std::vector<StackElement> arguments;
+	// Valid once done: the task's stack, bottom first, or the exception it ended with
+	std::vector<StackElement> results;
+	std::string exception;
+
+private:
+	ForthDict* pDict;
+	WordBodyElement** pCFA;
+	std::mutex mutex;
+	std::condition_variable doneCondition;
+	bool done;
+};
+
+// The result of spawn, that await waits on.  The task can outlive its future, if the future is dropped first
+class ForthFuture : public RefCountedObject
+{
+public:
+	ForthFuture(std::shared_ptr<ForthTask> pTask);
+	~ForthFuture();
+
+	virtual std::string GetObjectType();
+	virtual bool ToString(ExecState* pExecState) const;
+	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
+
+	static bool BuiltIn_Spawn(ExecState* pExecState);
+	static bool BuiltIn_Await(ExecState* pExecState);
+	static bool BuiltIn_IsReady(ExecState* pExecState);
+	// The dictionary for work run on the thread pool to use: the caller's dictionary as it is now, shared
+	static ForthDict* ShareDictionaryView(ExecState* pExecState);
+
+private:
+	std::shared_ptr<ForthTask> pTask;
+};
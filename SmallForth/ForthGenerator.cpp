@@ -0,0 +1,226 @@
+#include "ForthDefs.h"
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "ForthGenerator.h"
+#include "ExecState.h"
+#include "DataStack.h"
+#include "ForthWord.h"
+#include "GreenTask.h"
+#include "PreBuiltWords.h"
+#include "Bootstrap.h"
+
+ForthGenerator::ForthGenerator(ExecState* pExecState, WordBodyElement** pCFA) :
+	RefCountedObject(nullptr) {
+	this->objectType = ObjectType_Generator;
+	this->pExecState = pExecState;
+	this->pExecState->pGenerator = this;
+	this->pCFA = pCFA;
+	this->pWord = ForthWord::FindWordFromBody(pCFA);
+	if (this->pWord != nullptr) {
+		this->pWord->IncReference();
+	}
+	this->pConsumer = nullptr;
+	this->running = false;
+	this->yielded = false;
+	this->done = false;
+	this->pExecState->maxNestingDepth = MachineStack::c_maxNestingDepth;
+#ifdef _WIN32
+	this->pFiber = this->machineStack.CreateFiberContext(Entry, this);
+	this->pConsumerFiber = nullptr;
+#else
+	this->machineStack.MakeContext(&this->context, Entry, this);
+#endif
+}
+
+// Never deleted whilst running, as next holds a reference.  A generator left part way through is abandoned where it
+//  last yielded, and its machine stack goes with it
+ForthGenerator::~ForthGenerator() {
+	Release();
+}
+
+#ifdef _WIN32
+void __stdcall ForthGenerator::Entry(void* pParameter) {
+	ForthGenerator* pGenerator = (ForthGenerator*)pParameter;
+#else
+void ForthGenerator::Entry(unsigned int high, unsigned int low) {
+	ForthGenerator* pGenerator = (ForthGenerator*)MachineStack::JoinParameter(high, low);
+#endif
+	pGenerator->Run();
+	pGenerator->done = true;
+	// Never resumed again
+	pGenerator->SwitchToConsumer();
+}
+
+// Runs on the generator's own machine stack.  Nothing may be thrown out of it, as there is nothing to catch it
+void ForthGenerator::Run() {
+	bool succeeded = false;
+	try {
+		succeeded = this->pExecState->pStack->Push(this->pCFA) && PreBuiltWords::BuiltIn_Execute(this->pExecState);
+	}
+	catch (...) {
+		this->pExecState->CreateException("Execution caused exception");
+	}
+
+	if (!succeeded && this->pExecState->exceptionThrown) {
+		this->exception = this->pExecState->pzException != nullptr ? this->pExecState->pzException : "unknown";
+	}
+	// Anything left on the generator's stack is dropped with it
+	Release();
+}
+
+bool ForthGenerator::Resume(ExecState* pConsumer) {
+	this->pConsumer = pConsumer;
+	this->running = true;
+	this->yielded = false;
+	// Green tasks the generator makes have a scheduler of its own, otherwise it pauses as part of whichever task resumes
+	//  it
+	if (this->pExecState != nullptr &&
+		(this->pExecState->pScheduler == nullptr || !this->pExecState->pScheduler->IsRoot(this->pExecState))) {
+		this->pExecState->pScheduler = pConsumer->pScheduler;
+	}
+#ifdef _WIN32
+	// Only a fiber can switch to another fiber.  The thread is left a fiber, as converting back whilst a green task
+	//  scheduler still needs it would break that
+	if (!IsThreadAFiber()) {
+		ConvertThreadToFiber(nullptr);
+	}
+	this->pConsumerFiber = GetCurrentFiber();
+	SwitchToFiber(this->pFiber);
+#else
+	swapcontext(&this->consumerContext, &this->context);
+#endif
+	this->running = false;
+	this->pConsumer = nullptr;
+	return this->yielded;
+}
+
+bool ForthGenerator::Yield() {
+	if (!this->pExecState->pStack->MoveTopTo(this->pConsumer->pStack)) {
+		return this->pExecState->CreateStackOverflowException("whilst yielding a value");
+	}
+	this->yielded = true;
+	SwitchToConsumer();
+	return true;
+}
+
+void ForthGenerator::SwitchToConsumer() {
+#ifdef _WIN32
+	SwitchToFiber(this->pConsumerFiber);
+#else
+	swapcontext(&this->context, &this->consumerContext);
+#endif
+}
+
+void ForthGenerator::Release() {
+	if (this->pExecState != nullptr) {
+		Bootstrap::DeleteExecState(this->pExecState);
+		this->pExecState = nullptr;
+	}
+	if (this->pWord != nullptr) {
+		this->pWord->DecReference();
+		this->pWord = nullptr;
+	}
+}
+
+std::string ForthGenerator::GetObjectType() {
+	return "generator";
+}
+
+bool ForthGenerator::ToString(ExecState* pExecState) const {
+	std::string description;
+	if (this->done) {
+		description = "generator (done)";
+	}
+	else if (this->running) {
+		description = "generator (running)";
+	}
+	else {
+		description = "generator (suspended)";
+	}
+	if (!pExecState->pStack->Push(description)) {
+		return pExecState->CreateStackOverflowException();
+	}
+	return true;
+}
+
+bool ForthGenerator::InvokeFunctionIndex(ExecState* pExecState, ObjectFunction /*functionToInvoke*/) {
+	return pExecState->CreateException("Cannot invoke that function on a generator object");
+}
+
+// ( a1 .. an n xt -- generator ) Makes a generator that runs xt with a1 .. an on its stack, from the first next
+bool ForthGenerator::BuiltIn_Generator(ExecState* pExecState) {
+	if (!pExecState->pStack->TOSIsType(StackElement_PterToCFA)) {
+		return pExecState->CreateException("generator expects an execution token on the top of the stack");
+	}
+	WordBodyElement** pCFA = pExecState->pStack->PullAsCFA();
+	if (!pExecState->pStack->TOSIsType(StackElement_Int)) {
+		return pExecState->CreateException("generator expects the number of arguments under the execution token");
+	}
+	int64_t argumentCount = pExecState->pStack->PullAsInt();
+	if (argumentCount < 0 || argumentCount > pExecState->pStack->Count()) {
+		return pExecState->CreateStackUnderflowException("whilst getting arguments for generator");
+	}
+
+	ExecState* pGeneratorExecState = Bootstrap::CreateExecStateUsingDict(pExecState->pDict);
+	// The generator is on the same thread, so anything can be passed, and is moved rather than copied
+	std::vector<StackElement*> arguments((size_t)argumentCount);
+	for (size_t n = arguments.size(); n > 0; n--) {
+		arguments[n - 1] = pExecState->pStack->Pull();
+	}
+	for (StackElement* pElement : arguments) {
+		pGeneratorExecState->pStack->Push(pElement);
+	}
+
+	ForthGenerator* pGenerator = new ForthGenerator(pGeneratorExecState, pCFA);
+	if (!pExecState->pStack->Push(pGenerator)) {
+		return pExecState->CreateStackOverflowException("whilst pushing a generator");
+	}
+	return true;
+}
+
+// ( x -- ) Passes x to the next that resumed this generator, and suspends until the next next
+bool ForthGenerator::BuiltIn_Yield(ExecState* pExecState) {
+	if (pExecState->pGenerator == nullptr) {
+		return pExecState->CreateException("yield can only be used by a generator");
+	}
+	if (pExecState->pStack->Count() == 0) {
+		return pExecState->CreateStackUnderflowException("whilst getting value to yield");
+	}
+	return pExecState->pGenerator->Yield();
+}
+
+// ( generator -- x true | false ) Resumes the generator until it yields x, or returns false once it has finished
+bool ForthGenerator::BuiltIn_Next(ExecState* pExecState) {
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		return pExecState->CreateStackUnderflowException("whilst getting generator to resume");
+	}
+	if (pElement->GetType() != ObjectType_Generator) {
+		delete pElement;
+		pElement = nullptr;
+		return pExecState->CreateException("next requires a generator");
+	}
+	// The element's reference keeps the generator alive whilst it runs
+	ForthGenerator* pGenerator = (ForthGenerator*)pElement->GetObject();
+	if (pGenerator->running) {
+		delete pElement;
+		pElement = nullptr;
+		return pExecState->CreateException("A generator cannot resume itself");
+	}
+
+	bool yielded = !pGenerator->done && pGenerator->Resume(pExecState);
+	std::string exception;
+	exception.swap(pGenerator->exception);
+	delete pElement;
+	pElement = nullptr;
+	if (exception.size() > 0) {
+		std::string message = "Generator failed: " + exception;
+		return pExecState->CreateException(message.c_str());
+	}
+	if (!pExecState->pStack->Push(yielded)) {
+		return pExecState->CreateStackOverflowException("whilst resuming a generator");
+	}
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#ifndef _WIN32
+#include <ucontext.h>
+#endif
+#include "RefCountedObject.h"
+#include "MachineStack.h"
+class ExecState;
+class ForthWord;
+class WordBodyElement;
+
+// A coroutine made by generator, that runs an execution token on an ExecState of its own, a step at a time.  next
+//  resumes it until it yields a value, which is moved straight onto the stack of the ExecState calling next, or until
+//  it finishes.  So a sequence, or the lines of a file, can be consumed as it is produced, without building an array
+//  of it first.
+// As with green tasks (see GreenScheduler), the inner interpreter nests on the C++ stack, so a generator has a
+//  MachineStack of its own as well as its own ExecState, and next and yield swap both (swapcontext, or a fiber switch
+//  on Windows).  A generator runs on the thread that made it, so cannot be passed to another thread.
+class ForthGenerator : public RefCountedObject
+{
+public:
+	ForthGenerator(ExecState* pExecState, WordBodyElement** pCFA);
+	~ForthGenerator();
+
+	virtual std::string GetObjectType();
+	virtual bool ToString(ExecState* pExecState) const;
+	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
+
+	bool IsDone() const { return this->done; }
+
+	static bool BuiltIn_Generator(ExecState* pExecState);
+	static bool BuiltIn_Yield(ExecState* pExecState);
+	static bool BuiltIn_Next(ExecState* pExecState);
+
+private:
+	// Runs the generator until it yields or finishes.  Returns true if it yielded
+	bool Resume(ExecState* pConsumer);
+	bool Yield();
+	void SwitchToConsumer();
+	void Run();
+	// Deletes the generator's ExecState and releases its word, once finished with
+	void Release();
+#ifdef _WIN32
+	static void __stdcall Entry(void* pParameter);
+#else
+	static void Entry(unsigned int high, unsigned int low);
+#endif
+
+private:
+	ExecState* pExecState;
+	WordBodyElement** pCFA;
+	// The word run, kept alive whilst the generator runs it
+	ForthWord* pWord;
+	// Whilst running, the ExecState that called next, which yielded values are moved to
+	ExecState* pConsumer;
+	bool running;
+	bool yielded;
+	bool done;
+	// Set if the generator ended with an exception, until next reports it
+	std::string exception;
+	MachineStack machineStack;
+#ifdef _WIN32
+	void* pFiber;
+	void* pConsumerFiber;
+#else
+	ucontext_t context;
+	ucontext_t consumerContext;
+#endif
+};
@@ -4,16 +4,111 @@
 #include "DataStack.h"
 #include "ExecState.h"
 #include "StackElement.h"
+#include "ObjectPool.h"
 
-ForthString::ForthString(const std::string& pzString) :
+ForthString::ForthString(std::string_view stringView) :
 	RefCountedObject(nullptr) {
-	containedString = pzString;
+	this->length = 0;
+	SetContents(stringView);
+	objectType = ObjectType_String;
+	IncReference();
+}
+
+// Constructs a substring.  Short substrings are copied inline, longer ones share the buffer of the string they are taken from
+ForthString::ForthString(const ForthString* pViewOf, size_t start, size_t length) :
+	RefCountedObject(nullptr) {
+	this->length = 0;
+	if (pViewOf->IsShared() && length > inlineCapacity) {
+		this->shared.pBuffer = pViewOf->shared.pBuffer;
+		this->shared.pBuffer->count.fetch_add(1, std::memory_order_relaxed);
+		this->shared.start = pViewOf->shared.start + start;
+		this->length = length;
+	}
+	else {
+		SetContents(pViewOf->GetStringView().substr(start, length));
+	}
 	objectType = ObjectType_String;
 	IncReference();
 }
 
 ForthString::~ForthString() {
+	ReleaseBuffer();
+}
+
+void ForthString::ReleaseBuffer() {
+	if (IsShared() && this->shared.pBuffer->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		delete this->shared.pBuffer;
+	}
+}
+
+static ObjectPool* GetForthStringPool() {
+	static thread_local ObjectPool* pPool = ObjectPool::ForThread("string", sizeof(ForthString));
+	return pPool;
+}
+
+void* ForthString::operator new(size_t size) {
+	return GetForthStringPool()->Allocate(size);
+}
+
+void ForthString::operator delete(void* pBlock, size_t size) {
+	GetForthStringPool()->Release(pBlock, size);
+}
+
+std::string_view ForthString::GetStringView() const {
+	if (IsShared()) {
+		return std::string_view(this->shared.pBuffer->text.data() + this->shared.start, this->length);
+	}
+	return std::string_view(this->inlineChars, this->length);
+}
 
+void ForthString::SetContents(std::string_view contents) {
+	// Contents may be a view of this string's own buffer
+	SharedBuffer* pOldBuffer = IsShared() ? this->shared.pBuffer : nullptr;
+	if (contents.size() <= inlineCapacity) {
+		contents.copy(this->inlineChars, contents.size());
+	}
+	else {
+		this->shared.pBuffer = new SharedBuffer(contents);
+		this->shared.start = 0;
+	}
+	if (pOldBuffer != nullptr && pOldBuffer->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		delete pOldBuffer;
+	}
+	this->length = contents.size();
+}
+
+// Returns a buffer holding exactly this string's characters, that no other string shares, so it can be altered.  Only
+//  for a string that is, or is about to be, too long to hold inline
+std::string& ForthString::GetUniqueBuffer() {
+	if (!IsShared() || this->shared.pBuffer->count.load(std::memory_order_acquire) > 1 || this->shared.start != 0 ||
+		this->length != this->shared.pBuffer->text.size()) {
+		SharedBuffer* pUnique = new SharedBuffer(GetStringView());
+		ReleaseBuffer();
+		this->shared.pBuffer = pUnique;
+		this->shared.start = 0;
+	}
+	return this->shared.pBuffer->text;
+}
+
+void ForthString::AppendChars(std::string_view toAppend) {
+	if (!IsShared() && this->length + toAppend.size() <= inlineCapacity) {
+		toAppend.copy(this->inlineChars + this->length, toAppend.size());
+		this->length += toAppend.size();
+	}
+	else {
+		std::string& buffer = GetUniqueBuffer();
+		buffer.append(toAppend);
+		this->length = buffer.size();
+	}
+}
+
+void ForthString::SetChar(size_t index, char c) {
+	if (!IsShared()) {
+		this->inlineChars[index] = c;
+	}
+	else {
+		GetUniqueBuffer()[index] = c;
+	}
 }
 
 std::string ForthString::GetObjectType() {
@@ -51,7 +146,7 @@ bool ForthString::InvokeFunctionIndex(ExecState* pExecState, ObjectFunction func
 }
 
 bool ForthString::GetSize(ExecState* pExecState) {
-	 int64_t size = containedString.size();
+	 int64_t size = this->length;
 	 if (!pExecState->pStack->Push(size)) {
 		 return pExecState->CreateStackOverflowException();
 	 }
@@ -75,11 +170,11 @@ bool ForthString::ElementAtIndex(ExecState* pExecState) {
 	if (index < 0) {
 		success = pExecState->CreateException("Cannot access a negative element index");
 	}
-	else if (index >= this->containedString.size()) {
+	else if ((size_t)index >= this->length) {
 		success = pExecState->CreateException("Cannot access an element beyond the object bounds");
 	}
 	else {
-		char c = containedString[index];
+		char c = GetStringView()[index];
 		if (!pExecState->pStack->Push(c)) {
 			success = pExecState->CreateStackOverflowException();
 		}
@@ -116,21 +211,22 @@ bool ForthString::SetElementAtIndex(ExecState* pExecState) {
 
 		success = pExecState->CreateException("Cannot access a negative element index");
 	}
-	else if (index!=-1 && index > this->containedString.size()) {
+	else if (index!=-1 && (size_t)index > this->length) {
 		success = pExecState->CreateException("Cannot access an element beyond the object bounds");
 	}
 	else {
 		char c = pElementElement->GetChar();
 
 		if (index == -1) {
-			this->containedString = c + this->containedString;
+			std::string prepended = c + GetContainedString();
+			SetContents(prepended);
 		}
-		else if (index == this->containedString.size()) {
+		else if ((size_t)index == this->length) {
 			// Append
-			this->containedString += c;
+			AppendChars(std::string_view(&c, 1));
 		}
 		else {
-			this->containedString[index] = c;
+			SetChar(index, c);
 		}
 	}
 	delete pElementIndex;
@@ -156,7 +252,7 @@ bool ForthString::Contains(ExecState* pExecState) {
 	delete pElement;
 	pElement = nullptr;
 
-	bool containsChar = this->containedString.find(c, 0) != std::string::npos;
+	bool containsChar = GetStringView().find(c, 0) != std::string_view::npos;
 	if (!pExecState->pStack->Push(containsChar)) {
 		return pExecState->CreateStackOverflowException();
 	}
@@ -192,8 +288,8 @@ bool ForthString::IndexOf(ExecState* pExecState) {
 	delete pElement;
 	pElement = nullptr;
 
-	size_t index = this->containedString.find(c, afterIndex);
-	if (index == std::string::npos) {
+	size_t index = GetStringView().find(c, afterIndex);
+	if (index == std::string_view::npos) {
 		index = -1;
 	}
 	if (!pExecState->pStack->Push((int64_t)index)) {
@@ -231,20 +327,20 @@ bool ForthString::SubString(ExecState* pExecState) {
 	if (rangeSt >= rangeEnd) {
 		return pExecState->CreateException("Substring start must be before end");
 	}
-	else if (rangeSt < 0 || rangeSt>=this->containedString.length()) {
+	else if (rangeSt < 0 || (size_t)rangeSt>=this->length) {
 		return pExecState->CreateException("Substring start must be within the strings bounds");
 	}
-	else if (rangeEnd > this->containedString.length()) {
+	else if ((size_t)rangeEnd > this->length) {
 		return pExecState->CreateException("Substring end must not be more than one past the string end");
 	}
 
-	std::string substring = this->containedString.substr(rangeSt, rangeEnd - rangeSt);
-
-	ForthString* pNewString = new ForthString(substring);
+	ForthString* pNewString = new ForthString(this, rangeSt, rangeEnd - rangeSt);
+	bool success = true;
 	if (!pExecState->pStack->Push(pNewString)) {
-		return pExecState->CreateStackOverflowException();
+		success = pExecState->CreateStackOverflowException();
 	}
-	return true;
+	pNewString->DecReference();
+	return success;
 }
 
 // ( element object -- )
@@ -260,11 +356,12 @@ bool ForthString::Append(ExecState* pExecState) {
 	switch (appendType) {
 	case ObjectType_String:
 		pAppendString = (ForthString*)pExecState->pStack->PullAsObject();
-		this->containedString += pAppendString->containedString;
+		AppendChars(pAppendString->GetStringView());
+		pAppendString->DecReference();
 		break;
 	case StackElement_Char:
 		toAppend = pExecState->pStack->PullAsChar();
-		this->containedString += toAppend;
+		AppendChars(std::string_view(&toAppend, 1));
 		break;
 	case ObjectType_ReadWriteFile:
 	case ObjectType_WriteFile:
@@ -1,21 +1,30 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <atomic>
 #include "RefCountedObject.h"
 class StackElement;
 
 class ForthString : public RefCountedObject
 {
 public:
-	ForthString(const std::string& pzString);
+	ForthString(std::string_view stringView);
 	~ForthString();
+
+	static void* operator new(size_t size);
+	static void operator delete(void* pBlock, size_t size);
 	virtual std::string GetObjectType();
 	virtual bool ToString(ExecState* pExecState) const;
 
 	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
+	// Substrings of a string on another thread share its buffer, whose count is atomic
+	virtual bool CanEscape() const { return true; }
 
 	static bool Construct(ExecState* pExecState);
 
-	std::string GetContainedString() const { return containedString; }
+	std::string GetContainedString() const { return std::string(GetStringView()); }
+	std::string_view GetStringView() const;
+	size_t GetLength() const { return length; }
 
 private:
 	bool GetSize(ExecState* pExecState);
@@ -27,8 +36,34 @@ private:
 	bool Append(ExecState* pExecState);
 	bool AppendToFile(ExecState* pExecState, StackElement* pElementFile);
 
+	ForthString(const ForthString* pViewOf, size_t start, size_t length);
+	void SetContents(std::string_view contents);
+	std::string& GetUniqueBuffer();
+	void AppendChars(std::string_view toAppend);
+	void SetChar(size_t index, char c);
+	bool IsShared() const { return this->length > inlineCapacity; }
+	void ReleaseBuffer();
 
 private:
-	std::string containedString;
+	struct SharedBuffer {
+		SharedBuffer(std::string_view text) : count(1), text(text) { }
+		// Atomic, as substrings of an escaped string may be on other threads
+		std::atomic<int32_t> count;
+		std::string text;
+	};
+
+	// Strings up to inlineCapacity characters are held in inlineChars.  Longer strings are held in a buffer that
+	//  is shared with any substrings taken from them; a string is a view of buffer[start, start+length).  Before a
+	//  shared buffer is altered the string takes its own copy.  Which is used depends only on the length, so the two
+	//  overlap, and a string is 24 bytes more than RefCountedObject: like std::string, but with substrings sharing.
+	static const size_t inlineCapacity = 16;
+	union {
+		char inlineChars[inlineCapacity];
+		struct {
+			SharedBuffer* pBuffer;
+			size_t start;
+		} shared;
+	};
+	size_t length;
 };
 
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <list>
+#include <mutex>
 #include "ForthDefs.h"
 #include "ForthWord.h"
 #include "DataStack.h"
@@ -34,11 +35,76 @@ ForthWord::ForthWord(const std::string& name, XT firstXT) :
 	WordBodyElement* wbe = new WordBodyElement();
 	wbe->wordElement_XT = firstXT;
 	this->body[0] = wbe;
+	std::lock_guard<std::mutex> lock(GetWordsByBodyMutex());
+	GetWordsByBody()[this->body] = this;
+}
+
+ForthWord::~ForthWord() {
+	if (this->body != nullptr) {
+		{
+			std::lock_guard<std::mutex> lock(GetWordsByBodyMutex());
+			GetWordsByBody().erase(this->body);
+		}
+		for (int n = 0; n < this->bodySize; n++) {
+			delete this->body[n];
+		}
+		delete[] this->body;
+		this->body = nullptr;
+	}
+	for (ForthWord* pWord : this->referencedWords) {
+		pWord->DecReference();
+	}
+	for (RefCountedObject* pObject : this->referencedObjects) {
+		pObject->DecReference();
+	}
+}
+
+std::unordered_map<WordBodyElement**, ForthWord*>& ForthWord::GetWordsByBody() {
+	static std::unordered_map<WordBodyElement**, ForthWord*> wordsByBody;
+	return wordsByBody;
+}
+
+// Words are created and deleted by every thread running an ExecState
+std::mutex& ForthWord::GetWordsByBodyMutex() {
+	static std::mutex wordsByBodyMutex;
+	return wordsByBodyMutex;
+}
+
+ForthWord* ForthWord::FindWordFromBody(WordBodyElement** pBody) {
+	std::lock_guard<std::mutex> lock(GetWordsByBodyMutex());
+	std::unordered_map<WordBodyElement**, ForthWord*>& wordsByBody = GetWordsByBody();
+	auto iter = wordsByBody.find(pBody);
+	if (iter == wordsByBody.end()) {
+		return nullptr;
+	}
+	return iter->second;
+}
+
+// Words can grow after being revealed, e.g. by allot, which reallocates the body
+void ForthWord::BodyMoved(WordBodyElement** pOldBody) {
+	std::lock_guard<std::mutex> lock(GetWordsByBodyMutex());
+	std::unordered_map<WordBodyElement**, ForthWord*>& wordsByBody = GetWordsByBody();
+	if (pOldBody != nullptr) {
+		wordsByBody.erase(pOldBody);
+	}
+	wordsByBody[this->body] = this;
+}
+
+void ForthWord::AddReferencedObjects(std::vector<RefCountedObject*>& objects) const {
+	objects.insert(objects.end(), this->referencedWords.begin(), this->referencedWords.end());
+	objects.insert(objects.end(), this->referencedObjects.begin(), this->referencedObjects.end());
+}
+
+void ForthWord::ReferenceWordWithBody(WordBodyElement** pBody) {
+	ForthWord* pWord = FindWordFromBody(pBody);
+	// A recursive call does not keep its own word alive
+	if (pWord != nullptr && pWord != this) {
+		pWord->IncReference();
+		this->referencedWords.push_back(pWord);
+	}
 }
 
 void ForthWord::CompileXTIntoWord(XT xt, int pos /*= -1 */) {
-	// TODO Ensure when deleting words, that the WordBodyElement objects are deleted
-	//      Note, currently words do not get deleted, as other words or stackelements may be referencing pointers inside them
 	WordBodyElement* pNewElement = new WordBodyElement();
 	pNewElement->wordElement_XT = xt;
 	if (pos == -1) {
@@ -49,17 +115,17 @@ void ForthWord::CompileXTIntoWord(XT xt, int pos /*= -1 */) {
 			GrowByAndAdd(1, pNewElement);
 		}
 		else {
-			// TODO Consider garbage collection here... 
+			delete this->body[pos];
 			this->body[pos] = pNewElement;
 		}
 	}
 }
 
 void ForthWord::CompileCFAPterIntoWord(WordBodyElement** pterToBody) {
-	// TODO Ensure when deleting words, that the WordBodyElement objects are deleted
 	WordBodyElement* pNewElement = new WordBodyElement();
 	pNewElement->wordElement_BodyPter = pterToBody;
 	GrowByAndAdd(1, pNewElement);
+	ReferenceWordWithBody(pterToBody);
 }
 
 void ForthWord::CompileLiteralIntoWord(bool literal) {
@@ -90,6 +156,18 @@ void ForthWord::CompileLiteralIntoWord(WordBodyElement* literal) {
 	GrowByAndAdd(1, literal);
 }
 
+// The literal holds a reference to its object, which is released when this word is deleted
+void ForthWord::CompileObjectLiteralIntoWord(WordBodyElement* literal) {
+	GrowByAndAdd(1, literal);
+	this->referencedObjects.push_back(static_cast<RefCountedObject*>(literal->refCountedPter));
+}
+
+// An execution token kept in a constant or variable keeps its word alive, as one compiled as a call does
+void ForthWord::CompileCFALiteralIntoWord(WordBodyElement* literal) {
+	GrowByAndAdd(1, literal);
+	ReferenceWordWithBody(literal->wordElement_BodyPter);
+}
+
 void ForthWord::CompileTypeIntoWord(ForthType forthType) {
 	WordBodyElement* pNewElement = new WordBodyElement();
 	pNewElement->forthType = forthType;
@@ -120,9 +198,11 @@ void ForthWord::GrowBy(int growBy) {
 	for (int n = this->bodySize; n < this->bodySize + growBy; n++) {
 		pNewBody[n] = nullptr;
 	}
-	delete this->body;
+	WordBodyElement** pOldBody = this->body;
+	delete[] this->body;
 	this->body = pNewBody;
 	this->bodySize+=growBy;
+	BodyMoved(pOldBody);
 }
 
 void ForthWord::GrowByAndAdd(int growBy, WordBodyElement* pElement) {
@@ -142,9 +222,11 @@ void ForthWord::GrowByAndAdd(int growBy, WordBodyElement* pElement) {
 		}
 	}
 
-	delete this->body;
+	WordBodyElement** pOldBody = this->body;
+	delete[] this->body;
 	this->body = pNewBody;
 	this->bodySize+=growBy;
+	BodyMoved(pOldBody);
 }
 
 std::string ForthWord::GetObjectType() {
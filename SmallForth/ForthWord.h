@@ -1,17 +1,23 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <mutex>
 #include "RefCountedObject.h"
 
 class StackElement;
 class ExecState;
 class WordBodyElement;
 
+// A word holds a reference to each word whose body it has compiled a pointer to, and to each object compiled into it
+//  as a literal, so a definition that is forgotten or redefined lives on while other words still use it, and is
+//  deleted (with its body) once nothing does.
 class ForthWord : public RefCountedObject
 {
 public:
 	ForthWord(const std::string& name);
 	ForthWord(const std::string& name, XT firstXT);
+	~ForthWord();
 	void GrowByAndAdd(int growBy, WordBodyElement* pElement);
 	void GrowBy(int growBy);
 	void CompileXTIntoWord(XT xt, int pos = -1);
@@ -21,6 +27,8 @@ public:
 	void CompileLiteralIntoWord(int64_t literal);
 	void CompileLiteralIntoWord(double literal);
 	void CompileLiteralIntoWord(WordBodyElement* literal);
+	void CompileObjectLiteralIntoWord(WordBodyElement* literal);
+	void CompileCFALiteralIntoWord(WordBodyElement* literal);
 	void CompileTypeIntoWord(ForthType forthType);
 	void CompilePterIntoWord(void* pter);
 
@@ -36,6 +44,10 @@ public:
 	bool GetImmediate() const { return this->immediate; }
 	void SetImmediate(bool flag) { this->immediate = flag; }
 
+	static ForthWord* FindWordFromBody(WordBodyElement** pBody);
+	// The words and objects this word holds references to
+	void AddReferencedObjects(std::vector<RefCountedObject*>& objects) const;
+
 	virtual std::string GetObjectType();
 	virtual bool ToString(ExecState* pExecState) const;
 	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
@@ -53,6 +65,15 @@ public:
 	static bool BuiltInHelper_FetchLiteralWithOffset(ExecState* pExecState, int offset);
 	static bool BuiltInHelper_CompileTOSLiteral(ExecState* pExecState, bool includePushWord);
 
+private:
+	// Saves and rebuilds word bodies
+	friend class DictionaryImage;
+	void BodyMoved(WordBodyElement** pOldBody);
+	void ReferenceWordWithBody(WordBodyElement** pBody);
+	// Every live word, keyed on its body pointer (its CFA pointer), for SEE, the debugger and DoCol
+	static std::unordered_map<WordBodyElement**, ForthWord*>& GetWordsByBody();
+	static std::mutex& GetWordsByBodyMutex();
+
 private:
 	std::string name;
 
@@ -60,5 +81,7 @@ private:
 	WordBodyElement** body;
 	bool immediate;
 	bool visible;
+	std::vector<ForthWord*> referencedWords;
+	std::vector<RefCountedObject*> referencedObjects;
 };
 
@@ -252,9 +252,19 @@ bool ForthWord::BuiltInHelper_CompileTOSLiteral(ExecState* pExecState, bool incl
 		success = false;
 	}
 	else {
-		pExecState->pCompiler->CompileTypeIntoWordBeingCreated(pExecState, pTopElement->GetType());
+		ForthType literalType = pTopElement->GetType();
+		pExecState->pCompiler->CompileTypeIntoWordBeingCreated(pExecState, literalType);
 
-		pExecState->pCompiler->CompileWBEIntoWordBeingCreated(pExecState, pTopElement->GetValueAsWordBodyElement());
+		TypeSystem* pTS = TypeSystem::GetTypeSystem();
+		if (!pTS->IsPter(literalType) && pTS->TypeIsObject(literalType)) {
+			pExecState->pCompiler->CompileObjectWBEIntoWordBeingCreated(pExecState, pTopElement->GetValueAsWordBodyElement());
+		}
+		else if (literalType == StackElement_PterToCFA) {
+			pExecState->pCompiler->CompileCFAWBEIntoWordBeingCreated(pExecState, pTopElement->GetValueAsWordBodyElement());
+		}
+		else {
+			pExecState->pCompiler->CompileWBEIntoWordBeingCreated(pExecState, pTopElement->GetValueAsWordBodyElement());
+		}
 	}
 
 	delete pTopElement;
@@ -17,30 +17,10 @@
 
 bool PreBuiltWords::BuiltIn_StringLiteral(ExecState* pExecState) {
 	pExecState->insideStringLiteral = true;
-	InputWord inputWord = pExecState->pInputProcessor->GetNextWord(pExecState);
-	std::string partOfWord = inputWord.word;
-
 	std::string literal;
-	bool firstPart = true;
-	while (partOfWord.compare("\"") != 0) {
-		if (firstPart) {
-			// literals start with "_ and that first space (represented by underscore) should not be added, so it is -1 here on the loop comparison
-			firstPart = false;
-			for (int i = 0; i < pExecState->delimitersAfterCurrentWord - 1; ++i) {
-				literal += " ";
-			}
-		}
-		else {
-			// In previous loop, added one less space than the delimiter count specified, in case it was the last iteration of the loop
-			//  String literals end _" and that final space should not be included.  This line is adding that space, as it wasn't the final iteration
-			literal += " ";
-		}
-		literal += partOfWord;
-		for (int i = 0; i < inputWord.postDelimiterCount - 1; ++i) {
-			literal += " ";
-		}
-		inputWord = pExecState->pInputProcessor->GetNextWord(pExecState);
-		partOfWord = inputWord.word;
+	if (!pExecState->pInputProcessor->ReadStringLiteral(pExecState, literal)) {
+		pExecState->insideStringLiteral = false;
+		return pExecState->CreateException("String literal is not terminated");
 	}
 	ForthString* pForthString = new ForthString(literal);
 
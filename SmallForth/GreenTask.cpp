@@ -0,0 +1,396 @@
+#include "ForthDefs.h"
+#include <algorithm>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "GreenTask.h"
+#include "ExecState.h"
+#include "DataStack.h"
+#include "ForthWord.h"
+#include "PreBuiltWords.h"
+#include "Bootstrap.h"
+
+GreenContext::GreenContext(GreenTask* pTask) {
+	this->pTask = pTask;
+	this->state = ContextState_Runnable;
+	this->hasTimer = false;
+#ifdef _WIN32
+	this->pFiber = nullptr;
+#endif
+}
+
+GreenScheduler::GreenScheduler(ExecState* pRootExecState) :
+	rootContext(nullptr) {
+	this->pRootExecState = pRootExecState;
+	this->pCurrent = &this->rootContext;
+#ifdef _WIN32
+	// Only a fiber can switch to another fiber
+	this->convertedThread = !IsThreadAFiber();
+	this->rootContext.pFiber = this->convertedThread ? ConvertThreadToFiber(nullptr) : GetCurrentFiber();
+#endif
+}
+
+// Only the root deletes the scheduler, so no task is running
+GreenScheduler::~GreenScheduler() {
+	for (GreenTask* pTask : this->tasks) {
+		pTask->Discard();
+		pTask->DecReference();
+	}
+	this->tasks.clear();
+#ifdef _WIN32
+	if (this->convertedThread) {
+		ConvertFiberToThread();
+	}
+#endif
+}
+
+void GreenScheduler::Start(GreenTask* pTask) {
+	pTask->IncReference();
+	this->tasks.push_back(pTask);
+	this->runnable.push_back(&pTask->context);
+}
+
+void GreenScheduler::Pause() {
+	WakeDueTimers();
+	if (this->runnable.size() == 0) {
+		return;
+	}
+	this->runnable.push_back(this->pCurrent);
+	SwitchAway();
+}
+
+bool GreenScheduler::Sleep(bool hasTime, std::chrono::steady_clock::time_point wakeTime) {
+	GreenContext* pContext = this->pCurrent;
+	pContext->state = GreenContext::ContextState_Sleeping;
+	if (hasTime) {
+		pContext->timer = this->timers.emplace(wakeTime, pContext);
+		pContext->hasTimer = true;
+	}
+	SwitchAway();
+	// Still asleep if resumed only because nothing could ever wake it
+	if (pContext->state == GreenContext::ContextState_Sleeping) {
+		pContext->state = GreenContext::ContextState_Runnable;
+		return false;
+	}
+	return true;
+}
+
+void GreenScheduler::Wake(GreenContext* pContext) {
+	if (pContext->state != GreenContext::ContextState_Sleeping) {
+		return;
+	}
+	CancelTimer(pContext);
+	pContext->state = GreenContext::ContextState_Runnable;
+	this->runnable.push_back(pContext);
+}
+
+bool GreenScheduler::PauseWhileWaiting() {
+	WakeDueTimers();
+	if (this->runnable.size() > 0) {
+		Pause();
+		return true;
+	}
+	if (this->timers.size() == 0) {
+		return false;
+	}
+	// Nothing can run until a timer is due, but another thread may end the wait sooner
+	std::chrono::steady_clock::time_point pollTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+	std::this_thread::sleep_until(std::min(this->timers.begin()->first, pollTime));
+	return true;
+}
+
+void GreenScheduler::Finish(GreenTask* pTask) {
+	pTask->context.state = GreenContext::ContextState_Done;
+	for (GreenContext* pWaiter : pTask->waiters) {
+		Wake(pWaiter);
+	}
+	pTask->waiters.clear();
+	this->tasks.erase(std::find(this->tasks.begin(), this->tasks.end(), pTask));
+	// Deletion is deferred to a safe point, which is never on this task's stack
+	pTask->DecReference();
+	SwitchAway();
+}
+
+void GreenScheduler::SwitchAway() {
+	GreenContext* pNext = TakeNext();
+	if (pNext == this->pCurrent) {
+		return;
+	}
+	GreenContext* pPrevious = this->pCurrent;
+	this->pCurrent = pNext;
+#ifdef _WIN32
+	SwitchToFiber(pNext->pFiber);
+#else
+	swapcontext(&pPrevious->context, &pNext->context);
+#endif
+}
+
+GreenContext* GreenScheduler::TakeNext() {
+	while (true) {
+		WakeDueTimers();
+		if (this->runnable.size() > 0) {
+			GreenContext* pNext = this->runnable.front();
+			this->runnable.pop_front();
+			return pNext;
+		}
+		if (this->timers.size() == 0) {
+			// Every context is waiting to be woken, so none ever will be.  Only the root can be waiting on another
+			//  context (in Await) without a timer and without being a task that can be woken, and it finds itself still
+			//  asleep
+			return &this->rootContext;
+		}
+		std::this_thread::sleep_until(this->timers.begin()->first);
+	}
+}
+
+void GreenScheduler::WakeDueTimers() {
+	if (this->timers.size() == 0) {
+		return;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	while (this->timers.size() > 0 && this->timers.begin()->first <= now) {
+		GreenContext* pContext = this->timers.begin()->second;
+		this->timers.erase(this->timers.begin());
+		pContext->hasTimer = false;
+		pContext->state = GreenContext::ContextState_Runnable;
+		this->runnable.push_back(pContext);
+	}
+}
+
+void GreenScheduler::CancelTimer(GreenContext* pContext) {
+	if (pContext->hasTimer) {
+		this->timers.erase(pContext->timer);
+		pContext->hasTimer = false;
+	}
+}
+
+GreenTask::GreenTask(GreenScheduler* pScheduler, ExecState* pExecState, WordBodyElement** pCFA) :
+	RefCountedObject(nullptr), context(this) {
+	this->objectType = ObjectType_Task;
+	this->pScheduler = pScheduler;
+	this->pExecState = pExecState;
+	this->pCFA = pCFA;
+	this->pWord = ForthWord::FindWordFromBody(pCFA);
+	if (this->pWord != nullptr) {
+		this->pWord->IncReference();
+	}
+	this->pExecState->maxNestingDepth = MachineStack::c_maxNestingDepth;
+#ifdef _WIN32
+	this->context.pFiber = this->machineStack.CreateFiberContext(Entry, this);
+#else
+	this->machineStack.MakeContext(&this->context.context, Entry, this);
+#endif
+}
+
+// Only deleted once finished or discarded, and never whilst running.  The machine stack goes with it
+GreenTask::~GreenTask() {
+	Discard();
+}
+
+#ifdef _WIN32
+void __stdcall GreenTask::Entry(void* pParameter) {
+	GreenTask* pTask = (GreenTask*)pParameter;
+#else
+void GreenTask::Entry(unsigned int high, unsigned int low) {
+	GreenTask* pTask = (GreenTask*)MachineStack::JoinParameter(high, low);
+#endif
+	pTask->Run();
+	pTask->pScheduler->Finish(pTask);
+}
+
+// Runs on the task's own machine stack.  Nothing may be thrown out of it, as there is nothing to catch it
+void GreenTask::Run() {
+	bool succeeded = false;
+	try {
+		succeeded = this->pExecState->pStack->Push(this->pCFA) && PreBuiltWords::BuiltIn_Execute(this->pExecState);
+	}
+	catch (...) {
+		this->pExecState->CreateException("Execution caused exception");
+	}
+
+	if (!succeeded && this->pExecState->exceptionThrown) {
+		this->exception = this->pExecState->pzException != nullptr ? this->pExecState->pzException : "unknown";
+	}
+	else {
+		this->results.resize(this->pExecState->pStack->Count());
+		for (size_t n = this->results.size(); n > 0; n--) {
+			StackElement* pElement = this->pExecState->pStack->Pull();
+			this->results[n - 1] = *pElement;
+			delete pElement;
+			pElement = nullptr;
+		}
+	}
+	Release();
+}
+
+void GreenTask::Discard() {
+	Release();
+	if (this->context.state != GreenContext::ContextState_Done) {
+		this->context.state = GreenContext::ContextState_Done;
+		this->exception = "Discarded before finishing";
+	}
+}
+
+void GreenTask::Release() {
+	if (this->pExecState != nullptr) {
+		Bootstrap::DeleteExecState(this->pExecState);
+		this->pExecState = nullptr;
+	}
+	if (this->pWord != nullptr) {
+		this->pWord->DecReference();
+		this->pWord = nullptr;
+	}
+}
+
+std::string GreenTask::GetObjectType() {
+	return "task";
+}
+
+bool GreenTask::ToString(ExecState* pExecState) const {
+	std::string description;
+	switch (this->context.state) {
+	case GreenContext::ContextState_Runnable:
+		description = "task (runnable)";
+		break;
+	case GreenContext::ContextState_Sleeping:
+		description = "task (sleeping)";
+		break;
+	default:
+		description = "task (done)";
+		break;
+	}
+	if (!pExecState->pStack->Push(description)) {
+		return pExecState->CreateStackOverflowException();
+	}
+	return true;
+}
+
+bool GreenTask::InvokeFunctionIndex(ExecState* pExecState, ObjectFunction /*functionToInvoke*/) {
+	return pExecState->CreateException("Cannot invoke that function on a task object");
+}
+
+GreenScheduler* GreenTask::GetScheduler(ExecState* pExecState) {
+	if (pExecState->pScheduler == nullptr) {
+		pExecState->pScheduler = new GreenScheduler(pExecState);
+	}
+	return pExecState->pScheduler;
+}
+
+bool GreenTask::Await(ExecState* pExecState, GreenTask* pTask) {
+	GreenScheduler* pScheduler = pTask->pScheduler;
+	if (pExecState->pScheduler != pScheduler && !pTask->IsDone()) {
+		return pExecState->CreateException("A task can only be awaited by the ExecState that made it, or by its tasks");
+	}
+	while (!pTask->IsDone()) {
+		GreenContext* pContext = pScheduler->GetCurrentContext();
+		if (pContext == &pTask->context) {
+			return pExecState->CreateException("A task cannot await itself");
+		}
+		pTask->waiters.push_back(pContext);
+		bool woken = pScheduler->Sleep(false, std::chrono::steady_clock::time_point());
+		pTask->waiters.erase(std::remove(pTask->waiters.begin(), pTask->waiters.end(), pContext), pTask->waiters.end());
+		if (!woken) {
+			return pExecState->CreateException("Every task is waiting to be woken, so the task awaited can never finish");
+		}
+	}
+
+	if (pTask->exception.size() > 0) {
+		std::string message = "Task failed: " + pTask->exception;
+		return pExecState->CreateException(message.c_str());
+	}
+	for (const StackElement& value : pTask->results) {
+		if (!pExecState->pStack->Push(value)) {
+			return pExecState->CreateStackOverflowException("whilst pushing a task's results");
+		}
+	}
+	return true;
+}
+
+// ( a1 .. an n xt -- task ) Makes a task that runs xt with a1 .. an on its stack, from the next pause
+bool GreenTask::BuiltIn_Task(ExecState* pExecState) {
+	if (!pExecState->pStack->TOSIsType(StackElement_PterToCFA)) {
+		return pExecState->CreateException("task expects an execution token on the top of the stack");
+	}
+	WordBodyElement** pCFA = pExecState->pStack->PullAsCFA();
+	if (!pExecState->pStack->TOSIsType(StackElement_Int)) {
+		return pExecState->CreateException("task expects the number of arguments under the execution token");
+	}
+	int64_t argumentCount = pExecState->pStack->PullAsInt();
+	if (argumentCount < 0 || argumentCount > pExecState->pStack->Count()) {
+		return pExecState->CreateStackUnderflowException("whilst getting arguments for task");
+	}
+
+	GreenScheduler* pScheduler = GetScheduler(pExecState);
+	ExecState* pTaskExecState = Bootstrap::CreateExecStateUsingDict(pExecState->pDict);
+	pTaskExecState->pScheduler = pScheduler;
+	// The task is on the same thread, so anything can be passed, and is moved rather than copied
+	std::vector<StackElement*> arguments((size_t)argumentCount);
+	for (size_t n = arguments.size(); n > 0; n--) {
+		arguments[n - 1] = pExecState->pStack->Pull();
+	}
+	for (StackElement* pElement : arguments) {
+		pTaskExecState->pStack->Push(pElement);
+	}
+
+	GreenTask* pTask = new GreenTask(pScheduler, pTaskExecState, pCFA);
+	pScheduler->Start(pTask);
+	if (!pExecState->pStack->Push(pTask)) {
+		return pExecState->CreateStackOverflowException("whilst pushing a task");
+	}
+	return true;
+}
+
+// ( -- ) Lets every other runnable task (or the ExecState that made them) run, then carries on
+bool GreenTask::BuiltIn_Pause(ExecState* pExecState) {
+	if (pExecState->pScheduler != nullptr) {
+		pExecState->pScheduler->Pause();
+	}
+	return true;
+}
+
+// ( ms -- ) Lets other tasks run for at least ms milliseconds.  A task given a negative time sleeps until woken
+bool GreenTask::BuiltIn_Sleep(ExecState* pExecState) {
+	if (!pExecState->pStack->TOSIsType(StackElement_Int)) {
+		return pExecState->CreateException("sleep expects a number of milliseconds");
+	}
+	int64_t milliseconds = pExecState->pStack->PullAsInt();
+	GreenScheduler* pScheduler = pExecState->pScheduler;
+	if (milliseconds < 0) {
+		if (pScheduler == nullptr || pScheduler->IsRoot(pExecState)) {
+			return pExecState->CreateException("Only a task can sleep until woken");
+		}
+		pScheduler->Sleep(false, std::chrono::steady_clock::time_point());
+		return true;
+	}
+	if (pScheduler == nullptr) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+		return true;
+	}
+	pScheduler->Sleep(true, std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds));
+	return true;
+}
+
+// ( task -- ) Makes a sleeping task runnable.  Waking a task that is not asleep does nothing
+bool GreenTask::BuiltIn_Wake(ExecState* pExecState) {
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		return pExecState->CreateStackUnderflowException("whilst getting task to wake");
+	}
+	if (pElement->GetType() != ObjectType_Task) {
+		delete pElement;
+		pElement = nullptr;
+		return pExecState->CreateException("wake requires a task");
+	}
+	GreenTask* pTask = (GreenTask*)pElement->GetObject();
+	bool sameScheduler = pTask->pScheduler == pExecState->pScheduler;
+	if (sameScheduler) {
+		pTask->pScheduler->Wake(&pTask->context);
+	}
+	delete pElement;
+	pElement = nullptr;
+	if (!sameScheduler) {
+		return pExecState->CreateException("A task can only be woken by the ExecState that made it, or by its tasks");
+	}
+	return true;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <ucontext.h>
+#endif
+#include "RefCountedObject.h"
+#include "MachineStack.h"
+#include "StackElement.h"
+class ExecState;
+class ForthWord;
+class WordBodyElement;
+class GreenTask;
+
+// One of the contexts a GreenScheduler switches between: a task, or the root (the ExecState the tasks were created
+//  from, running on the thread's own stack)
+struct GreenContext {
+	enum ContextState {
+		ContextState_Runnable,
+		ContextState_Sleeping,
+		ContextState_Done
+	};
+
+	GreenContext(GreenTask* pTask);
+
+	// nullptr for the root
+	GreenTask* pTask;
+	ContextState state;
+	// Valid whilst sleeping with a time to wake
+	bool hasTimer;
+	std::multimap<std::chrono::steady_clock::time_point, GreenContext*>::iterator timer;
+#ifdef _WIN32
+	void* pFiber;
+#else
+	ucontext_t context;
+#endif
+};
+
+// Cooperative multitasking within one ExecState's thread, as in classic Forth.  Tasks run in turn (round robin) with
+//  the root, each until it pauses, sleeps or waits for another task, and none is ever preempted.  The inner
+//  interpreter nests on the C++ stack, so each task has a MachineStack of its own as well as its own ExecState, and
+//  a switch swaps both (swapcontext, or a fiber switch on Windows).  No other thread is involved.
+// Owned by the root ExecState; tasks' ExecStates refer to it too.  Tasks not finished when the root is deleted are
+//  discarded.
+class GreenScheduler
+{
+public:
+	GreenScheduler(ExecState* pRootExecState);
+	~GreenScheduler();
+
+	bool IsRoot(const ExecState* pExecState) const { return this->pRootExecState == pExecState; }
+	// True if a context other than the running one is ready to run
+	bool HasOtherRunnable() const { return this->runnable.size() > 0; }
+
+	void Start(GreenTask* pTask);
+	// Lets every other runnable context run before returning
+	void Pause();
+	// Sleeps until woken, or until the time given has passed if hasTime is set.  Returns false if every context was
+	//  left waiting to be woken, so nothing could wake this one
+	bool Sleep(bool hasTime, std::chrono::steady_clock::time_point wakeTime);
+	void Wake(GreenContext* pContext);
+	// For a context waiting on something outside the scheduler, such as a channel: lets other contexts run, or if none
+	//  can, sleeps briefly while one waits for a timer.  Returns false if no other context will ever run, so only
+	//  another thread can end the wait
+	bool PauseWhileWaiting();
+	// Called by a task that has finished.  Never returns
+	void Finish(GreenTask* pTask);
+	GreenContext* GetCurrentContext() { return this->pCurrent; }
+
+private:
+	void SwitchAway();
+	GreenContext* TakeNext();
+	void WakeDueTimers();
+	void CancelTimer(GreenContext* pContext);
+
+private:
+	ExecState* pRootExecState;
+	GreenContext rootContext;
+	GreenContext* pCurrent;
+	std::deque<GreenContext*> runnable;
+	std::multimap<std::chrono::steady_clock::time_point, GreenContext*> timers;
+	// Tasks not yet finished, each with a reference held
+	std::vector<GreenTask*> tasks;
+#ifdef _WIN32
+	bool convertedThread;
+#endif
+};
+
+// A task made by task, that runs an execution token on an ExecState of its own, switched to by its GreenScheduler
+class GreenTask : public RefCountedObject
+{
+public:
+	GreenTask(GreenScheduler* pScheduler, ExecState* pExecState, WordBodyElement** pCFA);
+	~GreenTask();
+
+	virtual std::string GetObjectType();
+	virtual bool ToString(ExecState* pExecState) const;
+	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
+
+	bool IsDone() const { return this->context.state == GreenContext::ContextState_Done; }
+	// Pauses the calling context until the task has finished, then pushes its results
+	static bool Await(ExecState* pExecState, GreenTask* pTask);
+
+	static bool BuiltIn_Task(ExecState* pExecState);
+	static bool BuiltIn_Pause(ExecState* pExecState);
+	static bool BuiltIn_Sleep(ExecState* pExecState);
+	static bool BuiltIn_Wake(ExecState* pExecState);
+
+private:
+	friend class GreenScheduler;
+	void Run();
+	// Ends the task without running the rest of it, deleting its ExecState
+	void Discard();
+	// Deletes the task's ExecState and releases its word, once finished with
+	void Release();
+	static GreenScheduler* GetScheduler(ExecState* pExecState);
+#ifdef _WIN32
+	static void __stdcall Entry(void* pParameter);
+#else
+	static void Entry(unsigned int high, unsigned int low);
+#endif
+
+private:
+	GreenScheduler* pScheduler;
+	ExecState* pExecState;
+	WordBodyElement** pCFA;
+	// The word run, kept alive whilst the task runs it
+	ForthWord* pWord;
+	GreenContext context;
+	MachineStack machineStack;
+	// Contexts waiting in Await for this task to finish
+	std::vector<GreenContext*> waiters;
+	// Valid once done: the task's stack, bottom first, or the exception it ended with
+	std::vector<StackElement> results;
+	std::string exception;
+};
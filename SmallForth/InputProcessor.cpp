@@ -1,10 +1,10 @@
 #include "ForthDefs.h"
 #include <iostream>
-#include <conio.h>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <charconv>
 
-#include <Windows.h>
 #include "InputProcessor.h"
 #include "ForthDict.h"
 #include "ForthWord.h"
@@ -16,31 +16,37 @@
 #include "ForthFile.h"
 #include "PreBuiltWords.h"
 #include "WordBodyElement.h"
+#include "ZeroCountTable.h"
+#include "CycleCollector.h"
+#include "MappedFile.h"
+#include "StreamLineReader.h"
 
 volatile bool InputProcessor::s_executionToHalt = false;
 
-int InputProcessor::HandlerRoutine(unsigned long fdwCtrlType) {
-	if (fdwCtrlType == CTRL_C_EVENT) {
-		InputProcessor::s_executionToHalt = true;
-		return TRUE;
-	}
-	return FALSE;
+InputProcessor::InputProcessor() {
+	pLineReader = new StreamLineReader(&std::cin, false);
+	processingFromStringFinished = false;
+	interpretDepth = 0;
 }
 
-InputProcessor::InputProcessor() {
-	SetConsoleCtrlHandler(HandlerRoutine, TRUE);
+InputProcessor::~InputProcessor() {
+	while (this->inputSources.size() > 0) {
+		PopInputSource();
+	}
+	delete this->pLineReader;
+	this->pLineReader = nullptr;
+}
 
-	processFromString = false;
-	processingFromStringFinished = false;
-	commandHistoryLine = 0;
-	exitApplication = false;
-	historySize = 500;
+// Takes ownership of the reader
+void InputProcessor::SetLineReader(LineReader* pLineReader) {
+	delete this->pLineReader;
+	this->pLineReader = pLineReader;
 }
 
 std::tuple<ForthWord*, bool> InputProcessor::GetForthWordFromVocabOrObject(ExecState* pExecState) {
 	bool executeOnTOSObject = false;
 	InputWord wordWithDelimiterCount = GetNextWord(pExecState);
-	std::string wordName = wordWithDelimiterCount.word;
+	std::string_view wordName = wordWithDelimiterCount.word;
 	bool bInsideCommentLine = pExecState->GetBoolTLSVariable(ExecState::c_insideCommentLineIndex);
 	if (bInsideCommentLine || wordName.length() == 0) {
 		return { nullptr, executeOnTOSObject };
@@ -57,7 +63,9 @@ std::tuple<ForthWord*, bool> InputProcessor::GetForthWordFromVocabOrObject(ExecS
 			pWord = pExecState->pDict->FindWord("literal");
 		}
 	}
-	if (pWord == nullptr) {
+	// A word whose first characters cannot begin any word in any dictionary skips the object and dictionary lookups,
+	//  so numbers are converted straight away
+	if (pWord == nullptr && ForthDict::CouldBeWord(wordName)) {
 		if (nCompileState == 1) {
 			pWord = FindWordInObjectDefinition(pExecState, wordName);
 		}
@@ -70,28 +78,29 @@ std::tuple<ForthWord*, bool> InputProcessor::GetForthWordFromVocabOrObject(ExecS
 		if (pWord == nullptr)
 		{
 			pWord = pExecState->pDict->FindWord(wordName);
-			if (pWord == nullptr) {
-				bool bInsideComment = pExecState->GetBoolTLSVariable(ExecState::c_insideCommentIndex);
-
-				if (bInsideComment == false) {
-					int64_t intValue;
-					double floatValue;
-					if (ConvertToInt(wordName, intValue)) {
-						pExecState->pStack->Push(intValue);
-					}
-					else if (ConvertToFloat(wordName, floatValue)) {
-						pExecState->pStack->Push(floatValue);
-					}
-					else {
-						ClearRestOfLine();
-						std::ostream* pStderr = pExecState->GetStderr();
-						(*pStderr) << "Unknown word: " << wordName << std::endl;
-					}
+		}
+	}
+	if (pWord == nullptr) {
+		bool bInsideComment = pExecState->GetBoolTLSVariable(ExecState::c_insideCommentIndex);
 
-					if (nCompileState == 1) {
-						pWord = pExecState->pDict->FindWord("literal");
-					}
-				}
+		if (bInsideComment == false) {
+			int64_t intValue;
+			double floatValue;
+			LiteralType literalType = ClassifyLiteral(wordName, intValue, floatValue);
+			if (literalType == LiteralType_Int) {
+				pExecState->pStack->Push(intValue);
+			}
+			else if (literalType == LiteralType_Float) {
+				pExecState->pStack->Push(floatValue);
+			}
+			else {
+				ClearRestOfLine();
+				std::ostream* pStderr = pExecState->GetStderr();
+				(*pStderr) << "Unknown word: " << wordName << std::endl;
+			}
+
+			if (nCompileState == 1) {
+				pWord = pExecState->pDict->FindWord("literal");
 			}
 		}
 	}
@@ -107,6 +116,7 @@ bool InputProcessor::WordMatchesXT(ForthWord* pWord, XT xtToMatch) {
 }
 
 bool InputProcessor::Interpret(ExecState* pExecState) {
+	++this->interpretDepth;
 	while (true) {
 		ForthWord* pWord;
 		bool executeOnTOSObject;
@@ -114,6 +124,7 @@ bool InputProcessor::Interpret(ExecState* pExecState) {
 		if (pWord == nullptr) {
 			if (processingFromStringFinished) {
 				processingFromStringFinished = false;
+				--this->interpretDepth;
 				if (pExecState->exceptionThrown) {
 					return false;
 				}
@@ -178,6 +189,7 @@ bool InputProcessor::Interpret(ExecState* pExecState) {
 
 				if (pExecState->exceptionThrown) {
 					ClearRestOfLine();
+					AbandonIncludedFiles();
 					std::ostream* pStderr = pExecState->GetStderr();
 					(*pStderr) << "Exception: " << pExecState->pzException << std::endl;
 
@@ -207,535 +219,357 @@ bool InputProcessor::Interpret(ExecState* pExecState) {
 			pExecState->pWordBeingInterpreted->DecReference();
 			pExecState->pWordBeingInterpreted = nullptr;
 		}
+		// Between words of the outermost interpreter no built-in word is executing, so it is safe to delete unreferenced
+		//  objects.  Do so at the end of each line (of the console, or of an included file), or sooner if many are waiting.  Garbage cycles are looked for
+		//  a step at a time, once enough candidates have built up.  Green tasks on this thread are suspended inside
+		//  built-in words (pause and the like), but those hold whatever they use counted or on the task's stacks.
+		ZeroCountTable* pZCT = ZeroCountTable::GetZeroCountTable();
+		CycleCollector* pCycleCollector = CycleCollector::GetCycleCollector();
+		if (this->interpretDepth == 1 && (AtEndOfLine() || pZCT->ReconcileRecommended())) {
+			if (pCycleCollector->StepRecommended()) {
+				pCycleCollector->CollectStep();
+			}
+			pZCT->Reconcile();
+		}
 	}
 
 	delete pExecState;
 	pExecState = nullptr;
+	--this->interpretDepth;
 	return true;
 }
 
 InputWord InputProcessor::GetNextWord(ExecState* pExecState) {
-	while (this->inputWords.size() == 0) {
+	while (true) {
+		if (this->inputSources.size() > 0) {
+			InputSource& source = this->inputSources.back();
+			std::string_view text = source.text;
+			size_t start = SkipDelimiters(text, source.position);
+			if (start < text.length()) {
+				size_t end = start;
+				while (end < text.length() && !IsDelimiter(text[end])) {
+					++end;
+				}
+				source.lastWordEnd = end;
+				source.position = SkipDelimiters(text, end);
+
+				InputWord iw;
+				iw.word = text.substr(start, end - start);
+				iw.postDelimiterCount = (int)(source.position - end);
+				return iw;
+			}
+		}
 		pExecState->SetVariable("#insideCommentLine", false);
 
-		if (processFromString)
-		{
-			processFromString = false;
+		if (this->inputSources.size() > 0 && !this->inputSources.back().fromConsole) {
+			bool endsInterpret = this->inputSources.back().endsInterpret;
+			PopInputSource();
+			if (endsInterpret) {
+				processingFromStringFinished = true;
+				return InputWord();
+			}
+			continue;
+		}
+		if (!ReadAndProcess(pExecState)) {
+			// End of the input
 			processingFromStringFinished = true;
-			InputWord iw;
-			return iw;
+			return InputWord();
 		}
-		ReadAndProcess(pExecState);
 	}
-	InputWord wordToReturn = this->inputWords.front();
-	this->inputWords.pop_front();
-	return wordToReturn;
 }
 
-char InputProcessor::GetNextChar() {
-	int c = _getch();
-	return c;
-}
-
-void InputProcessor::HandleException(ExecState* pExecState, const std::exception* pException, const std::string& msg) {
-	pExecState->pStack->Clear();
-	pExecState->pTempStack->Clear();
-	pExecState->pSelfStack->Clear();
-	pExecState->pReturnStack->Clear();
-	std::ostream* pStderr = pExecState->GetStderr();
-	(*pStderr) << msg;
-	if (pException != nullptr) {
-		(*pStderr) << pException->what();
-	}
-
-}
-
-void InputProcessor::ClearRestOfLine() {
-	this->inputWords.clear();
-}
-
-void InputProcessor::ReadAndProcess(ExecState* pExecState) {
-	std::ostream* pStdout = pExecState->GetStdout();
-	std::istream* pStdin = pExecState->GetStdin();
-
-	int64_t nCompileState = pExecState->GetIntTLSVariable(ExecState::c_compileStateIndex);
-
-	try
-	{
-		while (true) {
-			std::string line;
-			bool bInsideComment = pExecState->GetBoolTLSVariable(ExecState::c_insideCommentIndex);
-
-			if (bInsideComment) {
-				(*pStdout) << pExecState->commentPrompt;
-			}
-			else if (pExecState->insideStringLiteral) {
-				(*pStdout) << pExecState->stringLiteralPrompt;
-			}
-			else if (nCompileState==1) {
-				(*pStdout) << pExecState->compilePrompt;
+// Reads the text of a string literal, up to a closing " word, straight from the input text rather than as words.
+//  The literal starts after the single delimiter following the opening " word, and ends before the delimiter
+//  preceding the closing one.  A literal continued over several lines has its lines joined by a space.
+bool InputProcessor::ReadStringLiteral(ExecState* pExecState, std::string& literal) {
+	literal.clear();
+	bool literalStarted = false;
+	bool firstLine = true;
+	while (true) {
+		if (this->inputSources.size() > 0) {
+			InputSource& source = this->inputSources.back();
+			std::string_view text = source.text;
+			size_t start;
+			if (firstLine) {
+				start = std::min(source.lastWordEnd + 1, text.length());
 			}
 			else {
-				(*pStdout) << pExecState->interpetPrompt;
+				start = SkipDelimiters(text, source.position);
 			}
-			// Cannot simply call getline, as that will not process ctrl-c correctly (ctrl-c on empy line exits programme. ctrl-c on line with input, cancels line)
-			//  As getting input from cin only processes the ctrl-c once enter has been pressed
-			line = ReadLine(pStdout, pExecState);
-			if (exitApplication) {
-				exit(0);
+			size_t lineEnd = text.find('\n', start);
+			if (lineEnd == std::string_view::npos) {
+				lineEnd = text.length();
 			}
 
-			if (line.length() != 0) {
-				ProcessLine(line, ' ');
-				return;
+			for (size_t n = start; n < lineEnd; n++) {
+				bool closingWord = text[n] == '"' && (n == start || IsDelimiter(text[n - 1])) &&
+					(n + 1 == lineEnd || IsDelimiter(text[n + 1]));
+				if (closingWord) {
+					size_t end = n > start ? n - 1 : n;
+					AppendLiteralText(literal, text.substr(start, end - start), literalStarted);
+					source.lastWordEnd = n + 1;
+					source.position = SkipDelimiters(text, n + 1);
+					return true;
+				}
 			}
-			std::cin.clear();
-		}
-	}
-	catch (...)
-	{
-		std::ostream* pStderr = pExecState->GetStderr();
-		(*pStderr) << "Exiting\n";
-	}
-}
-
-void InputProcessor::ProcessLine(const std::string& line, char delimiter) {
-	int len = (int) line.length();
-	int currentWordStart = -1;
-	int delimitersAfterCurrentWord = 0;
-	for (int n =0;n<len;++n) {
-		char c = line[n];
-		if (c == '\t') {
-			c = ' ';
-		}
-		if (currentWordStart == -1) {
-			if (c != delimiter) {
-				currentWordStart = n;
-				delimitersAfterCurrentWord = 0;
+			size_t end = lineEnd;
+			if (end > start && text[end - 1] == '\r') {
+				--end;
 			}
-		}
-		else if (c == delimiter) {
-			++delimitersAfterCurrentWord;
-		}
-		else if (delimitersAfterCurrentWord > 0) {
-			// Found start of next word after delimiters
-			std::string word = line.substr(currentWordStart, n - currentWordStart - delimitersAfterCurrentWord);
-			InputWord w;
-			w.postDelimiterCount = delimitersAfterCurrentWord;
-			w.word = word;
-			this->inputWords.push_back(w);
-			delimitersAfterCurrentWord = 0;
-			currentWordStart = n;
-		}
-	}
-	if (currentWordStart != -1) {
-		std::string word = line.substr(currentWordStart, len - currentWordStart - delimitersAfterCurrentWord);
-		InputWord w;
-		w.postDelimiterCount = delimitersAfterCurrentWord;
-		w.word = word;
-		this->inputWords.push_back(w);
-	}
-}
-
-std::string InputProcessor::ReadLine(std::ostream* pStdout, ExecState* pExecState) {
-	// Have to process forward/backward arrows, home/end, up and down (through history), insert characters, delete/backspace without relying on the console implementation
-	// This is made more complex by the fact that the console, when told to advance from the last character on a console line (to the next line), actually keeps the cursor before the last 
-	//  character on the line. Doing this prevents the code from calculating the start position of the current line - cannot just store the start position as it moves around on resizing and scrolling
-	int cursorPositionInLine = 0;
-	std::string line;
-	while (true) {
-		int c = _getch();
-		if (c == 3) {
-			// ctrl-c
-			if (line.length() > 0) {
-				(*pStdout) << "^c";
-				line = std::string();
-				(*pStdout) << "\n";
-				cursorPositionInLine = 0;
-				return line;
+			if (end > start && IsDelimiter(text[end - 1])) {
+				--end;
 			}
-			else {
-				exitApplication = true;
-				return "";
+			if (start < end) {
+				AppendLiteralText(literal, text.substr(start, end - start), literalStarted);
 			}
-		}
-		if (c == 0xe0 || c==0x00) {
-			// Start of scanline codes
-			c = _getch();
-			cursorPositionInLine = ProcessScanLineCode(pStdout, line, cursorPositionInLine, c);
-		}
-		else if (c == 27) {
-			// escape
-			BlankCurrentLine(pStdout, line, cursorPositionInLine);
-			line = "";
-			cursorPositionInLine = 0;
-		}
-		else if (c == 9) {
-			// tab
-			cursorPositionInLine = InsertIntoLine(pStdout, line, cursorPositionInLine, ' ');
-			cursorPositionInLine = InsertIntoLine(pStdout, line, cursorPositionInLine, ' ');
-		}
-		else if (c == 8) {
-			// Backspace
-			if (cursorPositionInLine > 0) {
-				ProcessBackspace(pStdout, line, cursorPositionInLine);
+			firstLine = false;
+			if (lineEnd < text.length()) {
+				source.position = lineEnd + 1;
+				continue;
 			}
-		}
-		else if (c == 13 || c == 10) {
-			// This is to ensure that over a multi-(console)-line input, if the cursor isn't on the final console line
-			//  that the further console output doesn't overwrite the input
-			MoveToLineEnd(pStdout, line, cursorPositionInLine);
-			(*pStdout) << '\n';
-			break;
-		}
-		else {
-			cursorPositionInLine = InsertIntoLine(pStdout, line, cursorPositionInLine, c);
-		}
-	}
-	if (line.length() > 0) {
-		AddLineToHistory(line);
-	}
-	return line;
-}
+			source.position = text.length();
 
-int InputProcessor::ProcessScanLineCode(std::ostream* pStdout, std::string& line, int cursorPositionInLine, int scanlineCode) {
-	if (scanlineCode == 0x4b && cursorPositionInLine > 0) {
-		// Left arrow
-		int x;
-		int y;
-		int width;
-		int height;
-		this->GetCursorPositionAndSize(x, y, width, height);
-		if (x == 0)
-		{
-			SetCursorPosition(width - 1, y - 1);
-		}
-		else {
-			SetCursorPosition(x - 1, y);
-		}
-
-		//(*pStdout) << '\b';
-		cursorPositionInLine--;
-	}
-	else if (scanlineCode == 0x4d && cursorPositionInLine < line.length()) {
-		// Right arrow
-
-		// Normal console behaviour is odd at the end of a console line. It doesn't move the cursor the next console-line, or move it after the last character (on the console line), but keeps 
-		//  it on (before) the last character on the line instead of after it.
-		// This code moves it to the next line (as can't place it after it), which ensures backspace from end of console line (or next console line), works correctly.
-		int x;
-		int y;
-		int width;
-		int height;
-		this->GetCursorPositionAndSize(x, y, width, height);
-		if (x < width-1) {
-			++x;
+			if (!source.fromConsole) {
+				// Left for GetNextWord to finish with the source
+				return false;
+			}
 		}
-		else {
-			x = 0;
-			++y;
+		if (!ReadAndProcess(pExecState)) {
+			return false;
 		}
-		++cursorPositionInLine;
-		this->SetCursorPosition(x, y);
-	}
-	else if (scanlineCode == 0x48 && commandHistoryLine > 0) {
-		// Go up in history
-		BlankCurrentLine(pStdout, line, cursorPositionInLine);
-		line = MoveUpInHistory();
-		(*pStdout) << line;
-		cursorPositionInLine = (int)line.length();
-	}
-	else if (scanlineCode == 0x50 && this->commandHistoryLine < this->commandHistory.size()) {
-		// Go down in history
-		BlankCurrentLine(pStdout, line, cursorPositionInLine);
-		line = MoveDownInHistory();
-		(*pStdout) << line;
-		cursorPositionInLine = (int)line.length();
-	}
-	else if (scanlineCode == 0x53 && cursorPositionInLine < line.length()) {
-		// Delete pressed
-		line = line.substr(0, cursorPositionInLine) + line.substr(cursorPositionInLine + 1);
-		WriteLineFromPosition(pStdout, line, cursorPositionInLine, true);
-	}
-	else if (scanlineCode == 0x47) {
-		// home
-		MoveToPosition(pStdout, line, cursorPositionInLine, 0);
-		cursorPositionInLine = 0;
-	}
-	else if (scanlineCode == 0x4f) {
-		// end
-		MoveToLineEnd(pStdout, line, cursorPositionInLine);
-	}
-
-	return cursorPositionInLine;
-}
-
-void InputProcessor::MoveToLineEnd(std::ostream* pStdout, std::string& line, int& cursorPositionInLine) {
-	MoveToPosition(pStdout, line, cursorPositionInLine, (int)line.length());
-	cursorPositionInLine = (int)line.length();
-}
-
-void InputProcessor::ProcessBackspace(std::ostream* pStdout, std::string& line, int& cursorPositionInLine) {
-	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
-	int startX;
-	int startY;
-	CalculateLineStartPosition(cursorPositionInLine, startX, startY);
-
-	// Backspace won't work if cursor is currently at the start on the console line (as in the text line overspills)
-	int x;
-	int y;
-	int width;
-	int height;
-	this->GetCursorPositionAndSize(x, y, width, height);
-	if (y > startY && x == 0) {
-		SetCursorPosition(width - 1, y - 1);
-		(*pStdout) << " ";
-		SetCursorPosition(width-1, y - 1);
-	}
-	else {
-		// Backsace is fine here
-		(*pStdout) << (char)'\b';
-	}
-
-	line = line.substr(0, cursorPositionInLine - 1) + line.substr(cursorPositionInLine);
-	--cursorPositionInLine;
-	WriteLineFromPosition(pStdout, line, cursorPositionInLine, true);
+	}
 }
 
-int InputProcessor::InsertIntoLine(std::ostream* pStdout, std::string& line, int cursorPositionInLine, char toInsert) {
-	// First insert the character into the string line
-	if (line.length() == 0) {
-		line += toInsert;
-	}
-	else if (cursorPositionInLine == 0) {
-		line.insert(line.begin(), toInsert);
-	}
-	else {
-		line.insert(cursorPositionInLine, 1, toInsert);
-	}
-	// Then update the console to display line correctly. False means do not add a space on the end (which is used when deleting characters)
-	//  Note, this method needs the cursorPosition, as it used to calculate where the line starts in the console, to re-draw the line fully
-	WriteLineFromPosition(pStdout, line, cursorPositionInLine, false);
-	int x;
-	int y;
-	int width;
-	int height;
-	this->GetCursorPositionAndSize(x, y, width, height);
-
-	// Ensure that if the cursor ends up at the end of the line, it is moved to the next line. To prevent errant behaviour by the console at line ends
-	if (x == width - 1) {
-		x = 0;
-		y++;
-		// Weirdly this line does not move console down if debugging
-		(*pStdout) << "\n";
-		if (y >= height) {
-			y = height - 1;
-		}
+void InputProcessor::AppendLiteralText(std::string& literal, std::string_view text, bool& literalStarted) {
+	if (literalStarted) {
+		literal += ' ';
 	}
-	else {
-		x++;
+	literalStarted = true;
+	for (char c : text) {
+		literal += c == '\t' ? ' ' : c;
 	}
-	SetCursorPosition(x, y);
-	return ++cursorPositionInLine;
 }
 
-void InputProcessor::WriteLineFromPosition(std::ostream* pStdout, const std::string& line, int cursorPosition, bool addExtraSpaceForDeletion) {
-	int x;
-	int y;
-	GetCursorPosition(x, y);
-
-	int startX;
-	int startY;
-	this->CalculateLineStartPosition(cursorPosition, startX, startY);
-	SetCursorPosition(startX, startY);
-
-	int len = (int)line.length();
+size_t InputProcessor::SkipDelimiters(std::string_view text, size_t position) {
+	while (position < text.length() && IsDelimiter(text[position])) {
+		++position;
+	}
+	return position;
+}
 
-	(*pStdout) << line;
-	if (addExtraSpaceForDeletion) {
-		len++;
-		(*pStdout) << " ";
+// True when the last word read ended a line: the delimiters skipped after it include a newline, or there is no more text
+bool InputProcessor::AtEndOfLine() const {
+	if (this->inputSources.size() == 0) {
+		return true;
 	}
-	int startX_AfterLineOut;
-	int startY_AfterLineOut;
-	this->CalculateLineStartPosition(len, startX_AfterLineOut, startY_AfterLineOut);
-	if (startY_AfterLineOut < startY) {
-		// Console has scrolled
-		y -= startY - startY_AfterLineOut;
+	const InputSource& source = this->inputSources.back();
+	if (source.position >= source.text.length()) {
+		return true;
 	}
-	SetCursorPosition(x, y);
+	return source.text.substr(source.lastWordEnd, source.position - source.lastWordEnd).find('\n') != std::string_view::npos;
 }
 
-void InputProcessor::MoveToPosition(std::ostream* pStdout, const std::string& line, int currentPosition, int position) {
-	int x;
-	int y;
-	this->CalculatePositionInLine(currentPosition, position, x,y);
-	this->SetCursorPosition(x, y);
+void InputProcessor::PushInputSource(const std::string& text, bool endsInterpret) {
+	InputSource source;
+	source.buffer = text;
+	source.pMappedFile = nullptr;
+	source.position = 0;
+	source.lastWordEnd = 0;
+	source.fromConsole = false;
+	source.endsInterpret = endsInterpret;
+	this->inputSources.push_back(std::move(source));
+	// Set once in place, as moving the source may have moved a short buffer
+	this->inputSources.back().text = this->inputSources.back().buffer;
 }
 
-void InputProcessor::BlankCurrentLine(std::ostream* pStdout, const std::string& line, int currentPosition) {
-
-	int startX;
-	int startY;
-	this->CalculateLineStartPosition(currentPosition, startX, startY);
-	this->SetCursorPosition(startX, startY);
-
-	for (int i = (int)line.length(); i > 0; --i) {
-		(*pStdout) << " ";
+bool InputProcessor::PushFileSource(ExecState* pExecState, const std::string& path, bool endsInterpret) {
+	MappedFile* pMappedFile = new MappedFile();
+	if (!pMappedFile->Open(path)) {
+		delete pMappedFile;
+		pMappedFile = nullptr;
+		return pExecState->CreateException("Could not open file to include");
+	}
+	InputSource source;
+	source.pMappedFile = pMappedFile;
+	source.text = pMappedFile->GetContents();
+	source.position = 0;
+	// Skip a UTF-8 byte order mark
+	if (source.text.substr(0, 3) == "\xEF\xBB\xBF") {
+		source.position = 3;
 	}
-	this->SetCursorPosition(startX, startY);
+	source.lastWordEnd = source.position;
+	source.fromConsole = false;
+	source.endsInterpret = endsInterpret;
+	this->inputSources.push_back(std::move(source));
+	return true;
 }
 
-void InputProcessor::CalculatePositionInLine(int currenmtPositionInLine, int newPosition, int& x, int& y) {
-	int startX;
-	int startY;
-	CalculateLineStartPosition(currenmtPositionInLine, startX, startY);
-
-	int width;
-	int height;
-	GetConsoleSize(width, height);
-
-	x = startX;
-	y = startY;
-
-	if (newPosition < width - startX) {
-		x = startX + newPosition;
-	}
-	else {
-		newPosition -= (width - startX);
-		x = 0;
-		y++;
-		x += (newPosition % width);
-		y += (newPosition / width);
+void InputProcessor::PopInputSource() {
+	InputSource& source = this->inputSources.back();
+	if (source.pMappedFile != nullptr) {
+		delete source.pMappedFile;
+		source.pMappedFile = nullptr;
 	}
+	this->inputSources.pop_back();
 }
 
-void InputProcessor::CalculateLineStartPosition(int currentPositionInLine, int& startX, int& startY) {
-	int width;
-	int height;
-	int x;
-	int y;
-	this->GetCursorPositionAndSize(x, y, width, height);
-	int lines = currentPositionInLine / width;
-	int offsetX = currentPositionInLine % width;
-
-	startX = x - offsetX;
-	startY = y - lines;
-
-	if (startX < 0) {
-		// Scrolled to next line
-		startY -= 1;
-		startX += width;
+// An exception stops any files being included, as the rest of a file likely depends on what failed
+void InputProcessor::AbandonIncludedFiles() {
+	while (this->inputSources.size() > 0 && this->inputSources.back().pMappedFile != nullptr &&
+		!this->inputSources.back().endsInterpret) {
+		PopInputSource();
 	}
 }
 
-void InputProcessor::GetCursorPositionAndSize(int& x, int& y, int& width, int& height) {
-	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
-	CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
-	GetConsoleScreenBufferInfo(hStdout, &consoleInfo);
-	x = consoleInfo.dwCursorPosition.X;
-	y = consoleInfo.dwCursorPosition.Y;
-	width = consoleInfo.dwSize.X;
-	height = consoleInfo.dwSize.Y;
+// Words are read from the file as the interpreter needs them, after the word that included it, so the file is
+//  interpreted by the interpreter that executed include
+bool InputProcessor::IncludeFile(ExecState* pExecState, const std::string& path) {
+	return PushFileSource(pExecState, path, false);
 }
 
-void InputProcessor::GetConsoleSize(int& width, int& height) {
-	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
-	CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
-	GetConsoleScreenBufferInfo(hStdout, &consoleInfo);
-	width = consoleInfo.dwSize.X;
-	height = consoleInfo.dwSize.Y;
+// Interprets a whole file, returning once it has been interpreted
+bool InputProcessor::InterpretFile(ExecState* pExecState, const std::string& path) {
+	this->processingFromStringFinished = false;
+	if (!PushFileSource(pExecState, path, true)) {
+		std::ostream* pStderr = pExecState->GetStderr();
+		(*pStderr) << "Exception: " << pExecState->pzException << ": " << path << std::endl;
+		pExecState->exceptionThrown = false;
+		return false;
+	}
+	return Interpret(pExecState);
 }
 
-void InputProcessor::GetCursorPosition(int& x, int& y) {
-	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
-	CONSOLE_SCREEN_BUFFER_INFO consoleInfo;
-	GetConsoleScreenBufferInfo(hStdout, &consoleInfo);
-	x = consoleInfo.dwCursorPosition.X;
-	y = consoleInfo.dwCursorPosition.Y;
+char InputProcessor::GetNextChar() {
+	return this->pLineReader->ReadChar();
 }
 
-void InputProcessor::SetCursorPosition(int x, int y) {
-	HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
-	COORD coords;
-	coords.X = x;
-	coords.Y = y;
-	SetConsoleCursorPosition(hStdout, coords);
-}
+void InputProcessor::HandleException(ExecState* pExecState, const std::exception* pException, const std::string& msg) {
+	pExecState->pStack->Clear();
+	pExecState->pTempStack->Clear();
+	pExecState->pSelfStack->Clear();
+	pExecState->pReturnStack->Clear();
+	std::ostream* pStderr = pExecState->GetStderr();
+	(*pStderr) << msg;
+	if (pException != nullptr) {
+		(*pStderr) << pException->what();
+	}
 
-std::string InputProcessor::MoveUpInHistory() {
-	--commandHistoryLine;
-	return this->commandHistory[commandHistoryLine];
 }
 
-std::string InputProcessor::MoveDownInHistory() {
-	++this->commandHistoryLine;
-	if (this->commandHistoryLine == this->commandHistory.size()) {
-		return std::string();
-	}
-	else {
-		return this->commandHistory[this->commandHistoryLine];
+// The delimiters after the last word have already been skipped, so if they ended its line the rest of it is already gone
+void InputProcessor::ClearRestOfLine() {
+	if (this->inputSources.size() > 0 && !AtEndOfLine()) {
+		InputSource& source = this->inputSources.back();
+		size_t lineEnd = source.text.find('\n', source.position);
+		source.position = lineEnd == std::string_view::npos ? source.text.length() : lineEnd + 1;
 	}
 }
+// Reads the next non-empty line from the line reader into the console source.  Returns false at the end of the input
+bool InputProcessor::ReadAndProcess(ExecState* pExecState) {
+	int64_t nCompileState = pExecState->GetIntTLSVariable(ExecState::c_compileStateIndex);
+
+	try
+	{
+		while (true) {
+			std::string line;
+			std::string prompt;
+			bool bInsideComment = pExecState->GetBoolTLSVariable(ExecState::c_insideCommentIndex);
 
-void InputProcessor::AddLineToHistory(const std::string& line) {
-	if (commandHistoryLine == this->commandHistory.size()) {
-		this->commandHistory.push_back(line);
-		++commandHistoryLine;
-		while (this->commandHistory.size() > this->historySize) {
-			this->commandHistory.pop_front();
-			--commandHistoryLine;
+			if (bInsideComment) {
+				prompt = pExecState->commentPrompt;
+			}
+			else if (pExecState->insideStringLiteral) {
+				prompt = pExecState->stringLiteralPrompt;
+			}
+			else if (nCompileState==1) {
+				prompt = pExecState->compilePrompt;
+			}
+			else {
+				prompt = pExecState->interpetPrompt;
+			}
+			if (!this->pLineReader->ReadLine(pExecState, prompt, line)) {
+				return false;
+			}
+
+			if (line.length() != 0) {
+				// Words from the previous line are no longer referenced, so its source is reused
+				if (this->inputSources.size() == 0 || !this->inputSources.back().fromConsole) {
+					PushInputSource(line, false);
+					this->inputSources.back().fromConsole = true;
+				}
+				InputSource& source = this->inputSources.back();
+				source.buffer = line;
+				source.text = source.buffer;
+				source.position = 0;
+				source.lastWordEnd = 0;
+				return true;
+			}
 		}
 	}
-	else if (this->commandHistory[commandHistoryLine].compare(line) == 0) {
-		// Stay on current line
-	}
-	else {
-		while (this->commandHistory.size() > this->commandHistoryLine) {
-			this->commandHistory.pop_back();
-		}
-		this->commandHistory.push_back(line);
-		++this->commandHistoryLine;
+	catch (...)
+	{
+		std::ostream* pStderr = pExecState->GetStderr();
+		(*pStderr) << "Exiting\n";
 	}
-
+	return false;
 }
 
 void InputProcessor::SetInputString(const std::string& line) {
-	this->processFromString = true;
 	this->processingFromStringFinished = false;
-	if (line.length() != 0) {
-		ProcessLine(line, ' ');
-	}
+	PushInputSource(line, true);
 }
 
 // TODO Implement BASE
-bool InputProcessor::ConvertToInt(const std::string& word, int64_t& n) {
-	if (word.find(".")!= std::string::npos || word[word.length()-1]=='f') {
-		return false;
+// Classifies and converts a number in a single pass, without allocating.  Integers are decimal, or hex or binary with
+//  a 0x or 0b prefix.  Other numbers, with a fraction or exponent, or ending in f, are floats.  Integers too large
+//  for 64 bits are read as floats.
+LiteralType InputProcessor::ClassifyLiteral(std::string_view word, int64_t& intValue, double& floatValue) {
+	const char* pStart = word.data();
+	const char* pEnd = pStart + word.length();
+	const char* pDigits = pStart;
+	bool negative = false;
+	if (pDigits != pEnd && (*pDigits == '+' || *pDigits == '-')) {
+		negative = *pDigits == '-';
+		++pDigits;
+	}
+	if (pDigits == pEnd || *pDigits == '+' || *pDigits == '-') {
+		return LiteralType_None;
 	}
+	// from_chars accepts a leading minus sign, but not a plus
+	const char* pNumber = negative ? pStart : pDigits;
 
-	char* end;
-	n = strtoll(word.c_str(), &end,10);
-	if (end == word.c_str() || *end != '\0') {
-		return false;
+	if (pEnd - pDigits > 2 && pDigits[0] == '0' && (pDigits[1] == 'x' || pDigits[1] == 'X' || pDigits[1] == 'b' || pDigits[1] == 'B')) {
+		int base = (pDigits[1] == 'x' || pDigits[1] == 'X') ? 16 : 2;
+		uint64_t magnitude;
+		std::from_chars_result result = std::from_chars(pDigits + 2, pEnd, magnitude, base);
+		if (result.ec != std::errc() || result.ptr != pEnd) {
+			return LiteralType_None;
+		}
+		// Hex and binary give the full 64 bits, so 0xffffffffffffffff is -1
+		intValue = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+		return LiteralType_Int;
 	}
-	return true;
-}
 
-bool InputProcessor::ConvertToFloat(const std::string& word, double& n) {
-	std::string convertWord = word;
-	if (word[word.length() - 1] == 'f') {
-		convertWord = word.substr(0, word.length() - 1);
+	std::from_chars_result intResult = std::from_chars(pNumber, pEnd, intValue);
+	if (intResult.ec == std::errc() && intResult.ptr == pEnd) {
+		return LiteralType_Int;
 	}
-	char* end;
-	n = strtod(convertWord.c_str(), &end);
-	if (end == convertWord.c_str() || *end != '\0') {
-		return false;
+
+	const char* pFloatEnd = pEnd;
+	if (pEnd[-1] == 'f') {
+		--pFloatEnd;
 	}
-	return true;
+	if (pFloatEnd == pDigits) {
+		return LiteralType_None;
+	}
+	std::from_chars_result floatResult = std::from_chars(pNumber, pFloatEnd, floatValue);
+	if (floatResult.ec == std::errc() && floatResult.ptr == pFloatEnd) {
+		return LiteralType_Float;
+	}
+	return LiteralType_None;
 }
 
-ForthWord* InputProcessor::FindWordInTOSWord(ExecState* pExecState, const std::string& wordName) {
+ForthWord* InputProcessor::FindWordInTOSWord(ExecState* pExecState, std::string_view wordName) {
 	TypeSystem* pTS = TypeSystem::GetTypeSystem();
 	StackElement* pElement = pExecState->pStack->TopElement();
 	int64_t nCompileState = pExecState->GetIntTLSVariable(ExecState::c_compileStateIndex);
@@ -756,14 +590,16 @@ ForthWord* InputProcessor::FindWordInTOSWord(ExecState* pExecState, const std::s
 	return nullptr;
 }
 
-ForthWord* InputProcessor::FindWordInObjectDefinition(ExecState* pExecState, const std::string& wordName) {
-	if (!pExecState->PushVariableValueOntoStack("#compileForType")) {
+ForthWord* InputProcessor::FindWordInObjectDefinition(ExecState* pExecState, std::string_view wordName) {
+	// When compiling words on objects, can use previously defined object words
+	ForthType compileForType;
+	if (!pExecState->GetVariable("#compileForType", compileForType)) {
 		pExecState->exceptionThrown = false;
 		return nullptr;
 	}
-	ForthWord* pWord = FindWordInTOSWord(pExecState, wordName);
-	StackElement* pElementType = pExecState->pStack->Pull();
-	delete pElementType;
-	pElementType = nullptr;
-	return pWord;
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	if (!pTS->TypeIsUserObject(compileForType)) {
+		return nullptr;
+	}
+	return pTS->FindWordWithName(compileForType, wordName);
 }
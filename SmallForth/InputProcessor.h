@@ -1,24 +1,39 @@
 #pragma once
-#include <list>
 #include <deque>
+#include <string_view>
 #include "ForthDefs.h"
 class ForthDict;
 class DataStack;
 class ForthWord;
+class MappedFile;
+class LineReader;
+
+enum LiteralType {
+	LiteralType_None,
+	LiteralType_Int,
+	LiteralType_Float
+};
 
 class InputProcessor
 {
 public:
 	InputProcessor();
+	~InputProcessor();
+
+	void SetLineReader(LineReader* pLineReader);
 
 	bool Interpret(ExecState* pExecState);
 	void SetInputString(const std::string& line);
+	bool IncludeFile(ExecState* pExecState, const std::string& path);
+	bool InterpretFile(ExecState* pExecState, const std::string& path);
 	InputWord GetNextWord(ExecState* pExecState);
+	bool ReadStringLiteral(ExecState* pExecState, std::string& literal);
 	char GetNextChar();
 	void ClearRestOfLine();
 
 	static bool ExecuteHaltRequested() { return s_executionToHalt; }
 	static void ResetExecutionHaltFlag() { s_executionToHalt = false; }
+	static void RequestExecutionHalt() { s_executionToHalt = true; }
 
 private:
 	void HandleException(ExecState* pExecState, const std::exception* pException, const std::string& msg);
@@ -26,46 +41,44 @@ private:
 	std::tuple<ForthWord*, bool> GetForthWordFromVocabOrObject(ExecState* pExecState);
 	bool WordMatchesXT(ForthWord* pWord, XT xtToMatch);
 
-	void ReadAndProcess(ExecState* pExecState);
-	std::string ReadLine(std::ostream* pStdout, ExecState* pExecState);
+	bool ReadAndProcess(ExecState* pExecState);
 
-	bool ConvertToInt(const std::string& word, int64_t& n);
-	bool ConvertToFloat(const std::string& word, double& n);
+	static LiteralType ClassifyLiteral(std::string_view word, int64_t& intValue, double& floatValue);
 
-	ForthWord* FindWordInTOSWord(ExecState* pExecState, const std::string& wordName);
-	ForthWord* FindWordInObjectDefinition(ExecState* pExecState, const std::string& wordName);
+	ForthWord* FindWordInTOSWord(ExecState* pExecState, std::string_view wordName);
+	ForthWord* FindWordInObjectDefinition(ExecState* pExecState, std::string_view wordName);
 
 private:
-	void ProcessLine(const std::string& line, char delimiter);
-	int ProcessScanLineCode(std::ostream* pStdout, std::string& line, int cursorPositionInLine, int scanlineCode);
-	void MoveToLineEnd(std::ostream* pStdout, std::string& line, int& cursorPositionInLine);
-	void ProcessBackspace(std::ostream* pStdout, std::string& line, int& currenmtPositionInLine);
-	int InsertIntoLine(std::ostream* pStdout, std::string& line, int cursorPositionInLine, char toInsert);
-	void WriteLineFromPosition(std::ostream* pStdout, const std::string& line, int cursorPosition, bool addExtraSpaceForDeletion);
-	void MoveToPosition(std::ostream* pStdout, const std::string& line, int currentPosition, int position);
-	void BlankCurrentLine(std::ostream* pStdout, const std::string& line, int currentPosition);
-
-	void CalculatePositionInLine(int currenmtPositionInLine, int newPosition, int& x, int& y);
-	void CalculateLineStartPosition(int currenmtPositionInLine, int& startX, int& startY);
-	void SetCursorPosition(int x, int y);
-	void GetCursorPosition(int& x, int& y);
-	void GetCursorPositionAndSize(int& x, int& y, int& width, int& height);
-	void GetConsoleSize(int& width, int& height);
-	
-	std::string MoveUpInHistory();
-	std::string MoveDownInHistory();
-	void AddLineToHistory(const std::string& line);
-
-	static int HandlerRoutine(unsigned long fdwCtrlType);
+	void PushInputSource(const std::string& text, bool endsInterpret);
+	bool PushFileSource(ExecState* pExecState, const std::string& path, bool endsInterpret);
+	void PopInputSource();
+	void AbandonIncludedFiles();
+	bool AtEndOfLine() const;
+	static bool IsDelimiter(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+	static size_t SkipDelimiters(std::string_view text, size_t position);
+	static void AppendLiteralText(std::string& literal, std::string_view text, bool& literalStarted);
 
 private:
-	std::list<InputWord> inputWords;
-	bool processFromString;
+	// Text being interpreted, tokenized lazily: each word is read from the text as it is needed, as a view into the
+	//  text rather than a copy.  A source is a console line, a string, or a memory-mapped file.  Strings interpreted
+	//  by Forth words (e.g. when defining objects) and included files are pushed on top of the line they were called
+	//  from, and popped once interpreted.
+	struct InputSource {
+		std::string buffer;
+		MappedFile* pMappedFile;
+		std::string_view text;
+		size_t position;
+		size_t lastWordEnd;
+		bool fromConsole;
+		// Interpret returns when this source is finished, rather than carrying on with the source below
+		bool endsInterpret;
+	};
+	// A deque, so pushing a source does not move the buffers that earlier words are views into
+	std::deque<InputSource> inputSources;
 	bool processingFromStringFinished;
-	int commandHistoryLine;
-	int historySize;
-	std::deque<std::string> commandHistory;
-	bool exitApplication;
+	LineReader* pLineReader;
+	// Nesting of Interpret, as words such as define interpret Forth they generate
+	int interpretDepth;
 
 	volatile static bool s_executionToHalt;
 };
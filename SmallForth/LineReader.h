@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+class ExecState;
+
+// Where the interpreter reads its input from once it has interpreted everything it was given: a console with line
+//  editing, or a plain stream such as a piped script
+class LineReader
+{
+public:
+	virtual ~LineReader() {}
+
+	// Reads the next line, showing the prompt if the reader is interactive.  Returns false at the end of the input
+	virtual bool ReadLine(ExecState* pExecState, const std::string& prompt, std::string& line) = 0;
+	// Reads a single key press, for the debugger
+	virtual char ReadChar() = 0;
+};
@@ -0,0 +1,62 @@
+#include "ForthDefs.h"
+#include <stdint.h>
+#include <new>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "MachineStack.h"
+
+#ifdef _WIN32
+MachineStack::MachineStack() {
+	this->pFiber = nullptr;
+}
+
+MachineStack::~MachineStack() {
+	if (this->pFiber != nullptr) {
+		DeleteFiber(this->pFiber);
+		this->pFiber = nullptr;
+	}
+}
+
+// Windows puts a guard page below every fiber's stack, growing the committed part into the reserved size
+void* MachineStack::CreateFiberContext(EntryPoint entry, void* pParameter) {
+	this->pFiber = CreateFiberEx(64 * 1024, c_stackSize, FIBER_FLAG_FLOAT_SWITCH, entry, pParameter);
+	if (this->pFiber == nullptr) {
+		throw std::bad_alloc();
+	}
+	return this->pFiber;
+}
+#else
+// The guard page is at the low end, as stacks grow down
+MachineStack::MachineStack() {
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	this->mappingSize = c_stackSize + pageSize;
+	void* pMapping = mmap(nullptr, this->mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pMapping == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+	this->pMapping = (char*)pMapping;
+	mprotect(this->pMapping, pageSize, PROT_NONE);
+}
+
+MachineStack::~MachineStack() {
+	munmap(this->pMapping, this->mappingSize);
+	this->pMapping = nullptr;
+}
+
+void MachineStack::MakeContext(ucontext_t* pContext, EntryPoint entry, void* pParameter) {
+	getcontext(pContext);
+	pContext->uc_stack.ss_sp = this->pMapping + (this->mappingSize - c_stackSize);
+	pContext->uc_stack.ss_size = c_stackSize;
+	pContext->uc_link = nullptr;
+	uint64_t address = (uint64_t)(uintptr_t)pParameter;
+	makecontext(pContext, (void (*)())entry, 2, (unsigned int)(address >> 32), (unsigned int)(address & 0xffffffff));
+}
+
+void* MachineStack::JoinParameter(unsigned int high, unsigned int low) {
+	return (void*)(uintptr_t)(((uint64_t)high << 32) | low);
+}
+#endif
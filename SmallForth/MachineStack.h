@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#ifndef _WIN32
+#include <ucontext.h>
+#endif
+
+// A machine stack of its own for code switched to and from on one thread: a green task or a generator.  The inner
+//  interpreter nests on the machine stack, one DoCol per word, so ExecStates running on one are given a limit on how
+//  deeply words can nest (see ExecState::maxNestingDepth) that leaves the stack plenty of room.  Beyond the stack is a
+//  page that can't be touched, so anything that still overruns it faults rather than running into the heap.
+// On POSIX the stack is mapped (only the pages used are committed) and a context made to run on it with makecontext.
+//  On Windows it is a fiber's, with the same size reserved.
+class MachineStack
+{
+public:
+#ifdef _WIN32
+	typedef void(__stdcall* EntryPoint)(void* pParameter);
+#else
+	// makecontext passes ints, so a pointer is passed in two halves.  See JoinParameter
+	typedef void (*EntryPoint)(unsigned int high, unsigned int low);
+#endif
+
+	MachineStack();
+	~MachineStack();
+
+#ifdef _WIN32
+	// Creates the fiber that runs entry.  Deleted along with the stack
+	void* CreateFiberContext(EntryPoint entry, void* pParameter);
+#else
+	// Sets up pContext to run entry on this stack
+	void MakeContext(ucontext_t* pContext, EntryPoint entry, void* pParameter);
+	static void* JoinParameter(unsigned int high, unsigned int low);
+#endif
+
+	static const size_t c_stackSize = 1024 * 1024;
+	// Well within the stack, even in unoptimised builds, where a nested word takes around 250 bytes
+	static const size_t c_maxNestingDepth = 1024;
+
+private:
+#ifdef _WIN32
+	void* pFiber;
+#else
+	char* pMapping;
+	size_t mappingSize;
+#endif
+};
@@ -0,0 +1,110 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+#ifdef _WIN32
+	this->hFile = INVALID_HANDLE_VALUE;
+	this->hMapping = nullptr;
+#else
+	this->fd = -1;
+#endif
+	this->pData = nullptr;
+	this->size = 0;
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path) {
+	Close();
+	this->hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (this->hFile == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(this->hFile, &fileSize)) {
+		Close();
+		return false;
+	}
+	this->size = (size_t)fileSize.QuadPart;
+	// Empty files cannot be mapped, and do not need to be
+	if (this->size == 0) {
+		return true;
+	}
+	this->hMapping = CreateFileMappingA(this->hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (this->hMapping == nullptr) {
+		Close();
+		return false;
+	}
+	this->pData = static_cast<const char*>(MapViewOfFile(this->hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (this->pData == nullptr) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close() {
+	if (this->pData != nullptr) {
+		UnmapViewOfFile(this->pData);
+		this->pData = nullptr;
+	}
+	if (this->hMapping != nullptr) {
+		CloseHandle(this->hMapping);
+		this->hMapping = nullptr;
+	}
+	if (this->hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(this->hFile);
+		this->hFile = INVALID_HANDLE_VALUE;
+	}
+	this->size = 0;
+}
+#else
+bool MappedFile::Open(const std::string& path) {
+	Close();
+	this->fd = open(path.c_str(), O_RDONLY);
+	if (this->fd == -1) {
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(this->fd, &fileStat) != 0) {
+		Close();
+		return false;
+	}
+	this->size = (size_t)fileStat.st_size;
+	// Empty files cannot be mapped, and do not need to be
+	if (this->size == 0) {
+		return true;
+	}
+	void* pMapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+	if (pMapped == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	// Source is read once, front to back
+	madvise(pMapped, this->size, MADV_SEQUENTIAL);
+	this->pData = static_cast<const char*>(pMapped);
+	return true;
+}
+
+void MappedFile::Close() {
+	if (this->pData != nullptr) {
+		munmap(const_cast<char*>(this->pData), this->size);
+		this->pData = nullptr;
+	}
+	if (this->fd != -1) {
+		close(this->fd);
+		this->fd = -1;
+	}
+	this->size = 0;
+}
+#endif
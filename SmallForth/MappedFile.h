@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// A file mapped read-only into memory, so its contents can be tokenized in place without being read or copied
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& path);
+	void Close();
+	std::string_view GetContents() const { return std::string_view(this->pData, this->size); }
+
+private:
+#ifdef _WIN32
+	void* hFile;
+	void* hMapping;
+#else
+	int fd;
+#endif
+	const char* pData;
+	size_t size;
+};
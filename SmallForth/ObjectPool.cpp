@@ -0,0 +1,122 @@
+#include <new>
+#include <iomanip>
+#include <cstring>
+#include "ObjectPool.h"
+
+std::mutex ObjectPool::s_spareMutex;
+
+ObjectPool::ObjectPool(const char* name, size_t blockSize) {
+	this->name = name;
+	// Blocks must be able to hold the free list link and keep every block suitably aligned
+	const size_t alignment = alignof(std::max_align_t);
+	if (blockSize < sizeof(FreeBlock)) {
+		blockSize = sizeof(FreeBlock);
+	}
+	this->blockSize = (blockSize + alignment - 1) / alignment * alignment;
+	this->pFreeList = nullptr;
+	this->pChunkCursor = nullptr;
+	this->uncarvedBlocks = 0;
+	this->allocations = 0;
+	this->reused = 0;
+	this->releases = 0;
+	this->freeBlocks = 0;
+}
+
+ObjectPool* ObjectPool::ForThread(const char* name, size_t blockSize) {
+	ThreadPools& threadPools = GetThreadPools();
+	ObjectPool* pPool = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(s_spareMutex);
+		std::vector<ObjectPool*>& sparePools = GetSparePools();
+		for (size_t n = 0; n < sparePools.size(); n++) {
+			if (strcmp(sparePools[n]->name, name) == 0) {
+				pPool = sparePools[n];
+				sparePools.erase(sparePools.begin() + n);
+				break;
+			}
+		}
+	}
+	if (pPool == nullptr) {
+		pPool = new ObjectPool(name, blockSize);
+	}
+	threadPools.pools.push_back(pPool);
+	return pPool;
+}
+
+void ObjectPool::RegisterThread() {
+	GetThreadPools();
+}
+
+std::vector<ObjectPool*>& ObjectPool::GetSparePools() {
+	// Never destroyed, as detached threads may still exit during static destruction
+	static std::vector<ObjectPool*>* pSparePools = new std::vector<ObjectPool*>();
+	return *pSparePools;
+}
+
+ObjectPool::ThreadPools& ObjectPool::GetThreadPools() {
+	static thread_local ThreadPools threadPools;
+	return threadPools;
+}
+
+// Pools are never destroyed, as blocks carved from their chunks may still be in use on other threads, and objects may
+//  still be released during static destruction
+ObjectPool::ThreadPools::~ThreadPools() {
+	std::lock_guard<std::mutex> lock(s_spareMutex);
+	std::vector<ObjectPool*>& sparePools = GetSparePools();
+	sparePools.insert(sparePools.end(), this->pools.begin(), this->pools.end());
+	this->pools.clear();
+}
+
+void ObjectPool::AllocateChunk() {
+	this->pChunkCursor = (char*)::operator new(this->blockSize * blocksPerChunk);
+	this->chunks.push_back(this->pChunkCursor);
+	this->uncarvedBlocks = blocksPerChunk;
+	this->freeBlocks += blocksPerChunk;
+}
+
+void* ObjectPool::Allocate(size_t size) {
+	if (size > this->blockSize) {
+		// A derived class larger than the type the pool was created for
+		return ::operator new(size);
+	}
+	++this->allocations;
+	--this->freeBlocks;
+	if (this->pFreeList != nullptr) {
+		++this->reused;
+		FreeBlock* pBlock = this->pFreeList;
+		this->pFreeList = pBlock->pNext;
+		return pBlock;
+	}
+	if (this->uncarvedBlocks == 0) {
+		AllocateChunk();
+	}
+	void* pBlock = this->pChunkCursor;
+	this->pChunkCursor += this->blockSize;
+	--this->uncarvedBlocks;
+	return pBlock;
+}
+
+void ObjectPool::Release(void* pBlock, size_t size) {
+	if (pBlock == nullptr) {
+		return;
+	}
+	if (size > this->blockSize) {
+		::operator delete(pBlock);
+		return;
+	}
+	++this->releases;
+	FreeBlock* pFreeBlock = (FreeBlock*)pBlock;
+	pFreeBlock->pNext = this->pFreeList;
+	this->pFreeList = pFreeBlock;
+	++this->freeBlocks;
+}
+
+void ObjectPool::WriteStatistics(std::ostream* pStream) {
+	(*pStream) << std::left << std::setw(16) << "pool" << std::right << std::setw(8) << "block" << std::setw(12) << "allocated"
+		<< std::setw(12) << "reused" << std::setw(12) << "released" << std::setw(10) << "live" << std::setw(10) << "free" << std::endl;
+	for (ObjectPool* pPool : GetThreadPools().pools) {
+		(*pStream) << std::left << std::setw(16) << pPool->name << std::right << std::setw(8) << pPool->blockSize
+			<< std::setw(12) << pPool->allocations << std::setw(12) << pPool->reused << std::setw(12) << pPool->releases
+			<< std::setw(10) << (pPool->allocations - pPool->releases) << std::setw(10) << pPool->freeBlocks << std::endl;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <mutex>
+#include <ostream>
+
+// Free-list pool of fixed size blocks, used by the frequently created object types (strings, vectors, arrays,
+//  user-defined objects and stack elements) via class specific operator new/delete.  Blocks are carved from
+//  chunks that are never returned to the heap, and a released block goes onto a free list to be reused by the
+//  next allocation of the same type without visiting the general allocator.
+// Each thread has its own pools, so allocation takes no locks.  A block released on a different thread from the one
+//  that allocated it simply joins the releasing thread's free list; chunks are never returned, so this is safe.
+//  When a thread exits its pools, chunks and free lists included, are kept on a global list of spare pools, and the
+//  next thread to need a pool of the same type adopts one, so threads coming and going don't each keep their chunks.
+class ObjectPool
+{
+	ObjectPool(const char* name, size_t blockSize);
+public:
+	// The calling thread's pool for the type, adopting a spare pool if there is one
+	static ObjectPool* ForThread(const char* name, size_t blockSize);
+	// Called before registering anything that may release blocks as the thread exits, so that the thread's pools are
+	//  handed on after it has done so
+	static void RegisterThread();
+
+	void* Allocate(size_t size);
+	void Release(void* pBlock, size_t size);
+
+	// Statistics for the calling thread's pools
+	static void WriteStatistics(std::ostream* pStream);
+
+private:
+	void AllocateChunk();
+
+private:
+	struct FreeBlock {
+		FreeBlock* pNext;
+	};
+	static const int blocksPerChunk = 64;
+
+	const char* name;
+	size_t blockSize;
+	FreeBlock* pFreeList;
+	char* pChunkCursor;
+	int uncarvedBlocks;
+	std::vector<char*> chunks;
+
+	int64_t allocations;
+	int64_t reused;
+	int64_t releases;
+	int64_t freeBlocks;
+
+	// The calling thread's pools, which are made spare when the thread exits
+	struct ThreadPools {
+		std::vector<ObjectPool*> pools;
+		~ThreadPools();
+	};
+	static ThreadPools& GetThreadPools();
+	static std::mutex s_spareMutex;
+	static std::vector<ObjectPool*>& GetSparePools();
+};
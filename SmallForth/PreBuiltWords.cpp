@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cmath>
+#include <chrono>
 #include "PreBuiltWords.h"
 #include "ExecState.h"
 #include "ForthString.h"
@@ -9,7 +11,15 @@
 #include "ForthDict.h"
 #include "ReturnStack.h"
 #include "InputProcessor.h"
+#include "DictionaryImage.h"
+#include "ForthFuture.h"
+#include "ForthChannel.h"
+#include "GreenTask.h"
+#include "ForthGenerator.h"
+#include "ForthArray.h"
 #include "WordBodyElement.h"
+#include "ObjectPool.h"
+#include "CycleCollector.h"
 
 using std::ostream;
 
@@ -17,6 +27,8 @@ void PreBuiltWords::RegisterWords(ForthDict* pDict) {
 	InitialiseImmediateWord(pDict, "(", PreBuiltWords::BuiltIn_ParenthesisCommentStart);
 	InitialiseImmediateWord(pDict, ")", PreBuiltWords::BuiltIn_ParenthesisCommentEnd);
 	InitialiseImmediateWord(pDict, "\\", PreBuiltWords::BuiltIn_LineCommentStart);
+	InitialiseWord(pDict, "include", PreBuiltWords::BuiltIn_Include);
+	InitialiseWord(pDict, "save-image", PreBuiltWords::BuiltIn_SaveImage);
 
 	InitialiseWord(pDict, "#boolvar", PreBuiltWords::BuiltIn_ThreadSafeBoolVariable);
 	InitialiseWord(pDict, "#intvar", PreBuiltWords::BuiltIn_ThreadSafeIntVariable);
@@ -42,6 +54,9 @@ void PreBuiltWords::RegisterWords(ForthDict* pDict) {
 	InitialiseWord(pDict, "#insideComment", PreBuiltWords::BuiltIn_InsideCommentState);
 	InitialiseWord(pDict, "#insideCommentLine", PreBuiltWords::BuiltIn_InsideCommentLineState);
 	InitialiseWord(pDict, "#debugState", PreBuiltWords::BuiltIn_DebugState);
+	// The type that words defined with :: are being added to.  Per ExecState, as ExecStates sharing a dictionary
+	//  compile object words concurrently
+	InitialiseWord(pDict, "#compileForType", PreBuiltWords::BuiltIn_CompileForTypeState);
 
 	InitialiseWord(pDict, "docol", PreBuiltWords::BuiltIn_DoCol);
 	InitialiseWord(pDict, "[docol]", PreBuiltWords::BuiltIn_IndirectDoCol);
@@ -130,6 +145,7 @@ void PreBuiltWords::RegisterWords(ForthDict* pDict) {
 	InitialiseImmediateWord(pDict, "here", PreBuiltWords::BuiltIn_Here);
 	InitialiseWord(pDict, "(here)", PreBuiltWords::BuiltIn_Here);
 	InitialiseWord(pDict, "forget", PreBuiltWords::BuiltIn_Forget);
+	InitialiseWord(pDict, "deploy", PreBuiltWords::BuiltIn_Deploy);
 	InitialiseWord(pDict, "see", ForthWord::BuiltIn_DescribeWord);
 
 	InitialiseImmediateWord(pDict, "does>", PreBuiltWords::BuiltIn_Does);
@@ -142,6 +158,11 @@ void PreBuiltWords::RegisterWords(ForthDict* pDict) {
 	// Low level words
 	InitialiseWord(pDict, "self", PreBuiltWords::PushSelf);
 	InitialiseWord(pDict, "#refcount", PreBuiltWords::PushRefCount);
+	InitialiseWord(pDict, "#poolstats", PreBuiltWords::BuiltIn_PoolStats);
+	InitialiseWord(pDict, "gc", PreBuiltWords::BuiltIn_CollectCycles); // ( -- )
+	InitialiseWord(pDict, "gcstep", PreBuiltWords::BuiltIn_CollectCyclesStep); // ( -- )
+	InitialiseWord(pDict, "gcbudget", PreBuiltWords::BuiltIn_SetCycleCollectionBudget); // ( n -- )
+	InitialiseWord(pDict, "#gcstats", PreBuiltWords::BuiltIn_CycleCollectionStats);
 	InitialiseWord(pDict, "quit", PreBuiltWords::Quit);
 
 	// Definitions 
@@ -156,12 +177,45 @@ void PreBuiltWords::RegisterWords(ForthDict* pDict) {
 	InitialiseWord(pDict, "tofloat", PreBuiltWords::ToFloat);
 	InitialiseWord(pDict, "wordtoint", PreBuiltWords::WordToInt);
 	InitialiseWord(pDict, "wordtofloat", PreBuiltWords::WordToFloat);
+	InitialiseWord(pDict, "typefromint", PreBuiltWords::BuiltIn_TypeFromInt); // (v addr -- )
 
 	InitialiseWord(pDict, "isObject", PreBuiltWords::IsObject);
 	InitialiseWord(pDict, "isPter", PreBuiltWords::IsPter);
 
 	// Timer and time
 	InitialiseWord(pDict, "elapsedSeconds", PreBuiltWords::BuiltIn_GetHighResolutionTime);
+
+	// Tasks on the thread pool
+	InitialiseWord(pDict, "spawn", ForthFuture::BuiltIn_Spawn); // ( a1 .. an n xt -- future )
+	InitialiseWord(pDict, "await", ForthFuture::BuiltIn_Await); // ( future|task -- r1 .. rn )
+	InitialiseWord(pDict, "isReady", ForthFuture::BuiltIn_IsReady); // ( future|task -- b )
+
+	// Channels between ExecStates.  channel_type construct ( n -- channel ) makes one for many senders and receivers
+	InitialiseWord(pDict, "spscChannel", ForthChannel::BuiltIn_SpscChannel); // ( n -- channel )
+	InitialiseWord(pDict, "send", ForthChannel::BuiltIn_Send); // ( x channel -- )
+	InitialiseWord(pDict, "recv", ForthChannel::BuiltIn_Receive); // ( channel -- x true | false )
+	InitialiseWord(pDict, "tryRecv", ForthChannel::BuiltIn_TryReceive); // ( channel -- x true | false )
+
+	// Green tasks, switched between on this thread.  await and isReady also take a task
+	InitialiseWord(pDict, "task", GreenTask::BuiltIn_Task); // ( a1 .. an n xt -- task )
+	InitialiseWord(pDict, "pause", GreenTask::BuiltIn_Pause); // ( -- )
+	InitialiseWord(pDict, "sleep", GreenTask::BuiltIn_Sleep); // ( ms -- )
+	InitialiseWord(pDict, "wake", GreenTask::BuiltIn_Wake); // ( task -- )
+
+	// Generators, resumed a value at a time
+	InitialiseWord(pDict, "generator", ForthGenerator::BuiltIn_Generator); // ( a1 .. an n xt -- generator )
+	InitialiseWord(pDict, "yield", ForthGenerator::BuiltIn_Yield); // ( x -- )
+	InitialiseWord(pDict, "next", ForthGenerator::BuiltIn_Next); // ( generator -- x true | false )
+
+	// Arrays, a whole array at a time.  The parallel words split the array between the threads of the pool
+	InitialiseWord(pDict, "array-map", ForthArray::BuiltIn_Map); // ( array xt -- array' )
+	InitialiseWord(pDict, "array-filter", ForthArray::BuiltIn_Filter); // ( array xt -- array' )
+	InitialiseWord(pDict, "array-reduce", ForthArray::BuiltIn_Reduce); // ( array x xt -- x' )
+	InitialiseWord(pDict, "array-foreach", ForthArray::BuiltIn_ForEach); // ( array xt -- )
+	InitialiseWord(pDict, "array-map-parallel", ForthArray::BuiltIn_MapParallel); // ( array xt -- array' )
+	InitialiseWord(pDict, "array-filter-parallel", ForthArray::BuiltIn_FilterParallel); // ( array xt -- array' )
+	InitialiseWord(pDict, "array-reduce-parallel", ForthArray::BuiltIn_ReduceParallel); // ( array x xt -- x' )
+	InitialiseWord(pDict, "array-foreach-parallel", ForthArray::BuiltIn_ForEachParallel); // ( array xt -- )
 }
 
 void PreBuiltWords::CreateSecondLevelWords(ExecState* pExecState) {
@@ -191,10 +245,8 @@ void PreBuiltWords::CreateSecondLevelWords(ExecState* pExecState) {
 	InterpretForth(pExecState, ": constant create postpone #literal reveal postpone does> fetchliteral postpone [ ;");
 	InterpretForth(pExecState, ": variable create postpone #literal reveal ;");
 
-	InterpretForth(pExecState, "1 type type variable #compileForType");
-
-	// Set to 2 and 3, as already defined compileState, debugState (int) and postponeState, insideComment, insideCommentLine (bool) manually
-	InterpretForth(pExecState, "2 variable #nextIntVarIndex");
+	// Set to 3 and 3, as already defined compileState, debugState, compileForType (int) and postponeState, insideComment, insideCommentLine (bool) manually
+	InterpretForth(pExecState, "3 variable #nextIntVarIndex");
 	InterpretForth(pExecState, "3 variable #nextBoolVarIndex");
 
 	InterpretForth(pExecState, ": #getNextIntVarIndex #nextIntVarIndex dup @ dup 1 + rot ! ; immediate");
@@ -521,6 +573,17 @@ bool PreBuiltWords::BuiltIn_DebugState(ExecState* pExecState) {
 	return true;
 }
 
+bool PreBuiltWords::BuiltIn_CompileForTypeState(ExecState* pExecState) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+
+	WordBodyElement** ppWBE = pExecState->GetPointerToIntStateVariable(ExecState::c_compileForTypeIndex);
+	ForthType pterType = pTS->CreatePointerTypeTo(StackElement_Type);
+	if (!pExecState->pStack->Push(pterType, ppWBE)) {
+		return pExecState->CreateStackOverflowException("whilst pushing a state type variable");
+	}
+	return true;
+}
+
 bool PreBuiltWords::BuiltIn_SetBreakpoint(ExecState* pExecState) {
 	TypeSystem* pTS = TypeSystem::GetTypeSystem();
 
@@ -650,6 +713,10 @@ bool PreBuiltWords::BuiltIn_IndirectDoCol(ExecState* pExecState) {
 bool PreBuiltWords::BuiltIn_DoCol(ExecState* pExecState) {
 	bool exitFound = false;
 
+	if (pExecState->maxNestingDepth > 0 && pExecState->subStateStack.size() > pExecState->maxNestingDepth) {
+		return pExecState->CreateException("Words nested too deeply for a task's or generator's stack");
+	}
+
 	int64_t nDebugState = pExecState->GetIntTLSVariable(ExecState::c_debugStateIndex);
 
 	if (nDebugState>0) {
@@ -709,9 +776,11 @@ bool PreBuiltWords::BuiltIn_DoCol(ExecState* pExecState) {
 				continue;
 			}
 		}
+		int nextIP = pExecState->ip;
 		pExecState->NestAndSetCFA(pCFA, 1);
 		try
 		{
+			BuiltInExecuting builtIn(pExecState, exec);
 			if (!exec(pExecState)) {
 				if (pExecState->exceptionThrown) {
 					// TODO Fix this so it reports IP stack trace properly, and is guarded by an environment variable
@@ -729,11 +798,20 @@ bool PreBuiltWords::BuiltIn_DoCol(ExecState* pExecState) {
 			throw;
 		}
 		pExecState->UnnestCFA();
+		// Jumping back is a loop, which may run for a long time without returning
+		if (pExecState->ip < nextIP) {
+			pExecState->SafePoint();
+		}
 	}
 
+	pExecState->SafePoint();
 	return true;
 }
 
+bool PreBuiltWords::RunsOtherWords(XT xt) {
+	return xt == BuiltIn_DoCol || xt == BuiltIn_IndirectDoCol || xt == BuiltIn_Execute || xt == BuiltIn_ExecuteOnObject;
+}
+
 bool PreBuiltWords::BuiltIn_DoCol_Debug(ExecState* pExecState, std::ostream* pStdoutStream, int indentation) {
 	// All comments from BuiltIn_DoCol have been removed.
 	// Extra code for debugging is highlighted
@@ -742,6 +820,8 @@ bool PreBuiltWords::BuiltIn_DoCol_Debug(ExecState* pExecState, std::ostream* pSt
 	// Added for debug code
 	//
 	int64_t nDebugState;
+	// Counted as a built-in word, so there are no safe points whilst debugging
+	BuiltInExecuting debugging(pExecState, nullptr);
 	//
 	////
 	while (!exitFound) {
@@ -885,7 +965,11 @@ bool PreBuiltWords::BuiltIn_Execute(ExecState* pExecState) {
 	pExecState->NestAndSetCFA(pWBE, 1);
 
 	XT execFirst = pExecState->pExecBody[0]->wordElement_XT;
-	bool returnValue = execFirst(pExecState);
+	bool returnValue;
+	{
+		BuiltInExecuting builtIn(pExecState, execFirst);
+		returnValue = execFirst(pExecState);
+	}
 
 	pExecState->UnnestCFA();
 
@@ -905,7 +989,11 @@ bool PreBuiltWords::BuiltIn_ExecuteOnObject(ExecState* pExecState) {
 	pExecState->NestSelfPointer(pObjToExecOn);
 	pExecState->NestAndSetCFA(pWBE, 1);
 	XT execFirst = pExecState->pExecBody[0]->wordElement_XT;
-	bool returnValue = execFirst(pExecState);
+	bool returnValue;
+	{
+		BuiltInExecuting builtIn(pExecState, execFirst);
+		returnValue = execFirst(pExecState);
+	}
 
 	pExecState->UnnestSelfPointer();
 
@@ -1079,9 +1167,45 @@ bool PreBuiltWords::PushRefCount(ExecState* pExecState) {
 	return true;
 }
 
+bool PreBuiltWords::BuiltIn_PoolStats(ExecState* pExecState) {
+	ObjectPool::WriteStatistics(pExecState->GetStdout());
+	return true;
+}
+
+// Collected objects are deleted once the outer interpreter reaches the end of the line
+bool PreBuiltWords::BuiltIn_CollectCycles(ExecState*) {
+	CycleCollector::GetCycleCollector()->Collect();
+	return true;
+}
+
+bool PreBuiltWords::BuiltIn_CollectCyclesStep(ExecState*) {
+	CycleCollector::GetCycleCollector()->CollectStep();
+	return true;
+}
+
+bool PreBuiltWords::BuiltIn_SetCycleCollectionBudget(ExecState* pExecState) {
+	if (pExecState->pStack->Count() == 0) {
+		return pExecState->CreateStackUnderflowException("whilst setting the cycle collection budget");
+	}
+	if (!pExecState->pStack->TOSIsType(StackElement_Int)) {
+		return pExecState->CreateException("gcbudget requires ( n -- ), the number of candidates to examine per step");
+	}
+	int64_t budget = pExecState->pStack->PullAsInt();
+	if (budget < 1) {
+		return pExecState->CreateException("Cycle collection budget must be at least 1");
+	}
+	CycleCollector::GetCycleCollector()->SetBudget((size_t)budget);
+	return true;
+}
+
+bool PreBuiltWords::BuiltIn_CycleCollectionStats(ExecState* pExecState) {
+	CycleCollector::GetCycleCollector()->WriteStatistics(pExecState->GetStdout());
+	return true;
+}
+
 bool PreBuiltWords::BuiltIn_WordCFAFromInputStream(ExecState* pExecState) {
 	InputWord iw = pExecState->GetNextWordFromInput();
-	std::string word = iw.word;
+	std::string word(iw.word);
 	ForthWord* pWord = pExecState->pDict->FindWord(word);
 	if (pWord == nullptr) {
 		return pExecState->CreateException("Cannot find word in dictionary");
@@ -1111,7 +1235,7 @@ bool PreBuiltWords::Quit(ExecState* pExecState) {
 // Get next word from input stream, and find it in the dictionary
 bool PreBuiltWords::BuiltIn_Find(ExecState* pExecState) {
 	InputWord iw = pExecState->GetNextWordFromInput();
-	std::string word = iw.word;
+	std::string word(iw.word);
 	return true;
 }
 
@@ -1131,12 +1255,47 @@ bool PreBuiltWords::BuiltIn_ParenthesisCommentEnd(ExecState* pExecState) {
 }
 
 bool PreBuiltWords::BuiltIn_LineCommentStart(ExecState* pExecState) {
-	if (!pExecState->SetVariable("#insideCommentLine", true)) {
-		return pExecState->CreateException("Could not set #insideCommentLine flag");
-	}
+	// The rest of the line is skipped without being split into words.  Within an included file that is up to the
+	//  next newline, so #insideCommentLine is not set as it would otherwise also skip the following lines
+	pExecState->pInputProcessor->ClearRestOfLine();
 	return true;
 }
 
+// ( $filename -- ) Interprets the file, memory-mapped, as if its text followed this word
+bool PreBuiltWords::BuiltIn_Include(ExecState* pExecState) {
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		return pExecState->CreateStackUnderflowException("whilst getting file name to include");
+	}
+	if (pElement->GetType() != ObjectType_String) {
+		delete pElement;
+		pElement = nullptr;
+		return pExecState->CreateException("include requires a string file name");
+	}
+	std::string path(((ForthString*)pElement->GetObject())->GetStringView());
+	delete pElement;
+	pElement = nullptr;
+	return pExecState->pInputProcessor->IncludeFile(pExecState, path);
+}
+
+// ( $filename -- ) Saves the dictionary, and the objects and types it uses, as an image to boot from (DictionaryImage.h)
+bool PreBuiltWords::BuiltIn_SaveImage(ExecState* pExecState) {
+	StackElement* pElement = pExecState->pStack->Pull();
+	if (pElement == nullptr) {
+		return pExecState->CreateStackUnderflowException("whilst getting image file name");
+	}
+	if (pElement->GetType() != ObjectType_String) {
+		delete pElement;
+		pElement = nullptr;
+		return pExecState->CreateException("save-image requires a string file name");
+	}
+	std::string path(((ForthString*)pElement->GetObject())->GetStringView());
+	delete pElement;
+	pElement = nullptr;
+	DictionaryImage image(pExecState);
+	return image.Save(path);
+}
+
 bool PreBuiltWords::BuiltIn_Allot(ExecState* pExecState) {
 	if (pExecState->pStack->Count() == 0) {
 		return pExecState->CreateStackUnderflowException("whilst attempting to allot cells to a word");
@@ -1178,7 +1337,7 @@ bool PreBuiltWords::BuiltIn_Create(ExecState* pExecState) {
 	// Get next word from input stream
 
 	InputWord iw = pExecState->GetNextWordFromInput();
-	std::string word = iw.word;
+	std::string word(iw.word);
 
 	pExecState->pCompiler->StartWordCreation(word);
 	pExecState->pCompiler->CompileDoesXT(pExecState, PreBuiltWords::BuiltIn_PushPter);
@@ -1231,9 +1390,32 @@ bool PreBuiltWords::BuiltIn_EndCompilation(ExecState* pExecState) {
 
 bool PreBuiltWords::BuiltIn_Forget(ExecState* pExecState) {
 	InputWord iw = pExecState->GetNextWordFromInput();
-	std::string word = iw.word;
+	std::string word(iw.word);
 
-	return pExecState->pDict->ForgetWord(word);;
+	if (!pExecState->pDict->ForgetWord(word)) {
+		return pExecState->CreateException("Cannot forget a word that is not in the dictionary");
+	}
+	return true;
+}
+
+// ( "name" -- ) Adds the word to the shared dictionary this ExecState's dictionary is layered over, so that every
+//  ExecState using the shared dictionary finds it from its next lookup, without being paused.  The word, and what it
+//  uses, become shared
+bool PreBuiltWords::BuiltIn_Deploy(ExecState* pExecState) {
+	InputWord iw = pExecState->GetNextWordFromInput();
+	std::string word(iw.word);
+
+	ForthWord* pWord = pExecState->pDict->FindWord(word);
+	if (pWord == nullptr) {
+		return pExecState->CreateException("Cannot deploy a word that is not in the dictionary");
+	}
+	ForthDict* pDict = pExecState->pDict;
+	ForthDict* pTargetDict = pDict->IsShared() ? pDict : pDict->GetSharedDict();
+	// Otherwise no other ExecState uses the dictionary, and the word is already found
+	if (pTargetDict != nullptr) {
+		pTargetDict->AddWord(pWord);
+	}
+	return true;
 }
 
 bool PreBuiltWords::BuiltIn_Postpone(ExecState* pExecState) {
@@ -1673,8 +1855,6 @@ bool PreBuiltWords::BuiltIn_TStackSize(ExecState* pExecState) {
 }
 
 bool PreBuiltWords::BuiltIn_PrintStackTop(ExecState* pExecState) {
-	bool success = true;
-
 	StackElement* pTop = pExecState->pStack->Pull();
 	if (pTop == nullptr) {
 		return pExecState->CreateStackUnderflowException();
@@ -1686,16 +1866,14 @@ bool PreBuiltWords::BuiltIn_PrintStackTop(ExecState* pExecState) {
 	}
 	delete pTop;
 	pTop = nullptr;
-	std::string str;
-	tie(success, str) = pExecState->pStack->PullAsString();
-	if (success) {
-		ostream* pStdoutStream = pExecState->GetStdout();
-		(*pStdoutStream) << str;
-		return true;
-	}
-	else {
-		return pExecState->CreateException(str.c_str());
+	if (pExecState->pStack->GetTOSType() != ObjectType_String) {
+		return pExecState->CreateException("No string on stack");
 	}
+	ForthString* pString = (ForthString*)pExecState->pStack->PullAsObject();
+	ostream* pStdoutStream = pExecState->GetStdout();
+	(*pStdoutStream) << pString->GetStringView();
+	pString->DecReference();
+	return true;
 }
 
 bool PreBuiltWords::BuiltIn_Emit(ExecState* pExecState) {
@@ -2166,10 +2344,8 @@ bool PreBuiltWords::BuiltIn_ThrowException(ExecState* pExecState) {
 }
 
 bool PreBuiltWords::BuiltIn_GetHighResolutionTime(ExecState* pExecState) {
-	int64_t freq = _Query_perf_frequency();
-	int64_t time = _Query_perf_counter();
-
-	double elapsedSeconds = (double)time / (double)freq;
+	auto time = std::chrono::steady_clock::now().time_since_epoch();
+	double elapsedSeconds = std::chrono::duration<double>(time).count();
 	if (!pExecState->pStack->Push(elapsedSeconds)) {
 		return pExecState->CreateStackOverflowException("whilst getting high resolution time");
 	}
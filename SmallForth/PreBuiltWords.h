@@ -35,11 +35,14 @@ public:
 	static bool BuiltIn_InsideCommentState(ExecState* pExecState);
 	static bool BuiltIn_InsideCommentLineState(ExecState* pExecState);
 	static bool BuiltIn_DebugState(ExecState* pExecState);
+	static bool BuiltIn_CompileForTypeState(ExecState* pExecState);
 	static bool BuiltIn_SetBreakpoint(ExecState* pExecState);
 	static bool BuiltIn_RemoveBreakpoint(ExecState* pExecState);
 	static bool BuiltIn_ToggleBreakpoint(ExecState* pExecState);
 
 	static bool BuiltIn_DoCol(ExecState* pExecState);
+	// True for DoCol and the like, which hold nothing uncounted whilst the words they run execute
+	static bool RunsOtherWords(XT xt);
 	static bool BuiltIn_Immediate(ExecState* pExecState);
 	static bool BuiltIn_Here(ExecState* pExecState);
 	static bool BuiltIn_Execute(ExecState* pExecState);
@@ -51,6 +54,11 @@ public:
 	static bool BuiltIn_JumpOnFalse(ExecState* pExecState);
 	static bool BuiltIn_PokeIntegerInWord(ExecState* pExecState);
 	static bool PushRefCount(ExecState* pExecState);
+	static bool BuiltIn_PoolStats(ExecState* pExecState);
+	static bool BuiltIn_CollectCycles(ExecState* pExecState);
+	static bool BuiltIn_CollectCyclesStep(ExecState* pExecState);
+	static bool BuiltIn_SetCycleCollectionBudget(ExecState* pExecState);
+	static bool BuiltIn_CycleCollectionStats(ExecState* pExecState);
 	static bool BuiltIn_WordCFAFromInputStream(ExecState* pExecState);
 	static bool BuiltIn_WordCFAFromDefinition(ExecState* pExecState);
 	static bool Quit(ExecState* pExecState);
@@ -60,6 +68,8 @@ public:
 	static bool BuiltIn_ParenthesisCommentStart(ExecState* pExecState);
 	static bool BuiltIn_ParenthesisCommentEnd(ExecState* pExecState);
 	static bool BuiltIn_LineCommentStart(ExecState* pExecState);
+	static bool BuiltIn_Include(ExecState* pExecState);
+	static bool BuiltIn_SaveImage(ExecState* pExecState);
 
 	// Definitions 
 	static bool BuiltIn_Allot(ExecState* pExecState);
@@ -71,6 +81,7 @@ public:
 	static bool BuiltIn_StartCompilation(ExecState* pExecState);
 	static bool BuiltIn_EndCompilation(ExecState* pExecState);
 	static bool BuiltIn_Forget(ExecState* pExecState);
+	static bool BuiltIn_Deploy(ExecState* pExecState);
 	// When compiling, the next word won't be executed, it will be compiled into the new word
 	//  Even if executing a docol, the postpone command will compile the next word into the command being compiled (if the docol is involved in compiling a word).
 	static bool BuiltIn_Postpone(ExecState* pExecState);
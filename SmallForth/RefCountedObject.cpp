@@ -1,29 +1,53 @@
 #include <iostream>
+#include <unordered_set>
 #include "RefCountedObject.h"
 #include "ForthDict.h"
+#include "ForthWord.h"
 #include "ForthString.h"
+#include "ZeroCountTable.h"
+#include "CycleCollector.h"
 
 using std::string;
 
+// Zero until the thread first asks for its id, which no object is owned by
+static thread_local uint32_t t_threadId = 0;
+static std::atomic<uint32_t> s_nextThreadId(1);
+
+uint32_t RefCountedObject::GetThreadId() {
+	if (t_threadId == 0) {
+		t_threadId = s_nextThreadId.fetch_add(1);
+	}
+	return t_threadId;
+}
+
 RefCountedObject::RefCountedObject() {
 	this->referenceCount = 0;
+	this->ownerThread.store(GetThreadId(), std::memory_order_relaxed);
+	this->sharedCount.store(0, std::memory_order_relaxed);
+	this->escaped.store(false, std::memory_order_relaxed);
+	this->shared = false;
+	this->inZeroCountTable = false;
+	this->cycleCandidate = false;
+	this->cycleColour = 0;
+	this->canReferenceObjects = false;
 	this->pDictionary = nullptr;
 	this->objectType = ValueType_Undefined;
-	this->markedByReferenceCounter = false;
 }
 
 RefCountedObject::RefCountedObject(ForthDict* pDict) :
 RefCountedObject() {
-	if (pDict == nullptr) {
-		InitialiseDictionary();
-	}
-	else {
+	// A null dictionary is left unallocated until a word is added, so plain values (strings, words, files, arrays)
+	//  carry no dictionary
+	if (pDict != nullptr) {
 		pDictionary = pDict;
 		pDictionary->IncReference();
 	}
 }
 
 RefCountedObject::~RefCountedObject() {
+	if (this->cycleCandidate) {
+		CycleCollector::GetCycleCollector()->RemoveCandidate(this);
+	}
 	if (this->pDictionary != nullptr) {
 		this->pDictionary->DecReference();
 		this->pDictionary = nullptr;
@@ -38,47 +62,210 @@ void RefCountedObject::InitialiseDictionary() {
 }
 
 void RefCountedObject::IncReference() {
-	// TODO Add atomic increment
-
-	++this->referenceCount;
+	if (this->ownerThread.load(std::memory_order_relaxed) == t_threadId) {
+		++this->referenceCount;
+		return;
+	}
+	IncSharedReference(1);
 }
 
 void RefCountedObject::DecReference() {
-	// TODO Add atomic decrement
-
+	if (this->ownerThread.load(std::memory_order_relaxed) != t_threadId) {
+		DecSharedReference(1);
+		return;
+	}
 	--this->referenceCount;
 	if (this->referenceCount == 0) {
-		delete this;
+		if (IsEscaped()) {
+			Merge(false);
+		}
+		else {
+			// Stack references are not counted, so this may still be on a stack.  Deletion is deferred to the next reconciliation
+			ZeroCountTable::GetZeroCountTable()->Add(this);
+		}
+	}
+	else if (this->canReferenceObjects && !IsEscaped()) {
+		// Still referenced, possibly only from within a cycle
+		CycleCollector::GetCycleCollector()->AddCandidate(this);
 	}
 }
 
 void RefCountedObject::IncReferenceBy(int by) {
-	// TODO Add atomic increment
-	this->referenceCount += by;
+	if (this->ownerThread.load(std::memory_order_relaxed) == t_threadId) {
+		this->referenceCount += by;
+		return;
+	}
+	IncSharedReference(by);
 }
 
 void RefCountedObject::DecReferenceBy(int by) {
-	// TODO Add atomic decrement
+	if (this->ownerThread.load(std::memory_order_relaxed) != t_threadId) {
+		DecSharedReference(by);
+		return;
+	}
 	this->referenceCount -= by;
 	if (this->referenceCount <= 0) {
-		delete this;
+		if (IsEscaped()) {
+			Merge(false);
+		}
+		else {
+			ZeroCountTable::GetZeroCountTable()->Add(this);
+		}
+	}
+	else if (this->canReferenceObjects && !IsEscaped()) {
+		CycleCollector::GetCycleCollector()->AddCandidate(this);
+	}
+}
+
+// References from threads other than the owner, to an escaped or shared object
+void RefCountedObject::IncSharedReference(int by) {
+	if (this->shared) {
+		return;
+	}
+	this->sharedCount.fetch_add(by * c_sharedCountUnit, std::memory_order_relaxed);
+}
+
+void RefCountedObject::DecSharedReference(int by) {
+	if (this->shared) {
+		return;
+	}
+	int32_t oldValue = this->sharedCount.load(std::memory_order_relaxed);
+	int32_t newValue;
+	do {
+		newValue = oldValue - by * c_sharedCountUnit;
+		// Below zero, the owner holds the rest of the references.  Only the owner can tell when they are all gone
+		if ((newValue & c_sharedMerged) == 0 && SharedCountOf(newValue) < 0) {
+			newValue |= c_sharedQueued;
+		}
+	} while (!this->sharedCount.compare_exchange_weak(oldValue, newValue, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+	if ((newValue & c_sharedMerged) != 0) {
+		if ((newValue & c_sharedQueued) == 0 && SharedCountOf(newValue) == 0) {
+			// The last reference.  A thread with the object on a stack holds a reference, so it is on no stack
+			ZeroCountTable::GetZeroCountTable()->Add(this);
+		}
+	}
+	else if ((oldValue & c_sharedQueued) == 0 && (newValue & c_sharedQueued) != 0) {
+		ZeroCountTable::QueueForOwner(this, this->ownerThread.load(std::memory_order_acquire));
 	}
 }
 
+// On the owning thread, folds the owner's count into the shared count and gives up ownership, so from now on every
+//  thread uses the shared count.  Elsewhere (once merged) only clears the queued flag.  A queued object is left for
+//  whoever processes the queue, otherwise whoever leaves a merged object with no references releases it
+void RefCountedObject::Merge(bool clearQueued) {
+	bool owned = this->ownerThread.load(std::memory_order_relaxed) == t_threadId;
+	int32_t oldValue = this->sharedCount.load(std::memory_order_relaxed);
+	int32_t newValue;
+	do {
+		newValue = oldValue;
+		if (clearQueued) {
+			newValue &= ~c_sharedQueued;
+		}
+		if (owned) {
+			newValue = (newValue + this->referenceCount * c_sharedCountUnit) | c_sharedMerged;
+		}
+	} while (!this->sharedCount.compare_exchange_weak(oldValue, newValue, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+	ZeroCountTable* pZCT = ZeroCountTable::GetZeroCountTable();
+	if (owned) {
+		this->referenceCount = 0;
+		this->ownerThread.store(c_noOwner, std::memory_order_release);
+		pZCT->RemoveEscaped(this);
+	}
+	if ((newValue & c_sharedMerged) != 0 && (newValue & c_sharedQueued) == 0 && SharedCountOf(newValue) == 0) {
+		pZCT->Add(this);
+	}
+}
+
+// Marks everything reachable from the roots as escaped, on the thread that owns them.  Everything is checked before
+//  anything is marked, so nothing is marked if any of it can't escape
+bool RefCountedObject::EscapeObjects(std::vector<RefCountedObject*>& roots) {
+	std::vector<RefCountedObject*> toEscape;
+	std::unordered_set<RefCountedObject*> visited;
+	std::vector<RefCountedObject*> toVisit = roots;
+	while (toVisit.size() > 0) {
+		RefCountedObject* pObject = toVisit.back();
+		toVisit.pop_back();
+		// An escaped object's children escaped with it
+		if (pObject == nullptr || pObject->shared || pObject->IsEscaped() || !visited.insert(pObject).second) {
+			continue;
+		}
+		if (!pObject->CanEscape()) {
+			return false;
+		}
+		toEscape.push_back(pObject);
+		pObject->AddChildObjects(toVisit);
+	}
+
+	ZeroCountTable* pZCT = ZeroCountTable::GetZeroCountTable();
+	std::unordered_set<RefCountedObject*> onStacks;
+	pZCT->AddObjectsOnStacks(onStacks);
+	for (RefCountedObject* pObject : toEscape) {
+		pObject->escaped.store(true, std::memory_order_relaxed);
+		// Its count alone no longer says whether it is garbage
+		CycleCollector::GetCycleCollector()->RemoveCandidate(pObject);
+		pZCT->AddEscaped(pObject);
+		if (onStacks.find(pObject) != onStacks.end()) {
+			pZCT->Pin(pObject);
+		}
+	}
+	return true;
+}
+
+// Marks everything reachable from the roots as shared: words in dictionaries, the words and objects each word
+//  refers to, objects' method dictionaries and the objects they contain
+void RefCountedObject::ShareObjects(std::vector<RefCountedObject*>& roots) {
+	std::vector<RefCountedObject*> toVisit = roots;
+	std::vector<RefCountedObject*> children;
+	std::vector<std::vector<ForthWord*>> chains;
+	while (toVisit.size() > 0) {
+		RefCountedObject* pObject = toVisit.back();
+		toVisit.pop_back();
+		// Escaped objects are already safe to count from any thread
+		if (pObject == nullptr || pObject->shared || pObject->IsEscaped()) {
+			continue;
+		}
+		pObject->shared = true;
+		pObject->ownerThread.store(c_noOwner, std::memory_order_relaxed);
+
+		children.clear();
+		pObject->AddChildObjects(children);
+		if (pObject->objectType == ObjectType_Word) {
+			((ForthWord*)pObject)->AddReferencedObjects(children);
+		}
+		else if (pObject->objectType == ObjectType_Dict) {
+			chains.clear();
+			((ForthDict*)pObject)->GetWordChains(chains);
+			for (std::vector<ForthWord*>& chain : chains) {
+				children.insert(children.end(), chain.begin(), chain.end());
+			}
+		}
+		if (pObject->pDictionary != nullptr) {
+			children.push_back(pObject->pDictionary);
+		}
+		toVisit.insert(toVisit.end(), children.begin(), children.end());
+	}
+}
 
 int RefCountedObject::GetCurrentReferenceCount() {
-	return this->referenceCount;
+	if (!IsEscaped()) {
+		return this->referenceCount;
+	}
+	// Only a snapshot, as other threads may be changing the shared count
+	int count = SharedCountOf(this->sharedCount.load(std::memory_order_acquire));
+	if (this->ownerThread.load(std::memory_order_relaxed) == t_threadId) {
+		count += this->referenceCount;
+	}
+	return count;
 }
 
 void RefCountedObject::AddWord(ForthWord* pWordToAdd) {
-	if (this->pDictionary == nullptr) {
-		this->pDictionary = new ForthDict();
-		this->pDictionary->IncReference();
-	}
+	InitialiseDictionary();
 	pDictionary->AddWord(pWordToAdd);
 }
 
-ForthWord* RefCountedObject::GetWordWithName(const string& wordName) const {
+ForthWord* RefCountedObject::GetWordWithName(std::string_view wordName) const {
 	if (this->pDictionary != nullptr) {
 		return this->pDictionary->FindWord(wordName);
 	}
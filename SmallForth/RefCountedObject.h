@@ -1,5 +1,8 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
 #include "ForthDefs.h"
 class ExecState;
 class ForthWord;
@@ -25,22 +28,66 @@ public:
 	virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke) = 0;
 
 	void AddWord(ForthWord* pWordToAdd);
-	ForthWord* GetWordWithName(const std::string& wordName) const;
+	ForthWord* GetWordWithName(std::string_view wordName) const;
 	int GetWordCount() const;
 
-	void MarkForReferenceCounter(bool mark) { this->markedByReferenceCounter = mark; }
-	bool GetMarkForReferenceCounter() const { return this->markedByReferenceCounter; }
+	// Shared objects are immortal: once a dictionary is shared between threads (ForthDict::Share) its words and the
+	//  objects they refer to are used by every thread, so their counts are no longer changed and they are never deleted
+	bool IsShared() const { return this->shared; }
+	static void ShareObjects(std::vector<RefCountedObject*>& roots);
+
+	// Biased reference counting.  An object is owned by the thread that created it, which counts its references
+	//  without atomic operations.  Once it escapes to an ExecState on another thread (passed to or returned from a
+	//  task), other threads count their references in a separate atomic count.  When the owner's count reaches zero it
+	//  merges it into the atomic count and gives up ownership; if another thread takes the atomic count below zero
+	//  first, the object is queued for its owner to merge at its next safe point (see ZeroCountTable).
+	// Escaping marks everything reachable from the roots, and fails if any of it is a type that can't escape.  Each
+	//  thread holds a counted reference to an escaped object whilst it is on one of its stacks, as stack references
+	//  are not counted
+	bool IsEscaped() const { return this->escaped.load(std::memory_order_relaxed); }
+	virtual bool CanEscape() const { return false; }
+	static bool EscapeObjects(std::vector<RefCountedObject*>& roots);
+	void Merge(bool clearQueued);
+	static uint32_t GetThreadId();
+
+	bool InZeroCountTable() const { return this->inZeroCountTable; }
+	void SetInZeroCountTable(bool inTable) { this->inZeroCountTable = inTable; }
+
+	// Objects that can refer to other objects (set canReferenceObjects) report them for cycle collection, and
+	//  release them when collected as part of a garbage cycle
+	virtual void AddChildObjects(std::vector<RefCountedObject*>& /*children*/) const { }
+	virtual void ReleaseChildObjects() { }
 protected:
 	void InitialiseDictionary();
 	int GetReferenceCount() const { return referenceCount; }
 
 private:
+	void IncSharedReference(int by);
+	void DecSharedReference(int by);
+
+	static const uint32_t c_noOwner = 0xffffffff;
+	// The shared count is held in steps of c_sharedCountUnit, leaving the low bits for these flags
+	static const int32_t c_sharedCountUnit = 4;
+	static const int32_t c_sharedMerged = 1;
+	static const int32_t c_sharedQueued = 2;
+	static int32_t SharedCountOf(int32_t sharedValue) { return (sharedValue & ~(c_sharedMerged | c_sharedQueued)) / c_sharedCountUnit; }
+
+private:
+	friend class CycleCollector;
+	// Counted by the owning thread only
 	int referenceCount;
+	std::atomic<uint32_t> ownerThread;
+	std::atomic<int32_t> sharedCount;
+	std::atomic<bool> escaped;
+	bool shared;
+	bool inZeroCountTable;
+	bool cycleCandidate;
+	uint8_t cycleColour;
 
 protected:
 	uint32_t objectType;
+	bool canReferenceObjects;
 
 	ForthDict* pDictionary;
-	bool markedByReferenceCounter;
 };
 
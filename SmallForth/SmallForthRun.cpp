@@ -0,0 +1,78 @@
+#include "ForthDefs.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "InputProcessor.h"
+#include "ForthDict.h"
+#include "ExecState.h"
+#include "Bootstrap.h"
+
+// Runs a script on a thread of its own, with its own ExecState layered over the shared dictionary
+static void RunScriptOnThread(ForthDict* pSharedDict, const char* pzPath, bool* pSucceeded) {
+    ExecState* pExecState = Bootstrap::CreateExecState(pSharedDict);
+    *pSucceeded = pExecState->pInputProcessor->InterpretFile(pExecState, pzPath);
+    Bootstrap::DeleteExecState(pExecState);
+}
+
+// Batch runner: smallforth-run [-image <file>] [-parallel] [script.fs ...]
+//  Interprets each script in turn, or standard input if none are named, then exits.  There is no console handling,
+//  so input can be piped in.  With -parallel the initialised dictionary is shared and each script runs at the same
+//  time on its own thread; definitions made by one script are not seen by the others unless deployed.  Returns 1 if a
+//  script could not be opened or did not finish cleanly.
+int main(int argc, char* argv[])
+{
+    ExecState* pExecState = Bootstrap::CreateExecState(nullptr);
+    ForthDict* pDict = pExecState->pDict;
+    InputProcessor* pProcessor = pExecState->pInputProcessor;
+
+    Bootstrap::InitialiseTypeSystem(pExecState);
+
+    int firstFile = 1;
+    if (argc > 2 && std::string(argv[1]) == "-image") {
+        if (!Bootstrap::InitialiseDictFromImage(pExecState, argv[2])) {
+            return 1;
+        }
+        firstFile = 3;
+    }
+    else {
+        Bootstrap::InitialiseDict(pExecState);
+    }
+    bool parallel = false;
+    if (firstFile < argc && std::string(argv[firstFile]) == "-parallel") {
+        parallel = true;
+        ++firstFile;
+    }
+
+    bool succeeded = true;
+    if (parallel) {
+        pDict->Share();
+        std::vector<std::thread> threads;
+        // Not std::vector<bool>, as each thread writes its own element
+        bool* pSucceeded = new bool[argc];
+        for (int n = firstFile; n < argc; n++) {
+            threads.emplace_back(RunScriptOnThread, pDict, argv[n], pSucceeded + n);
+        }
+        for (int n = firstFile; n < argc; n++) {
+            threads[n - firstFile].join();
+            if (!pSucceeded[n]) {
+                succeeded = false;
+            }
+        }
+        delete[] pSucceeded;
+    }
+    else if (firstFile < argc) {
+        for (int n = firstFile; n < argc; n++) {
+            if (!pProcessor->InterpretFile(pExecState, argv[n])) {
+                succeeded = false;
+            }
+        }
+    }
+    else {
+        // The default line reader reads standard input without prompts
+        succeeded = pProcessor->Interpret(pExecState);
+    }
+    std::cout.flush();
+
+    Bootstrap::DeleteExecState(pExecState);
+    return succeeded ? 0 : 1;
+}
@@ -6,6 +6,8 @@
 #include "ForthString.h"
 #include <sstream>
 #include "WordBodyElement.h"
+#include "ObjectPool.h"
+#include "ZeroCountTable.h"
 
 #include "enumPrinters.h"
 
@@ -219,6 +221,19 @@ StackElement::~StackElement() {
 	pTS->DecReferenceForPter(elementType, this->valuePter);
 }
 
+static ObjectPool* GetStackElementPool() {
+	static thread_local ObjectPool* pPool = ObjectPool::ForThread("stackelement", sizeof(StackElement));
+	return pPool;
+}
+
+void* StackElement::operator new(size_t size) {
+	return GetStackElementPool()->Allocate(size);
+}
+
+void StackElement::operator delete(void* pBlock, size_t size) {
+	GetStackElementPool()->Release(pBlock, size);
+}
+
 StackElement::StackElement(char c) {
 	elementType = StackElement_Char;
 	valueChar = c;
@@ -388,6 +403,65 @@ void StackElement::SetTo(ForthType forthType, void* value) {
 	}
 }
 
+void StackElement::CopyUncounted(const StackElement& element) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	RelinquishUncountedValue();
+	this->elementType = element.elementType;
+	// Copying the widest member of the union copies whichever value it holds
+	this->valueInt64 = element.valueInt64;
+	static_assert(sizeof(int64_t) >= sizeof(void*), "StackElement union copy assumes pointers fit in 64 bits");
+	if (pTS->IsPter(this->elementType) && this->valuePter != nullptr) {
+		pTS->IncReferenceForPter(this->elementType, this->valuePter);
+	}
+	else {
+		RefCountedObject* pObject = GetDirectObject();
+		if (pObject != nullptr && pObject->IsEscaped()) {
+			ZeroCountTable::GetZeroCountTable()->Pin(pObject);
+		}
+	}
+}
+
+void StackElement::SetToUncounted(RefCountedObject* value) {
+	SetToUncounted(value->GetObjectTypeId(), value);
+}
+
+void StackElement::SetToUncounted(ForthType forthType, RefCountedObject* value) {
+	this->elementType = forthType;
+	this->valuePter = static_cast<void*>(value);
+	if (value != nullptr && value->IsEscaped()) {
+		// Another thread may drop its references whilst this is on the stack
+		ZeroCountTable::GetZeroCountTable()->Pin(value);
+	}
+}
+
+void StackElement::RelinquishUncountedValue() {
+	RefCountedObject* pObject = GetDirectObject();
+	if (pObject != nullptr) {
+		// Escaped objects are counted whilst on the stack (see ZeroCountTable)
+		if (!pObject->IsEscaped() && pObject->GetCurrentReferenceCount() <= 0) {
+			// Possibly the last reference; the zero count table will delete it if it is not on another stack
+			ZeroCountTable::GetZeroCountTable()->Add(pObject);
+		}
+		this->valuePter = nullptr;
+		this->elementType = StackElement_Undefined;
+	}
+	else {
+		RelinquishValue();
+	}
+}
+
+void StackElement::SwapUncounted(StackElement& element) {
+	std::swap(this->elementType, element.elementType);
+	std::swap(this->valueInt64, element.valueInt64);
+}
+
+RefCountedObject* StackElement::GetDirectObject() const {
+	if (TypeSystem::IsPter(this->elementType) || !TypeSystem::GetTypeSystem()->TypeIsObject(this->elementType)) {
+		return nullptr;
+	}
+	return static_cast<RefCountedObject*>(this->valuePter);
+}
+
 void StackElement::RelinquishValue() {
 	if (elementType == StackElement_Undefined) {
 		return;
@@ -689,6 +763,7 @@ WordBodyElement* StackElement::GetValueAsWordBodyElement() const {
 			case StackElement_Float: pWBE->wordElement_float = this->valueDouble; break;
 			case StackElement_Bool: pWBE->wordElement_bool = this->valueBool; break;
 			case StackElement_Type: pWBE->forthType = this->valueType; break;
+			case StackElement_PterToCFA: pWBE->wordElement_BodyPter = this->valueWordBodyPter; break;
 			}
 		}
 	}
@@ -27,6 +27,9 @@ public:
 	StackElement(ForthType forthType, void* pter);
 	~StackElement();
 
+	static void* operator new(size_t size);
+	static void operator delete(void* pBlock, size_t size);
+
 	void SetTo(char value);
 	void SetTo(int64_t value);
 	void SetTo(double value);
@@ -40,6 +43,16 @@ public:
 	void SetTo(ForthType forthType, void* value);
 	void RelinquishValue();
 
+	// Stack slots do not hold counted references to objects (see ZeroCountTable).  Pointer types remain counted.
+	void CopyUncounted(const StackElement& element);
+	void SetToUncounted(RefCountedObject* value);
+	void SetToUncounted(ForthType forthType, RefCountedObject* value);
+	void RelinquishUncountedValue();
+	void SwapUncounted(StackElement& element);
+
+	// The object held directly (not through a pointer), or nullptr
+	RefCountedObject* GetDirectObject() const;
+
 
 	ForthType GetType() const { return elementType; }
 	char GetChar() const;
@@ -68,6 +81,7 @@ public:
 	bool ToString(ExecState* pExecState) const;
 
 private: 
+	friend class DictionaryImage;
 	bool PokeObjectIntoContainedPter(ExecState* pExecState, StackElement* pValueElement);
 	bool PokeValueIntoContainedPter(ExecState* pExecState, StackElement* pValueElement);
 
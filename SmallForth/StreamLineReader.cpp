@@ -0,0 +1,35 @@
+#include "ForthDefs.h"
+#include <string>
+#include "StreamLineReader.h"
+#include "ExecState.h"
+
+StreamLineReader::StreamLineReader(std::istream* pStream, bool showPrompts) {
+	this->pStream = pStream;
+	this->showPrompts = showPrompts;
+}
+
+bool StreamLineReader::ReadLine(ExecState* pExecState, const std::string& prompt, std::string& line) {
+	if (this->showPrompts) {
+		std::ostream* pStdout = pExecState->GetStdout();
+		(*pStdout) << prompt;
+		pStdout->flush();
+	}
+	if (!std::getline(*this->pStream, line)) {
+		return false;
+	}
+	// Lines ending CR LF, from a file written on Windows
+	if (line.length() > 0 && line.back() == '\r') {
+		line.pop_back();
+	}
+	return true;
+}
+
+// Newlines are skipped, as a key press only reaches the stream once return has been pressed.  The end of the stream
+//  reads as 0, which the debugger treats as a step
+char StreamLineReader::ReadChar() {
+	int c = this->pStream->get();
+	while (c == '\n' || c == '\r') {
+		c = this->pStream->get();
+	}
+	return c == std::char_traits<char>::eof() ? 0 : (char)c;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <istream>
+#include "LineReader.h"
+
+// Reads whole lines from a stream, with no console handling, so the interpreter can be driven from a pipe or file
+class StreamLineReader : public LineReader
+{
+public:
+	StreamLineReader(std::istream* pStream, bool showPrompts);
+
+	virtual bool ReadLine(ExecState* pExecState, const std::string& prompt, std::string& line) override;
+	virtual char ReadChar() override;
+
+private:
+	std::istream* pStream;
+	bool showPrompts;
+};
@@ -0,0 +1,114 @@
+#include "ThreadPool.h"
+
+ThreadPool* ThreadPool::s_pThreadPool;
+std::once_flag ThreadPool::s_created;
+thread_local int ThreadPool::t_workerIndex = -1;
+
+ThreadPool* ThreadPool::GetThreadPool() {
+	// Tasks can be spawned from any thread, including the pool's own
+	std::call_once(s_created, []() {
+		unsigned int workerCount = std::thread::hardware_concurrency();
+		s_pThreadPool = new ThreadPool(workerCount > 0 ? workerCount : 2);
+	});
+	return s_pThreadPool;
+}
+
+ThreadPool::ThreadPool(size_t workerCount) {
+	this->nextQueue = 0;
+	this->pendingTasks = 0;
+	this->workerCount = 0;
+	this->blockedWorkers = 0;
+	this->nextWorkerIndex = 0;
+	for (size_t n = 0; n < workerCount; n++) {
+		this->queues.push_back(new WorkQueue());
+	}
+	std::lock_guard<std::mutex> lock(this->idleMutex);
+	for (size_t n = 0; n < workerCount; n++) {
+		StartWorker();
+	}
+}
+
+// Called with idleMutex held
+void ThreadPool::StartWorker() {
+	++this->workerCount;
+	// Workers run until the process exits, or (beyond the original number) until not needed
+	std::thread(&ThreadPool::WorkerLoop, this, this->nextWorkerIndex++).detach();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+	size_t queueIndex = (t_workerIndex >= 0 ? t_workerIndex : this->nextQueue.fetch_add(1)) % this->queues.size();
+	WorkQueue* pQueue = this->queues[queueIndex];
+	{
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		pQueue->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->idleMutex);
+		++this->pendingTasks;
+		if (this->blockedWorkers == this->workerCount) {
+			StartWorker();
+		}
+	}
+	this->workAvailable.notify_one();
+}
+
+void ThreadPool::BeginBlocking() {
+	if (t_workerIndex < 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(this->idleMutex);
+	++this->blockedWorkers;
+	if (this->blockedWorkers == this->workerCount && this->pendingTasks > 0) {
+		StartWorker();
+	}
+}
+
+void ThreadPool::EndBlocking() {
+	if (t_workerIndex < 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(this->idleMutex);
+	--this->blockedWorkers;
+}
+
+// Takes the newest task from the worker's own queue, otherwise steals the oldest from another queue
+bool ThreadPool::TakeTask(int workerIndex, std::function<void()>& task) {
+	size_t queueCount = this->queues.size();
+	for (size_t n = 0; n < queueCount; n++) {
+		WorkQueue* pQueue = this->queues[(workerIndex + n) % queueCount];
+		std::lock_guard<std::mutex> lock(pQueue->mutex);
+		if (pQueue->tasks.size() > 0) {
+			if (n == 0) {
+				task = std::move(pQueue->tasks.back());
+				pQueue->tasks.pop_back();
+			}
+			else {
+				task = std::move(pQueue->tasks.front());
+				pQueue->tasks.pop_front();
+			}
+			std::lock_guard<std::mutex> idleLock(this->idleMutex);
+			--this->pendingTasks;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::WorkerLoop(int workerIndex) {
+	t_workerIndex = workerIndex;
+	std::function<void()> task;
+	while (true) {
+		if (TakeTask(workerIndex, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(this->idleMutex);
+		if (this->pendingTasks == 0 && (size_t)workerIndex >= this->queues.size() && this->workerCount - this->blockedWorkers > this->queues.size()) {
+			// An extra worker, started whilst others waited, that is no longer needed
+			--this->workerCount;
+			return;
+		}
+		this->workAvailable.wait(lock, [this]() { return this->pendingTasks > 0; });
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Work-stealing pool of threads, used to run tasks spawned from Forth (see ForthFuture).  Each worker has its own
+//  queue: tasks submitted from a worker go on that worker's queue, which it takes from newest first, and tasks
+//  submitted from any other thread are dealt out between the queues in turn.  A worker with nothing queued steals
+//  the oldest task from another worker's queue.
+// The pool is created on first use with a worker per hardware thread, and lives until the process exits.
+// A task can wait for another task (await, or a channel), which may be queued behind it.  So a worker that is about to
+//  wait says so, and if every worker is then waiting and tasks are queued, another worker is started.  Workers beyond
+//  the original number share the original queues, and exit once they are idle and no longer needed.
+class ThreadPool
+{
+	ThreadPool(size_t workerCount);
+public:
+	static ThreadPool* GetThreadPool();
+
+	void Submit(std::function<void()> task);
+	// Bracket a wait on another task.  Does nothing off the pool's threads
+	void BeginBlocking();
+	void EndBlocking();
+	static bool OnWorkerThread() { return t_workerIndex >= 0; }
+	size_t GetWorkerCount() const { return this->queues.size(); }
+
+private:
+	struct WorkQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void WorkerLoop(int workerIndex);
+	bool TakeTask(int workerIndex, std::function<void()>& task);
+	void StartWorker();
+
+private:
+	static ThreadPool* s_pThreadPool;
+	static std::once_flag s_created;
+	static thread_local int t_workerIndex;
+
+	std::vector<WorkQueue*> queues;
+	std::atomic<size_t> nextQueue;
+
+	// Idle workers wait for pendingTasks to become non-zero.  The counts of workers are also guarded by idleMutex
+	std::mutex idleMutex;
+	std::condition_variable workAvailable;
+	size_t pendingTasks;
+	size_t workerCount;
+	size_t blockedWorkers;
+	int nextWorkerIndex;
+};
@@ -5,10 +5,12 @@
 #include "ExecState.h"
 #include "DataStack.h"
 #include "WordBodyElement.h"
+#include "ForthDict.h"
 #include <algorithm>
 #include <sstream>
 
 TypeSystem* TypeSystem::s_pTypeSystem;
+thread_local TypeSystem::MethodCacheEntry TypeSystem::t_methodCache[TypeSystem::methodCacheSize];
 
 TypeSystem* TypeSystem::GetTypeSystem() {
 	if (s_pTypeSystem == nullptr) {
@@ -17,17 +19,19 @@ TypeSystem* TypeSystem::GetTypeSystem() {
 	return s_pTypeSystem;
 }
 
-TypeSystem::TypeSystem() {
+TypeSystem::TypeSystem() :
+	registeredTypes(65536) {
 	nextValueTypeId = 0;
 	maxValueTypeId = 1022;
 	firstObjectTypeId = nextObjectTypeId = 1024;
 	firstUserObjectTypeId =  nextUserObjectTypeId = 32768;
 	maxObjectTypeId = 32767;
 	maxUserObjectTypeId = 65535;
+	// Cache entries start at generation 0, so are all invalid
+	methodCacheGeneration = 1;
 }
 
 bool TypeSystem::RegisterValueType(ExecState* pExecState, std::string typeName) {
-	// TODO Interlocked increment of type id
 	int idToUse = nextValueTypeId++;
 	if (!RegisterType(pExecState, typeName, idToUse, nullptr, nullptr, nullptr)) {
 		return false;
@@ -36,7 +40,6 @@ bool TypeSystem::RegisterValueType(ExecState* pExecState, std::string typeName)
 }
 
 ForthType TypeSystem::RegisterObjectType(ExecState* pExecState, std::string typeName, XT constructXT, XT binaryOpsXT) {
-	// TODO Interlocked increment of type id
 	int idToUse = nextObjectTypeId++;
 	if (!RegisterType(pExecState, typeName, idToUse, constructXT, binaryOpsXT, nullptr)) {
 		return TypeSystem::typeIdInvalid;
@@ -45,7 +48,6 @@ ForthType TypeSystem::RegisterObjectType(ExecState* pExecState, std::string type
 }
 
 ForthType TypeSystem::RegisterUserObjectType(ExecState* pExecState, std::string typeName, UserDefinedObject* pNewObjectDefinition) {
-	// TODO Interlocked increment of type id
 	ForthType idToUse = nextUserObjectTypeId++;
 	if (!RegisterType(pExecState, typeName, idToUse, nullptr, nullptr, pNewObjectDefinition)) {
 		return TypeSystem::typeIdInvalid;
@@ -58,14 +60,21 @@ bool TypeSystem::RegisterType(ExecState* pExecState, std::string typeName, int t
 	std::transform(typeName.begin(), typeName.end(), typeName.begin(),
 		[](unsigned char c) { return std::tolower(c); });
 
-	unsigned int existingTypeId = GetBaseTypeIdForName(typeName);
-	if (existingTypeId != TypeSystem::typeIdInvalid) {
+	std::unique_lock<std::mutex> lock(this->typesMutex);
+	if (typeNameToId.find(typeName) != typeNameToId.end()) {
+		lock.unlock();
 		return pExecState->CreateException("Type already exists");
 	}
 	typeNameToId[typeName] = typeId;
 	typeIdToName[typeId] = typeName;
 	RegisteredType* pRT = new RegisteredType(typeName, typeId, constructXT, binaryOpsXT, pDefiningType);
+	pRT->pDefiningDict = pExecState->pDict;
+	if (pDefiningType != nullptr) {
+		// The type system holds the defining object's reference, so it survives being pushed to and dropped from the stack
+		pDefiningType->IncReference();
+	}
 	typeIdToRegisteredType[typeId] = pRT;
+	this->registeredTypes[typeId].store(pRT, std::memory_order_release);
 	return true;
 }
 
@@ -73,6 +82,7 @@ unsigned int TypeSystem::GetBaseTypeIdForName(std::string typeName) const {
 	std::transform(typeName.begin(), typeName.end(), typeName.begin(),
 		[](unsigned char c) { return std::tolower(c); });
 
+	std::lock_guard<std::mutex> lock(this->typesMutex);
 	std::map<std::string, unsigned int>::const_iterator findType = typeNameToId.find(typeName);
 
 	if (findType == typeNameToId.end()) {
@@ -82,6 +92,7 @@ unsigned int TypeSystem::GetBaseTypeIdForName(std::string typeName) const {
 }
 
 std::string TypeSystem::GetBaseTypeNameForId(unsigned int typeId) const {
+	std::lock_guard<std::mutex> lock(this->typesMutex);
 	std::map<unsigned int, std::string >::const_iterator findType = typeIdToName.find(typeId);
 
 	if (findType == typeIdToName.end()) {
@@ -154,12 +165,7 @@ RegisteredType* TypeSystem::GetRegisteredTypeForTypeId(ForthType type) const {
 	if (GetIndirectionLevel(type) > 0) {
 		return nullptr;
 	}
-	int typeId = type & 0xffff;
-	std::map<unsigned int, RegisteredType*>::const_iterator foundIterator = typeIdToRegisteredType.find(typeId);
-	if (foundIterator == typeIdToRegisteredType.end()) {
-		return nullptr;
-	}
-	return foundIterator->second;
+	return this->registeredTypes[type & 0xffff].load(std::memory_order_acquire);
 }
 
 std::string TypeSystem::TypeToString(ForthType type) const {
@@ -339,7 +345,6 @@ void TypeSystem::IncReferenceForPter(ForthType type, void* pter) {
 		if (ppWBE != nullptr) {
 			WordBodyElement* pWBE = *ppWBE;
 			if (n < indirectionCount - 1) {
-				// TODO Add atomic increment here
 				pWBE->refCount++;
 				ppWBE = static_cast<WordBodyElement**>(pWBE->refCountedPter);
 			}
@@ -364,7 +369,6 @@ void TypeSystem::IncReferenceForPterBy(ForthType type, void* pter, int by) {
 		if (ppWBE != nullptr) {
 			WordBodyElement* pWBE = *ppWBE;
 			if (n < indirectionCount - 1) {
-				// TODO Add atomic increment here
 				pWBE->refCount+=by;
 				ppWBE = static_cast<WordBodyElement**>(pWBE->refCountedPter);
 			}
@@ -389,7 +393,6 @@ void TypeSystem::DecReferenceForPter(ForthType type, void* pter) {
 		if (ppWBE != nullptr) {
 			WordBodyElement* pWBE = *ppWBE;
 			if (n < indirectionCount - 1) {
-				// TODO Add atomic decrement here
 				pWBE->refCount --;
 				ppWBE = static_cast<WordBodyElement**>(pWBE->refCountedPter);
 			}
@@ -414,7 +417,6 @@ void TypeSystem::DecReferenceForPterBy(ForthType type, void* pter, int by) {
 		if (ppWBE != nullptr) {
 			WordBodyElement* pWBE = *ppWBE;
 			if (n < indirectionCount - 1) {
-				// TODO Add atomic decrement here
 				pWBE->refCount -= by;
 				ppWBE = static_cast<WordBodyElement**>(pWBE->refCountedPter);
 			}
@@ -573,7 +575,7 @@ bool TypeSystem::ValueTypeToString(ExecState* pExecState, ForthType forthType, c
 			out << *((double*)pter);
 			break;
 		case StackElement_Bool:
-			if (*((double*)pter)) {
+			if (*((bool*)pter)) {
 				out << "true";
 			}
 			else {
@@ -604,7 +606,11 @@ bool TypeSystem::AddWordToObject(ExecState* pExecState, ForthType type, ForthWor
 		return pExecState->CreateException("Object is not a registered type - it does not have registered type information with the type system");
 	}
 	if (pType->definingObject != nullptr) {
+		if (pType->definingObject->IsShared()) {
+			return pExecState->CreateException("Cannot add a word to a type defined in a shared dictionary");
+		}
 		pType->definingObject->AddWord(pWord);
+		InvalidateMethodCache();
 	}
 	else {
 		return pExecState->CreateException("Object is registered but does not have a defining object");
@@ -613,16 +619,41 @@ bool TypeSystem::AddWordToObject(ExecState* pExecState, ForthType type, ForthWor
 	return true;
 }
 
-ForthWord* TypeSystem::FindWordWithName(ForthType type, const std::string& wordName) {
+ForthWord* TypeSystem::FindWordWithName(ForthType type, std::string_view wordName) {
+	uint32_t hash = ForthDict::HashName(wordName);
+	uint64_t generation = this->methodCacheGeneration.load(std::memory_order_acquire);
+	MethodCacheEntry& entry = t_methodCache[(hash ^ (type * 2654435761u)) & (methodCacheSize - 1)];
+	if (entry.generation == generation && entry.type == type && entry.hash == hash && ForthDict::FoldedNameMatches(entry.foldedName, wordName)) {
+		return entry.pWord;
+	}
+
+	ForthWord* pWord = nullptr;
 	RegisteredType* pType = GetRegisteredTypeForTypeId(type);
+	if (pType != nullptr && pType->definingObject != nullptr) {
+		pWord = pType->definingObject->GetWordWithName(wordName);
+	}
+	entry.generation = generation;
+	entry.type = type;
+	entry.hash = hash;
+	ForthDict::FoldName(wordName, entry.foldedName);
+	entry.pWord = pWord;
+	return pWord;
+}
 
-	if (pType == nullptr || pType->definingObject==nullptr) {
-		return nullptr;
+void TypeSystem::InvalidateMethodCache() {
+	this->methodCacheGeneration.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void TypeSystem::AddUserTypeDefinitions(ForthDict* pDict, std::vector<RefCountedObject*>& objects) const {
+	std::lock_guard<std::mutex> lock(this->typesMutex);
+	for (auto& idAndType : typeIdToRegisteredType) {
+		if (idAndType.second->definingObject != nullptr && idAndType.second->pDefiningDict == pDict) {
+			objects.push_back(idAndType.second->definingObject);
+		}
 	}
-	return pType->definingObject->GetWordWithName(wordName);
 }
 
-ForthWord* TypeSystem::FindWordInTOSWord(ExecState* pExecState, const std::string& wordName) {
+ForthWord* TypeSystem::FindWordInTOSWord(ExecState* pExecState, std::string_view wordName) {
 	TypeSystem* pTS = TypeSystem::GetTypeSystem();
 	StackElement* pElement = pExecState->pStack->TopElement();
 	if (pElement != nullptr) {
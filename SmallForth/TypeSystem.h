@@ -1,10 +1,16 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <map>
 #include <tuple>
+#include <vector>
+#include <atomic>
+#include <mutex>
 class ExecState;
 class UserDefinedObject;
 class ForthWord;
+class RefCountedObject;
+class ForthDict;
 
 class RegisteredType {
 public:
@@ -14,12 +20,15 @@ public:
 		this->constructorXT = constructor;
 		this->binaryOpsXT = binaryOps;
 		this->definingObject = pDefiningObject;
+		this->pDefiningDict = nullptr;
 	}
 	unsigned int id;
 	std::string name;
 	XT constructorXT;
 	XT binaryOpsXT;
 	UserDefinedObject* definingObject;
+	// The dictionary of the ExecState that registered the type, which shares the type when it is shared
+	ForthDict* pDefiningDict;
 };
 
 class TypeSystem
@@ -65,8 +74,11 @@ public:
 	bool TypeExists(std::string typeName) const;
 	
 	bool AddWordToObject(ExecState* pExecState, ForthType type, ForthWord* pWord);
-	ForthWord* FindWordWithName(ForthType type, const std::string& wordName);
-	ForthWord* FindWordInTOSWord(ExecState* pExecState, const std::string& wordName);
+	ForthWord* FindWordWithName(ForthType type, std::string_view wordName);
+	void InvalidateMethodCache();
+	// The objects defining the user object types registered by ExecStates using pDict, for sharing with it
+	void AddUserTypeDefinitions(ForthDict* pDict, std::vector<RefCountedObject*>& objects) const;
+	ForthWord* FindWordInTOSWord(ExecState* pExecState, std::string_view wordName);
 
 
 public:
@@ -83,6 +95,8 @@ public:
 	static const unsigned int typeIdInvalid = 1023;
 
 private:
+	// Restores user object types with the ids they were saved with
+	friend class DictionaryImage;
 	bool RegisterType(ExecState* pExecState, std::string typeName, int typeId, XT constructXT, XT binaryOpsXT, UserDefinedObject* pDefiningType);
 	std::string GetBaseTypeNameForId(unsigned int typeId) const;
 	unsigned int GetBaseTypeIdForName(std::string typeName) const;
@@ -92,11 +106,13 @@ private:
 	bool ConstructSystemType(ExecState* pExecState, ForthType type);
 
 private:
-	unsigned int nextValueTypeId;
+	// Types can be registered by ExecStates on several threads, so ids are allocated atomically, registration and
+	//  the name maps are guarded by typesMutex, and types are found by id without locking through registeredTypes
+	std::atomic<unsigned int> nextValueTypeId;
 	unsigned int firstObjectTypeId;
-	unsigned int nextObjectTypeId;
+	std::atomic<unsigned int> nextObjectTypeId;
 	unsigned int firstUserObjectTypeId;
-	unsigned int nextUserObjectTypeId;
+	std::atomic<unsigned int> nextUserObjectTypeId;
 	unsigned int maxValueTypeId;
 	unsigned int maxObjectTypeId;
 	unsigned int maxUserObjectTypeId;
@@ -104,6 +120,22 @@ private:
 	std::map<std::string, unsigned int> typeNameToId;
 	std::map<unsigned int, std::string> typeIdToName;
 	std::map<unsigned int, RegisteredType*> typeIdToRegisteredType;
+	mutable std::mutex typesMutex;
+	std::vector<std::atomic<RegisteredType*>> registeredTypes;
+
+	// Direct-mapped cache of method resolutions, keyed on (type, case-folded name).  Failed resolutions are cached
+	//  too, so plain words used while an object is on the stack skip the type and dictionary lookups.  Each thread
+	//  has its own cache; all are invalidated, by moving to a new generation, whenever a word is added to an object.
+	struct MethodCacheEntry {
+		uint64_t generation;
+		ForthType type;
+		uint32_t hash;
+		std::string foldedName;
+		ForthWord* pWord;
+	};
+	static const size_t methodCacheSize = 256;
+	static thread_local MethodCacheEntry t_methodCache[methodCacheSize];
+	std::atomic<uint64_t> methodCacheGeneration;
 
 	static TypeSystem* s_pTypeSystem;
 };
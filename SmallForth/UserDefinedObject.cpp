@@ -7,6 +7,7 @@
 #include "TypeSystem.h"
 #include "ForthDict.h"
 #include "ForthString.h"
+#include "ObjectPool.h"
 
 UserDefinedObject::UserDefinedObject(std::string name, int stateCount, ForthDict* pDict)
 : RefCountedObject(pDict) {
@@ -14,13 +15,31 @@ UserDefinedObject::UserDefinedObject(std::string name, int stateCount, ForthDict
 	this->defaultObject = false;
 	this->objectName = name;
 	this->stateCount = stateCount;
-	this->markedByReferenceCounter = false;
+	this->canReferenceObjects = true;
+	// An object definition always owns a dictionary, so that instances constructed from it share the same methods,
+	//  even those added after the instance was constructed
+	InitialiseDictionary();
 }
 
 UserDefinedObject::~UserDefinedObject() {
-	// No need to alter reference counts of sub-objects.  To get to the point of this destructor being called, it's ref
-	//  count must have reached zero.  In doing so it would have already decremented the ref counts of sub-objects
-	//  as far as it needs to.
+	// Each state element holds one reference to the object it contains, released as the element is deleted
+	for (StackElement* pSE : this->state) {
+		delete pSE;
+	}
+	this->state.clear();
+}
+
+static ObjectPool* GetUserDefinedObjectPool() {
+	static thread_local ObjectPool* pPool = ObjectPool::ForThread("object", sizeof(UserDefinedObject));
+	return pPool;
+}
+
+void* UserDefinedObject::operator new(size_t size) {
+	return GetUserDefinedObjectPool()->Allocate(size);
+}
+
+void UserDefinedObject::operator delete(void* pBlock, size_t size) {
+	GetUserDefinedObjectPool()->Release(pBlock, size);
 }
 
 void UserDefinedObject::SetType(ForthType type) {
@@ -42,52 +61,19 @@ bool UserDefinedObject::DefineObjectFromStack(ExecState* pExecState) {
 	return true;
 }
 
-void UserDefinedObject::IncReference() {
-	//cout << "       : " << GetObjectType() << " " << std::hex << this << std::dec << " inc " << this->GetReferenceCount() << " to " << (this->GetReferenceCount() + 1) << endl;
-	// Potentially marked by the construction method, to prevent the reference count going higher when it is returned to the construction code and it's added to a stack element
-	if (!this->markedByReferenceCounter) {
-		MarkForReferenceCounter(true);
-		for (StackElement* pSE : this->state) {
-			ConsiderRefCountChangeForLinkedObject(pSE, 1);
-		}
-	}
-	MarkForReferenceCounter(false);
-	RefCountedObject::IncReference();
-}
-
-void UserDefinedObject::DecReference() {
-	//cout << "       : " << GetObjectType() << " " << std::hex << this << std::dec << " dec " << this->GetReferenceCount() << " to " << (this->GetReferenceCount() - 1) << endl;
-	if (!this->markedByReferenceCounter) {
-		MarkForReferenceCounter(true);
-		for (StackElement* pSE : this->state) {
-			ConsiderRefCountChangeForLinkedObject(pSE, -1);
-		}
-		MarkForReferenceCounter(false);
-	}
-	RefCountedObject::DecReference();
-}
-
-void UserDefinedObject::IncReferenceBy(int by) {
-	// Potentially marked by the construction method, to prevent the reference count going higher when it is returned to the construction code and it's added to a stack element
-	if (!this->markedByReferenceCounter) {
-		MarkForReferenceCounter(true);
-		for (StackElement* pSE : this->state) {
-			ConsiderRefCountChangeForLinkedObject(pSE, by);
+void UserDefinedObject::AddChildObjects(std::vector<RefCountedObject*>& children) const {
+	for (StackElement* pSE : this->state) {
+		RefCountedObject* pObject = pSE->GetDirectObject();
+		if (pObject != nullptr) {
+			children.push_back(pObject);
 		}
 	}
-	MarkForReferenceCounter(false);
-	RefCountedObject::IncReferenceBy(by);
 }
 
-void UserDefinedObject::DecReferenceBy(int by) {
-	if (!this->markedByReferenceCounter) {
-		MarkForReferenceCounter(true);
-		for (StackElement* pSE : this->state) {
-			ConsiderRefCountChangeForLinkedObject(pSE, -by);
-		}
-		MarkForReferenceCounter(false);
+void UserDefinedObject::ReleaseChildObjects() {
+	for (StackElement* pSE : this->state) {
+		pSE->RelinquishValue();
 	}
-	RefCountedObject::DecReference();
 }
 
 std::string UserDefinedObject::GetObjectType() {
@@ -122,28 +108,6 @@ bool UserDefinedObject::InvokeFunctionIndex(ExecState* pExecState, ObjectFunctio
 	return false;
 }
 
-void UserDefinedObject::ConsiderRefCountChangeForLinkedObject(StackElement* pElement, int changeDirection) {
-	TypeSystem* pTS = TypeSystem::GetTypeSystem();
-	ForthType elementType = pElement->GetType();
-	if (pTS->TypeIsObjectOrObjectPter(elementType) &&
-		pElement->GetObject()->GetMarkForReferenceCounter()==false) {
-		if (changeDirection == 1) {
-			//cout << "     : Incrementing sub object of type " << elementType << endl;
-			pTS->IncReferenceForPter(elementType, pElement->GetObject());
-		}
-		else if (changeDirection>1) {
-			pTS->IncReferenceForPterBy(elementType, pElement->GetObject(),changeDirection);
-		}
-		else if (changeDirection==-1) {
-			//cout << "     : Decrementing sub object of type " << elementType << endl;
-			pTS->DecReferenceForPter(elementType, pElement->GetObject());
-		}
-		else {
-			pTS->DecReferenceForPterBy(elementType, pElement->GetObject(),-changeDirection);
-		}
-	}
-}
-
 UserDefinedObject* UserDefinedObject::Construct(ExecState* pExecState) {
 	ForthWord* pConstruct = GetWordWithName("construct");
 	if (pConstruct != nullptr)
@@ -160,23 +124,13 @@ UserDefinedObject* UserDefinedObject::Construct(ExecState* pExecState) {
 		return nullptr;
 	}
 	else {
-		TypeSystem* pTS = TypeSystem::GetTypeSystem();
 		UserDefinedObject* pConstructed = new UserDefinedObject(this->objectName, this->stateCount, this->pDictionary);
 		pConstructed->objectType = this->objectType;
-		pConstructed->MarkForReferenceCounter(true);
-		//cout << "  : iterating over state elements " << endl;
+		// Copying a state element takes a reference to any object it contains, on behalf of the constructed object
 		for (StackElement* pSE : this->state) {
-			/*	if (pTS->TypeIsObjectOrObjectPter(pSE->GetType())) {
-					cout << "  : copy default element, increment... " << endl;
-				}*/
 			StackElement* pNewElement = new StackElement(*pSE);
 			pConstructed->state.push_back(pNewElement);
 		}
-		// Leaving this construction method with the object 'marked'.  This will stop
-		//  the impending ref inc (on the constructed object) from incorrectly incrementing
-		//  the subobjects
-		// 
-		//cout << "  : finished iterating over state elements " << endl;
 		return pConstructed;
 	}
 }
@@ -195,7 +149,7 @@ bool UserDefinedObject::ElementAtIndex(ExecState* pExecState) {
 	delete pElementIndex;
 	pElementIndex = nullptr;
 
-	if (index < 0 || index>this->stateCount) {
+	if (index < 0 || index >= this->stateCount) {
 		return pExecState->CreateException("Index into user defined type must be within the range of its state count");
 	}
 	StackElement* pStateItem = this->state[index];
@@ -208,7 +162,6 @@ bool UserDefinedObject::ElementAtIndex(ExecState* pExecState) {
 }
 
 bool UserDefinedObject::SetElementAtIndex(ExecState* pExecState) {
-	TypeSystem* pTS = TypeSystem::GetTypeSystem();
 	StackElement* pElementIndex;
 	bool incorrectType;
 	std::tie(incorrectType, pElementIndex) = pExecState->pStack->PullType(StackElement_Int);
@@ -225,10 +178,13 @@ bool UserDefinedObject::SetElementAtIndex(ExecState* pExecState) {
 
 	StackElement* pElementElement = pExecState->pStack->Pull();
 	if (pElementElement == nullptr) {
-		delete pElementIndex;
-		pElementIndex = nullptr;
 		return pExecState->CreateStackUnderflowException();
 	}
+	else if (index < 0 || index >= this->stateCount) {
+		delete pElementElement;
+		pElementElement = nullptr;
+		return pExecState->CreateException("Index into user defined type must be within the range of its state count");
+	}
 	else {
 		ForthType typePassed = pElementElement->GetType();
 		ForthType typeToSet = this->state[index]->GetType();
@@ -239,24 +195,13 @@ bool UserDefinedObject::SetElementAtIndex(ExecState* pExecState) {
 			return pExecState->CreateException("Set element must be called with ( e n -- ) where e is a type compatible with state element being set");
 		}
 	}
-	if (index < 0 || index>this->stateCount) {
-		delete pElementElement;
-		pElementElement = nullptr;
-		return pExecState->CreateException("Index into user defined type must be within the range of its state count");
-	}
 
+	// The pulled element already holds a reference to any object it contains, which passes to this object.  Deleting
+	//  the replaced element releases this object's reference to its previous value.
 	StackElement* pCurrentElement = this->state[index];
-	if (pTS->TypeIsObjectOrObjectPter(pElementElement->GetType())) {
-		// The -1 is because we are NULLing this pElementElement pter, not deleting it.  Deleting it
-		//  would cause the item to lose a reference point
-		pElementElement->GetObject()->IncReferenceBy(this->GetCurrentReferenceCount()-1);
-	}
 	this->state[index] = pElementElement;
 	pElementElement = nullptr;
 
-	if (pTS->TypeIsObjectOrObjectPter(pCurrentElement->GetType())) {
-		pCurrentElement->GetObject()->DecReferenceBy(this->GetCurrentReferenceCount());
-	}
 	delete pCurrentElement;
 	pCurrentElement = nullptr;
 	return true;
@@ -12,10 +12,8 @@ public:
 	UserDefinedObject(std::string name, int stateCount, ForthDict* pDict);
 	virtual ~UserDefinedObject();
 
-	virtual void IncReference();
-	virtual void DecReference();
-	virtual void IncReferenceBy(int by);
-	virtual void DecReferenceBy(int by);
+	static void* operator new(size_t size);
+	static void operator delete(void* pBlock, size_t size);
 
 	virtual std::string GetObjectType();
 	virtual bool ToString(ExecState* pExecState) const;
@@ -26,9 +24,11 @@ public:
 
 	UserDefinedObject* Construct(ExecState* pExecState);
 
-private:
-	void ConsiderRefCountChangeForLinkedObject(StackElement* pElement, int changeDirection);
+	virtual void AddChildObjects(std::vector<RefCountedObject*>& children) const;
+	virtual void ReleaseChildObjects();
 
+private:
+	friend class DictionaryImage;
 	bool ElementAtIndex(ExecState* pExecState);
 	bool SetElementAtIndex(ExecState* pExecState);
 	bool DeconstructToStack(ExecState* pExecState);
@@ -4,6 +4,7 @@
 #include "ExecState.h"
 #include "DataStack.h"
 #include "ForthString.h"
+#include "ObjectPool.h"
 
 Vector3::Vector3(double x, double y, double z) :
 	RefCountedObject(nullptr) {
@@ -16,6 +17,19 @@ Vector3::Vector3(double x, double y, double z) :
 Vector3::~Vector3() { 
 }
 
+static ObjectPool* GetVector3Pool() {
+	static thread_local ObjectPool* pPool = ObjectPool::ForThread("vector3", sizeof(Vector3));
+	return pPool;
+}
+
+void* Vector3::operator new(size_t size) {
+	return GetVector3Pool()->Allocate(size);
+}
+
+void Vector3::operator delete(void* pBlock, size_t size) {
+	GetVector3Pool()->Release(pBlock, size);
+}
+
 std::string Vector3::GetObjectType() {
 	return "vector3";
 }
@@ -8,6 +8,9 @@ class Vector3 :
 public:
     Vector3(double x, double y, double z);
     ~Vector3();
+
+    static void* operator new(size_t size);
+    static void operator delete(void* pBlock, size_t size);
     virtual std::string GetObjectType();
     virtual bool ToString(ExecState* pExecState) const;
     virtual bool InvokeFunctionIndex(ExecState* pExecState, ObjectFunction functionToInvoke);
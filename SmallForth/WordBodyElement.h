@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include "ForthDefs.h"
 
 class WordBodyElement
@@ -15,6 +16,8 @@ public:
 		void* refCountedPter;
 		ForthType forthType;
 	};
-	int16_t refCount;
+	// References to the pointer held in this element.  Atomic, as pushing the address of a variable in a shared
+	//  dictionary counts a reference to it from whichever thread does so
+	std::atomic<int16_t> refCount;
 };
 
@@ -0,0 +1,168 @@
+#include "ForthDefs.h"
+#include "WordHandle.h"
+#include "ExecState.h"
+#include "ForthDict.h"
+#include "ForthWord.h"
+#include "WordBodyElement.h"
+#include "StackElement.h"
+#include "TypeSystem.h"
+#include "PreBuiltWords.h"
+#include "ZeroCountTable.h"
+#include "CycleCollector.h"
+
+WordHandle::WordHandle(ForthWord* pWord, HandleKind kind) {
+	this->pWord = pWord;
+	this->pWord->IncReference();
+	this->kind = kind;
+}
+
+WordHandle::~WordHandle() {
+	this->pWord->DecReference();
+	this->pWord = nullptr;
+}
+
+// Variables push a pointer to the value in their body, and constants fetch it: [xt, type, value]
+WordHandle* WordHandle::Resolve(ExecState* pExecState, std::string_view name) {
+	ForthWord* pWord = pExecState->pDict->FindWord(name);
+	if (pWord == nullptr) {
+		pExecState->CreateException("Could not find word in dictionary");
+		return nullptr;
+	}
+	HandleKind kind = HandleKind_Word;
+	if (pWord->GetBodySize() >= 3) {
+		XT xt = pWord->GetPterToBody()[0]->wordElement_XT;
+		if (xt == PreBuiltWords::BuiltIn_PushPter) {
+			kind = HandleKind_Variable;
+		}
+		else if (xt == PreBuiltWords::BuiltIn_FetchLiteral) {
+			kind = HandleKind_Constant;
+		}
+	}
+	return new WordHandle(pWord, kind);
+}
+
+ForthType WordHandle::GetValueType() const {
+	if (this->kind == HandleKind_Word) {
+		return StackElement_Undefined;
+	}
+	return this->pWord->GetPterToBody()[1]->forthType;
+}
+
+WordBodyElement* WordHandle::GetValueElement() const {
+	return this->pWord->GetPterToBody()[2];
+}
+
+// Invoked by the host, rather than by a word, it returns to where nothing is executing, which is a safe point as the
+//  end of an interpreted line is.  So a host calling words in a loop doesn't build up garbage
+bool WordHandle::Invoke(ExecState* pExecState) {
+	bool outermost = pExecState->subStateStack.empty() && pExecState->builtInsExecuting == 0;
+	bool succeeded = pExecState->ExecuteWord(this->pWord, false);
+	if (outermost) {
+		CycleCollector* pCycleCollector = CycleCollector::GetCycleCollector();
+		if (pCycleCollector->StepRecommended()) {
+			pCycleCollector->CollectStep();
+		}
+		ZeroCountTable::GetZeroCountTable()->Reconcile();
+	}
+	return succeeded;
+}
+
+bool WordHandle::CheckValue(ExecState* pExecState, bool setting, bool matchingType) const {
+	if (this->kind == HandleKind_Word) {
+		return pExecState->CreateException("Word is not a variable or a constant");
+	}
+	if (setting && this->kind == HandleKind_Constant) {
+		return pExecState->CreateException("Cannot set a constant");
+	}
+	if (!matchingType) {
+		return pExecState->CreateException("Variable or constant is of a different type");
+	}
+	return true;
+}
+
+bool WordHandle::Get(ExecState* pExecState, int64_t& value) const {
+	if (!CheckValue(pExecState, false, GetValueType() == StackElement_Int)) {
+		return false;
+	}
+	value = GetValueElement()->wordElement_int;
+	return true;
+}
+
+bool WordHandle::Get(ExecState* pExecState, double& value) const {
+	if (!CheckValue(pExecState, false, GetValueType() == StackElement_Float)) {
+		return false;
+	}
+	value = GetValueElement()->wordElement_float;
+	return true;
+}
+
+bool WordHandle::Get(ExecState* pExecState, bool& value) const {
+	if (!CheckValue(pExecState, false, GetValueType() == StackElement_Bool)) {
+		return false;
+	}
+	value = GetValueElement()->wordElement_bool;
+	return true;
+}
+
+bool WordHandle::Get(ExecState* pExecState, ForthType& value) const {
+	if (!CheckValue(pExecState, false, GetValueType() == StackElement_Type)) {
+		return false;
+	}
+	value = GetValueElement()->forthType;
+	return true;
+}
+
+bool WordHandle::Get(ExecState* pExecState, RefCountedObject*& value) const {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	if (!CheckValue(pExecState, false, pTS->TypeIsObject(GetValueType()))) {
+		return false;
+	}
+	value = static_cast<RefCountedObject*>(GetValueElement()->refCountedPter);
+	if (value != nullptr) {
+		value->IncReference();
+	}
+	return true;
+}
+
+bool WordHandle::Set(ExecState* pExecState, int64_t value) {
+	if (!CheckValue(pExecState, true, GetValueType() == StackElement_Int)) {
+		return false;
+	}
+	GetValueElement()->wordElement_int = value;
+	return true;
+}
+
+bool WordHandle::Set(ExecState* pExecState, double value) {
+	if (!CheckValue(pExecState, true, GetValueType() == StackElement_Float)) {
+		return false;
+	}
+	GetValueElement()->wordElement_float = value;
+	return true;
+}
+
+bool WordHandle::Set(ExecState* pExecState, bool value) {
+	if (!CheckValue(pExecState, true, GetValueType() == StackElement_Bool)) {
+		return false;
+	}
+	GetValueElement()->wordElement_bool = value;
+	return true;
+}
+
+bool WordHandle::Set(ExecState* pExecState, ForthType value) {
+	if (!CheckValue(pExecState, true, GetValueType() == StackElement_Type)) {
+		return false;
+	}
+	GetValueElement()->forthType = value;
+	return true;
+}
+
+// Stored as ! would, so the variable's reference to its old and new object are counted
+bool WordHandle::Set(ExecState* pExecState, RefCountedObject* value) {
+	TypeSystem* pTS = TypeSystem::GetTypeSystem();
+	if (!CheckValue(pExecState, true, pTS->TypeIsObject(GetValueType()))) {
+		return false;
+	}
+	StackElement address(pTS->CreatePointerTypeTo(GetValueType()), (void*)(this->pWord->GetPterToBody() + 2));
+	StackElement valueElement(value);
+	return address.PokeIntoContainedPter(pExecState, &valueElement);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <string_view>
+#include "ForthDefs.h"
+class ExecState;
+class ForthWord;
+class RefCountedObject;
+class WordBodyElement;
+
+// A word, variable or constant looked up by name once, for a host that calls into Forth repeatedly.  Invoking a
+//  handle executes the word without a dictionary lookup, and reading or writing a variable or constant goes
+//  straight to the value in its body, rather than executing the word and then @ or ! by name.  Values are pushed and
+//  pulled unboxed with pStack's typed Push and PullAs methods.
+// A handle holds a reference to its word, so it stays valid if the word is redefined or forgotten, and keeps
+//  referring to the definition it resolved.
+class WordHandle
+{
+public:
+	enum HandleKind {
+		HandleKind_Word,
+		HandleKind_Variable,
+		HandleKind_Constant
+	};
+
+	// Returns nullptr, with an exception created, if there is no such word
+	static WordHandle* Resolve(ExecState* pExecState, std::string_view name);
+	~WordHandle();
+
+	HandleKind GetKind() const { return this->kind; }
+	// The type of a variable's or constant's value
+	ForthType GetValueType() const;
+
+	// Executes the word.  Called by the host, rather than by a word, objects no longer referenced are deleted once it
+	//  returns
+	bool Invoke(ExecState* pExecState);
+
+	bool Get(ExecState* pExecState, int64_t& value) const;
+	bool Get(ExecState* pExecState, double& value) const;
+	bool Get(ExecState* pExecState, bool& value) const;
+	bool Get(ExecState* pExecState, ForthType& value) const;
+	// The object returned has a reference held for the caller
+	bool Get(ExecState* pExecState, RefCountedObject*& value) const;
+
+	bool Set(ExecState* pExecState, int64_t value);
+	bool Set(ExecState* pExecState, double value);
+	bool Set(ExecState* pExecState, bool value);
+	bool Set(ExecState* pExecState, ForthType value);
+	bool Set(ExecState* pExecState, RefCountedObject* value);
+
+private:
+	WordHandle(ForthWord* pWord, HandleKind kind);
+	bool CheckValue(ExecState* pExecState, bool setting, bool matchingType) const;
+	WordBodyElement* GetValueElement() const;
+
+private:
+	ForthWord* pWord;
+	HandleKind kind;
+};
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include "ZeroCountTable.h"
+#include "RefCountedObject.h"
+#include "DataStack.h"
+#include "CycleCollector.h"
+#include "ObjectPool.h"
+
+thread_local ZeroCountTable* ZeroCountTable::s_pZeroCountTable;
+std::mutex ZeroCountTable::s_tablesMutex;
+std::unordered_map<uint32_t, ZeroCountTable*>& ZeroCountTable::s_tables = *new std::unordered_map<uint32_t, ZeroCountTable*>();
+
+ZeroCountTable* ZeroCountTable::GetZeroCountTable() {
+	if (s_pZeroCountTable == nullptr) {
+		// Deleting the table deletes objects, so the thread's pools must be handed on after it
+		ObjectPool::RegisterThread();
+		static thread_local ThreadExit threadExit;
+		s_pZeroCountTable = new ZeroCountTable();
+	}
+	return s_pZeroCountTable;
+}
+
+void ZeroCountTable::DeleteZeroCountTable() {
+	ZeroCountTable* pZCT = s_pZeroCountTable;
+	if (pZCT == nullptr || pZCT->HasStacks()) {
+		return;
+	}
+	// As when the thread's last ExecState is deleted (see Bootstrap::DeleteExecState), but cycles are collected too,
+	//  and deleting what they refer to may make more candidates
+	pZCT->MergeEscapedObjects();
+	CycleCollector* pCollector = CycleCollector::GetCycleCollector();
+	do {
+		pCollector->Collect();
+		pZCT->Reconcile();
+	} while (pCollector->HasCandidates());
+	CycleCollector::DeleteCycleCollector();
+
+	{
+		std::lock_guard<std::mutex> lock(s_tablesMutex);
+		s_tables.erase(RefCountedObject::GetThreadId());
+	}
+	delete pZCT;
+	s_pZeroCountTable = nullptr;
+}
+
+ZeroCountTable::ZeroCountTable() {
+	this->reconciling = false;
+	this->reconcileAt = reconcileThreshold;
+	this->hasQueuedObjects = false;
+	this->queueClosed = false;
+	std::lock_guard<std::mutex> lock(s_tablesMutex);
+	s_tables[RefCountedObject::GetThreadId()] = this;
+}
+
+void ZeroCountTable::Add(RefCountedObject* pObject) {
+	if (pObject->InZeroCountTable()) {
+		return;
+	}
+	pObject->SetInZeroCountTable(true);
+	this->zeroCountObjects.push_back(pObject);
+}
+
+void ZeroCountTable::RegisterStack(DataStack* pStack) {
+	if (this->stacks.size() == 0) {
+		std::lock_guard<std::mutex> lock(this->queueMutex);
+		this->queueClosed = false;
+	}
+	this->stacks.push_back(pStack);
+}
+
+void ZeroCountTable::UnregisterStack(DataStack* pStack) {
+	this->stacks.erase(std::remove(this->stacks.begin(), this->stacks.end(), pStack), this->stacks.end());
+}
+
+void ZeroCountTable::AddObjectsOnStacks(std::unordered_set<RefCountedObject*>& objects) const {
+	for (DataStack* pStack : this->stacks) {
+		pStack->AddObjectsOnStack(objects);
+	}
+}
+
+void ZeroCountTable::Pin(RefCountedObject* pObject) {
+	if (this->pinnedObjects.insert(pObject).second) {
+		pObject->IncReference();
+	}
+}
+
+void ZeroCountTable::AddEscaped(RefCountedObject* pObject) {
+	// Only garbage escaped objects are in the table, and this one is still referenced by whatever is passing it
+	if (pObject->InZeroCountTable()) {
+		this->zeroCountObjects.erase(std::remove(this->zeroCountObjects.begin(), this->zeroCountObjects.end(), pObject), this->zeroCountObjects.end());
+		pObject->SetInZeroCountTable(false);
+	}
+	this->escapedObjects.insert(pObject);
+}
+
+void ZeroCountTable::QueueForOwner(RefCountedObject* pObject, uint32_t ownerThread) {
+	{
+		// Held whilst queuing, as the owner's table is deleted if its thread exits
+		std::lock_guard<std::mutex> lock(s_tablesMutex);
+		auto iter = s_tables.find(ownerThread);
+		if (iter != s_tables.end()) {
+			ZeroCountTable* pOwnerTable = iter->second;
+			std::lock_guard<std::mutex> queueLock(pOwnerTable->queueMutex);
+			if (!pOwnerTable->queueClosed) {
+				pOwnerTable->queuedObjects.push_back(pObject);
+				pOwnerTable->hasQueuedObjects = true;
+				return;
+			}
+		}
+	}
+	// The owner has already merged it, either since it was queued or when it closed its queue
+	pObject->Merge(true);
+}
+
+void ZeroCountTable::MergeQueuedObjects() {
+	std::vector<RefCountedObject*> toMerge;
+	{
+		std::lock_guard<std::mutex> lock(this->queueMutex);
+		toMerge.swap(this->queuedObjects);
+		this->hasQueuedObjects = false;
+	}
+	for (RefCountedObject* pObject : toMerge) {
+		pObject->Merge(true);
+	}
+}
+
+// Called once the thread has no stacks, so holds no references to escaped objects other than counted ones
+void ZeroCountTable::MergeEscapedObjects() {
+	std::lock_guard<std::mutex> lock(this->queueMutex);
+	this->queueClosed = true;
+	std::vector<RefCountedObject*> toMerge(this->escapedObjects.begin(), this->escapedObjects.end());
+	for (RefCountedObject* pObject : toMerge) {
+		pObject->Merge(false);
+	}
+	for (RefCountedObject* pObject : this->queuedObjects) {
+		pObject->Merge(true);
+	}
+	this->queuedObjects.clear();
+	this->hasQueuedObjects = false;
+}
+
+void ZeroCountTable::ReleasePins(const std::unordered_set<RefCountedObject*>& onStacks) {
+	std::vector<RefCountedObject*> toRelease;
+	for (RefCountedObject* pObject : this->pinnedObjects) {
+		if (onStacks.find(pObject) == onStacks.end()) {
+			toRelease.push_back(pObject);
+		}
+	}
+	for (RefCountedObject* pObject : toRelease) {
+		this->pinnedObjects.erase(pObject);
+		pObject->DecReference();
+	}
+}
+
+void ZeroCountTable::Reconcile() {
+	if (this->reconciling || (this->zeroCountObjects.size() == 0 && this->pinnedObjects.size() == 0 && !this->hasQueuedObjects)) {
+		return;
+	}
+	this->reconciling = true;
+
+	std::unordered_set<RefCountedObject*> onStacks;
+	AddObjectsOnStacks(onStacks);
+	if (this->hasQueuedObjects) {
+		MergeQueuedObjects();
+	}
+	ReleasePins(onStacks);
+
+	// Deleting an object releases the objects it refers to, which may in turn be added to the table, so keep going
+	//  until no more are added
+	std::vector<RefCountedObject*> stillOnStack;
+	while (this->zeroCountObjects.size() > 0) {
+		std::vector<RefCountedObject*> toConsider;
+		toConsider.swap(this->zeroCountObjects);
+		for (RefCountedObject* pObject : toConsider) {
+			if (pObject->GetCurrentReferenceCount() > 0) {
+				// Referenced again since being added
+				pObject->SetInZeroCountTable(false);
+			}
+			else if (onStacks.find(pObject) != onStacks.end()) {
+				stillOnStack.push_back(pObject);
+			}
+			else {
+				delete pObject;
+			}
+		}
+	}
+	this->zeroCountObjects.swap(stillOnStack);
+	this->reconcileAt = this->zeroCountObjects.size() * 2;
+	if (this->reconcileAt < reconcileThreshold) {
+		this->reconcileAt = reconcileThreshold;
+	}
+	this->reconciling = false;
+}
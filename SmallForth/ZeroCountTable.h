@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+class RefCountedObject;
+class DataStack;
+
+// Deferred reference counting.  References held by stack slots (data, temp and self stacks) are not counted, so
+//  pushing, pulling, duplicating and swapping objects on the stacks costs no reference count changes.  An object
+//  whose count of other references reaches zero is therefore not deleted straight away, as it may still be on a
+//  stack.  It is recorded in this table instead, and at a safe point (where no built-in word is part way through
+//  executing) the table is reconciled against a scan of the stacks.  Objects still at zero and not on any stack
+//  are deleted.
+// Each thread has its own table, holding the stacks of the ExecStates running on it, so an ExecState must be created
+//  on the thread that runs it.  Shared objects (see ForthDict::Share) are never counted so never reach a table.
+// Objects that have escaped to other threads (see RefCountedObject::EscapeObjects) are counted on each thread whilst
+//  they are on its stacks: the table holds a reference to each such object, released at reconciliation once it is
+//  no longer on any of the thread's stacks.  So an escaped object only reaches a table once it is garbage.  The table
+//  also holds the queue of the thread's objects whose shared counts other threads have taken below zero, merged at
+//  reconciliation, and when the thread's last stack goes every escaped object it owns is merged, as the thread may
+//  never reach another safe point.
+// When a thread exits, its table and cycle collector are deleted, along with everything left for them to delete,
+//  unless an ExecState on the thread was never deleted.
+class ZeroCountTable
+{
+	ZeroCountTable();
+public:
+	static ZeroCountTable* GetZeroCountTable();
+
+	void Add(RefCountedObject* pObject);
+	void Reconcile();
+	bool ReconcileRecommended() const { return this->zeroCountObjects.size() >= this->reconcileAt; }
+
+	void RegisterStack(DataStack* pStack);
+	void UnregisterStack(DataStack* pStack);
+	bool HasStacks() const { return this->stacks.size() > 0; }
+	void AddObjectsOnStacks(std::unordered_set<RefCountedObject*>& objects) const;
+
+	void Pin(RefCountedObject* pObject);
+	void AddEscaped(RefCountedObject* pObject);
+	void RemoveEscaped(RefCountedObject* pObject) { this->escapedObjects.erase(pObject); }
+	void MergeEscapedObjects();
+	static void QueueForOwner(RefCountedObject* pObject, uint32_t ownerThread);
+
+private:
+	struct ThreadExit {
+		~ThreadExit() { DeleteZeroCountTable(); }
+	};
+	static void DeleteZeroCountTable();
+	void ReleasePins(const std::unordered_set<RefCountedObject*>& onStacks);
+	void MergeQueuedObjects();
+
+private:
+	static thread_local ZeroCountTable* s_pZeroCountTable;
+	static const size_t reconcileThreshold = 4096;
+	// Every thread's table, by thread id, so objects can be queued for their owners.  Never destroyed, as detached
+	//  threads may still exit during static destruction
+	static std::mutex s_tablesMutex;
+	static std::unordered_map<uint32_t, ZeroCountTable*>& s_tables;
+
+	std::vector<RefCountedObject*> zeroCountObjects;
+	// Objects still on a stack stay in the table, so the size it must reach again grows with them, otherwise every
+	//  safe point would scan the stacks once that many are on them
+	size_t reconcileAt;
+	std::vector<DataStack*> stacks;
+	bool reconciling;
+
+	// Escaped objects on this thread's stacks, each holding a reference, and escaped objects owned by this thread
+	std::unordered_set<RefCountedObject*> pinnedObjects;
+	std::unordered_set<RefCountedObject*> escapedObjects;
+
+	// Queued by other threads.  Once the thread has no stacks the queue is closed, and queuing threads merge for it
+	std::mutex queueMutex;
+	std::vector<RefCountedObject*> queuedObjects;
+	std::atomic<bool> hasQueuedObjects;
+	bool queueClosed;
+};
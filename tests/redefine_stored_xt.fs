@@ -0,0 +1,17 @@
+\ An execution token stored at run time must stay valid after its word is redefined, and forget must reveal the
+\  previous definition however many lines (and so reconciliations) come between.  Prints 1, 1, then 4
+: foo 1 ;
+` foo array_type construct variable av
+: foo 2 ;
+: zz 3 ;
+av @ 0 swap [n] execute . cr
+: bar 4 ;
+: bar 5 ;
+: bar 6 ;
+forget bar
+forget bar
+forget foo
+foo . cr
+: bar 7 ;
+forget bar
+bar . cr
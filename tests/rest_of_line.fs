@@ -0,0 +1,7 @@
+\ A failing word, an unknown word or a comment at the end of a line must not lose the next line.  Prints 1 to 4
+nosuchword
+1 . cr
+1 0 /
+2 . cr
+3 . cr \
+4 . cr